@@ -0,0 +1,326 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Read alignments from BAM or CRAM files
+// ***************************************************************************
+
+#include "alignmentReader.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#ifdef HAVE_HTSLIB
+#include <htslib/hts.h>
+#include <htslib/sam.h>
+#endif
+
+using namespace std;
+
+// Whether a file name is that of a CRAM file.
+bool isCramFile(const string& filename) {
+  return filename.size() > 5 && filename.compare(filename.size() - 5, 5, ".cram") == 0;
+}
+
+#ifdef HAVE_HTSLIB
+
+// A CRAM file, its index and the next alignment read from it.
+struct cramFile {
+  string filename;
+  samFile* file;
+  sam_hdr_t* header;
+  hts_idx_t* index;
+  hts_itr_t* iterator;
+  bam1_t* next;
+  bool hasNext;
+};
+
+// The CIGAR operations in the order of their BAM codes.
+static const char CIGAR_TYPES[] = "MIDNSHP=X";
+
+static bool sameReference(const RefData& a, const RefData& b) {
+  return a.RefName == b.RefName && a.RefLength == b.RefLength;
+}
+
+static void closeCram(cramFile* cram) {
+  if (cram->iterator != NULL) { hts_itr_destroy(cram->iterator); }
+  if (cram->index != NULL) { hts_idx_destroy(cram->index); }
+  if (cram->next != NULL) { bam_destroy1(cram->next); }
+  if (cram->header != NULL) { sam_hdr_destroy(cram->header); }
+  if (cram->file != NULL) { sam_close(cram->file); }
+  delete cram;
+}
+
+// Read the next alignment from a CRAM file, from the current region if one is set. Returns false if
+// the file cannot be decoded, in which case there is no next alignment.
+static bool readNext(cramFile* cram) {
+  int result;
+  if (cram->iterator != NULL) { result = sam_itr_next(cram->file, cram->iterator, cram->next); }
+  else { result = sam_read1(cram->file, cram->header, cram->next); }
+  cram->hasNext = (result >= 0);
+  return result >= -1;
+}
+
+// Copy the core alignment data, and the read name and base qualities if required, into a
+// BamAlignment, in the same form as BamReader and bamStream produce.
+static void fillAlignment(const bam1_t* record, bool names, bool qualities, BamAlignment& al) {
+  const bam1_core_t& core = record->core;
+  al.RefID         = core.tid;
+  al.Position      = core.pos;
+  al.Bin           = core.bin;
+  al.MapQuality    = core.qual;
+  al.AlignmentFlag = core.flag;
+  al.Length        = core.l_qseq;
+  al.MateRefID     = core.mtid;
+  al.MatePosition  = core.mpos;
+  al.InsertSize    = core.isize;
+
+  const uint32_t* cigar = bam_get_cigar(record);
+  al.CigarData.clear();
+  for (uint32_t i = 0; i < core.n_cigar; ++i) {
+    unsigned int op = bam_cigar_op(cigar[i]);
+    al.CigarData.push_back(CigarOp(CIGAR_TYPES[op < 9 ? op : 0], bam_cigar_oplen(cigar[i])));
+  }
+
+  if (names) { al.Name = bam_get_qname(record); }
+  al.Qualities.clear();
+  if (qualities && core.l_qseq > 0) {
+    const uint8_t* quality = bam_get_qual(record);
+    if (quality[0] != 0xff) {
+      al.Qualities.assign((const char*)quality, core.l_qseq);
+      for (int32_t i = 0; i < core.l_qseq; ++i) { al.Qualities[i] += 33; }
+    }
+  }
+}
+
+#else
+
+struct cramFile {
+};
+
+static void closeCram(cramFile* cram) {
+  delete cram;
+}
+
+#endif // HAVE_HTSLIB
+
+// Constructor
+alignmentReader::alignmentReader(void) {
+  cramInput    = false;
+  names        = false;
+  qualities    = false;
+  threads      = 1;
+  currentRefID = -1;
+  failed       = false;
+}
+
+alignmentReader::~alignmentReader(void) {
+  Close();
+}
+
+// Set the fields needed in addition to the core alignment data: the read names and the base
+// qualities. This must be called before the files are opened.
+void alignmentReader::SetRequiredFields(bool readNames, bool baseQualities) {
+  names     = readNames;
+  qualities = baseQualities;
+}
+
+// Set the number of threads decompressing each CRAM file. BAM files are always read on the
+// calling thread.
+void alignmentReader::SetThreads(int numberThreads) {
+  threads = numberThreads;
+#ifdef HAVE_HTSLIB
+  if (threads > 1) {
+    for (size_t i = 0; i < cramFiles.size(); ++i) { hts_set_threads(cramFiles[i]->file, threads); }
+  }
+#endif
+}
+
+// Open the files. The files must either all be BAM or all be CRAM.
+bool alignmentReader::Open(const vector<string>& filenames) {
+  Close();
+  errorString.clear();
+  size_t numberCram = count_if(filenames.begin(), filenames.end(), isCramFile);
+  if (numberCram == 0) { return bam.Open(filenames); }
+  if (numberCram != filenames.size()) {
+    errorString = "BAM and CRAM files cannot be read together";
+    return false;
+  }
+  cramInput = true;
+
+#ifdef HAVE_HTSLIB
+  // Only decode the fields that are used. The bases are never needed for the depth, so CRAM files
+  // are decoded without the reference sequence.
+  int fields = SAM_FLAG | SAM_RNAME | SAM_POS | SAM_MAPQ | SAM_CIGAR | SAM_RNEXT | SAM_PNEXT | SAM_TLEN;
+  if (names) { fields |= SAM_QNAME; }
+  if (qualities) { fields |= SAM_QUAL; }
+
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    cramFile* file = new cramFile;
+    file->filename = filenames[i];
+    file->header   = NULL;
+    file->index    = NULL;
+    file->iterator = NULL;
+    file->next     = NULL;
+    file->hasNext  = false;
+    file->file     = sam_open(filenames[i].c_str(), "r");
+    if (file->file == NULL) {
+      delete file;
+      errorString = filenames[i] + ": could not open the file";
+      return false;
+    }
+    cramFiles.push_back(file);
+    if (hts_get_format(file->file)->format != cram) {
+      errorString = filenames[i] + ": not a CRAM file";
+      return false;
+    }
+    hts_set_opt(file->file, CRAM_OPT_REQUIRED_FIELDS, fields);
+    hts_set_opt(file->file, CRAM_OPT_DECODE_MD, 0);
+    if (threads > 1) { hts_set_threads(file->file, threads); }
+
+    file->header = sam_hdr_read(file->file);
+    if (file->header == NULL) {
+      errorString = filenames[i] + ": could not read the header";
+      return false;
+    }
+    file->next = bam_init1();
+
+    // The reference sequences are taken from the first file, and the other files must match.
+    RefVector fileReferences;
+    for (int ref = 0; ref < sam_hdr_nref(file->header); ++ref) {
+      fileReferences.push_back(RefData(sam_hdr_tid2name(file->header, ref), (int32_t)sam_hdr_tid2len(file->header, ref)));
+    }
+    if (i == 0) {
+      headerText = sam_hdr_str(file->header);
+      references = fileReferences;
+    } else if (fileReferences.size() != references.size() || !equal(references.begin(), references.end(), fileReferences.begin(), sameReference)) {
+      errorString = filenames[i] + ": different reference sequences from " + filenames[0];
+      return false;
+    }
+  }
+
+  // Read the first alignment from each file.
+  for (size_t i = 0; i < cramFiles.size(); ++i) {
+    if ( !readNext(cramFiles[i]) ) { return fail(cramFiles[i]); }
+  }
+  return true;
+#else
+  errorString = "CRAM files can only be read if the program is built with htslib";
+  return false;
+#endif
+}
+
+void alignmentReader::Close(void) {
+  bam.Close();
+  for (size_t i = 0; i < cramFiles.size(); ++i) { closeCram(cramFiles[i]); }
+  cramFiles.clear();
+  cramInput    = false;
+  currentRefID = -1;
+  failed       = false;
+  headerText.clear();
+  references.clear();
+}
+
+// Load the index of each file.
+bool alignmentReader::LocateIndexes(void) {
+  if (!cramInput) { return bam.LocateIndexes(); }
+  bool found = true;
+#ifdef HAVE_HTSLIB
+  for (size_t i = 0; i < cramFiles.size(); ++i) {
+    cramFiles[i]->index = sam_index_load(cramFiles[i]->file, cramFiles[i]->filename.c_str());
+    if (cramFiles[i]->index == NULL) { found = false; }
+  }
+#endif
+  return found;
+}
+
+bool alignmentReader::HasIndexes(void) const {
+  if (!cramInput) { return bam.HasIndexes(); }
+#ifdef HAVE_HTSLIB
+  for (size_t i = 0; i < cramFiles.size(); ++i) {
+    if (cramFiles[i]->index == NULL) { return false; }
+  }
+#endif
+  return !cramFiles.empty();
+}
+
+// Read the alignments in a region, which may span several references. The same alignments are
+// returned as BamMultiReader returns: those that start before the right position and end at or
+// after the left position.
+bool alignmentReader::SetRegion(const int& leftRefID, const int& leftPosition, const int& rightRefID, const int& rightPosition) {
+  if (!cramInput) { return bam.SetRegion(leftRefID, leftPosition, rightRefID, rightPosition); }
+  if (!HasIndexes() || leftRefID < 0 || rightRefID < leftRefID || rightRefID >= (int)references.size()) { return false; }
+  region = BamRegion(leftRefID, leftPosition, rightRefID, rightPosition);
+  return startReference(leftRefID);
+}
+
+// Start reading the part of the region on a reference. An alignment ending at the left position
+// overlaps the base before it, so the query starts one base early.
+bool alignmentReader::startReference(int refID) {
+  currentRefID = refID;
+#ifdef HAVE_HTSLIB
+  hts_pos_t begin = (refID == region.LeftRefID) ? max(region.LeftPosition - 1, 0) : 0;
+  hts_pos_t end   = (refID == region.RightRefID) ? region.RightPosition : references[refID].RefLength;
+  for (size_t i = 0; i < cramFiles.size(); ++i) {
+    cramFile* file = cramFiles[i];
+    if (file->iterator != NULL) { hts_itr_destroy(file->iterator); }
+    file->iterator = sam_itr_queryi(file->index, refID, begin, end);
+    if (file->iterator == NULL) { return false; }
+    if ( !readNext(file) ) { return fail(file); }
+  }
+#endif
+  return true;
+}
+
+// Return the next alignment across all files, ordered by reference and position. Unmapped reads
+// (reference -1) sort last. Once a file cannot be decoded, no more alignments are returned.
+bool alignmentReader::GetNextAlignmentCore(BamAlignment& al) {
+  if (!cramInput) { return bam.GetNextAlignmentCore(al); }
+#ifdef HAVE_HTSLIB
+  if (failed) { return false; }
+  while (true) {
+    cramFile* first = NULL;
+    for (size_t i = 0; i < cramFiles.size(); ++i) {
+      cramFile* file = cramFiles[i];
+      if (!file->hasNext) { continue; }
+      if (first == NULL) { first = file; }
+      else {
+        unsigned int refID      = file->next->core.tid;
+        unsigned int firstRefID = first->next->core.tid;
+        if (refID < firstRefID || (refID == firstRefID && file->next->core.pos < first->next->core.pos)) { first = file; }
+      }
+    }
+    if (first != NULL) {
+      fillAlignment(first->next, names, qualities, al);
+      if ( !readNext(first) ) { fail(first); }
+      return true;
+    }
+
+    // Move on to the next reference in the region.
+    if (currentRefID < 0 || currentRefID >= region.RightRefID) { return false; }
+    if ( !startReference(currentRefID + 1) ) { return false; }
+  }
+#else
+  return false;
+#endif
+}
+
+// Record that a file could not be decoded. Always returns false.
+bool alignmentReader::fail(cramFile* file) {
+#ifdef HAVE_HTSLIB
+  errorString = file->filename + ": could not decode the alignments";
+#endif
+  failed = true;
+  return false;
+}
+
+string alignmentReader::GetHeaderText(void) const {
+  return cramInput ? headerText : bam.GetHeaderText();
+}
+
+RefVector alignmentReader::GetReferenceData(void) const {
+  return cramInput ? references : bam.GetReferenceData();
+}
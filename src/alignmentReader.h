@@ -0,0 +1,88 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Read alignments from BAM or CRAM files
+// ***************************************************************************
+
+#ifndef ALIGNMENT_READER_H
+#define ALIGNMENT_READER_H
+
+#include "api/BamAlignment.h"
+#include "api/BamMultiReader.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// A CRAM file opened through htslib. The htslib types are kept out of this
+// header, so nothing else depends on htslib.
+struct cramFile;
+
+// Read alignments from a set of BAM files through BamMultiReader or, if the
+// program was built with htslib, from a set of CRAM files. The methods are those
+// of BamMultiReader, so the coverage calculations do not depend on the format.
+// Only the core alignment data is read from CRAM files: the bases are never
+// decoded, so no reference sequence is needed. The read names and base
+// qualities are decoded only if they are required. If a CRAM file cannot be
+// decoded part way through, no more alignments are returned and HasFailed is
+// set, with GetErrorString naming the file.
+class alignmentReader {
+
+  public:
+    alignmentReader(void);
+    ~alignmentReader(void);
+
+  // Public methods.
+  public:
+    void SetRequiredFields(bool, bool);
+    void SetThreads(int);
+    bool Open(const vector<string>&);
+    void Close(void);
+    bool LocateIndexes(void);
+    bool HasIndexes(void) const;
+    bool SetRegion(const int&, const int&, const int&, const int&);
+    bool GetNextAlignmentCore(BamAlignment&);
+    string GetHeaderText(void) const;
+    RefVector GetReferenceData(void) const;
+    bool IsCram(void) const { return cramInput; }
+    string GetErrorString(void) const { return errorString; }
+    bool HasFailed(void) const { return failed; }
+
+  private:
+    bool startReference(int);
+    bool fail(cramFile*);
+
+  private:
+    BamMultiReader bam;
+    bool cramInput;
+    vector<cramFile*> cramFiles;
+
+    // The fields decoded in addition to the core alignment data.
+    bool names;
+    bool qualities;
+
+    // The number of threads decompressing each CRAM file.
+    int threads;
+
+    // The region being read from the CRAM files and the reference currently
+    // being read. A region may span several references.
+    BamRegion region;
+    int currentRefID;
+
+    string headerText;
+    RefVector references;
+    string errorString;
+
+    // Set when a file cannot be decoded part way through.
+    bool failed;
+};
+
+// Whether a file name is that of a CRAM file.
+bool isCramFile(const string&);
+
+#endif // ALIGNMENT_READER_H
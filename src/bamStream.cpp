@@ -0,0 +1,209 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Stream alignments from sorted BAM files using the parallel BGZF reader
+// ***************************************************************************
+
+#include "bamStream.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+// Read a little endian 32 bit integer.
+static inline int32_t unpackInt32(const char* data) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  return (int32_t)(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24));
+}
+
+static inline uint16_t unpackUint16(const char* data) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  return bytes[0] | (bytes[1] << 8);
+}
+
+// The CIGAR operations in the order of their BAM codes.
+static const char CIGAR_TYPES[] = "MIDNSHP=X";
+
+// Constructor
+bamStream::bamStream(void) {
+  filter = NULL;
+}
+
+bamStream::~bamStream(void) {
+  Close();
+}
+
+// Open the file and read the header.
+bool bamStream::Open(const string& file, int numberThreads) {
+  filename = file;
+  errorString.clear();
+  if ( !bgzf.Open(filename, numberThreads) ) {
+    errorString = bgzf.GetErrorString();
+    return false;
+  }
+
+  // Check the magic string and read the header text.
+  char buffer[4];
+  if ( !bgzf.Read(buffer, 4) || memcmp(buffer, "BAM\1", 4) != 0 ) { return fail("not a BAM file"); }
+  if ( !bgzf.Read(buffer, 4) ) { return fail("truncated header"); }
+  int32_t textLength = unpackInt32(buffer);
+  if (textLength < 0) { return fail("truncated header"); }
+  headerText.resize(textLength);
+  if ( textLength > 0 && !bgzf.Read(&headerText[0], textLength) ) { return fail("truncated header"); }
+  headerText.resize(strlen(headerText.c_str()));
+
+  // Read the reference sequences.
+  if ( !bgzf.Read(buffer, 4) ) { return fail("truncated reference sequence dictionary"); }
+  int32_t numberReferences = unpackInt32(buffer);
+  references.clear();
+  for (int32_t i = 0; i < numberReferences; ++i) {
+    if ( !bgzf.Read(buffer, 4) ) { return fail("truncated reference sequence dictionary"); }
+    int32_t nameLength = unpackInt32(buffer);
+    if (nameLength <= 0) { return fail("truncated reference sequence dictionary"); }
+    string name(nameLength, '\0');
+    if ( !bgzf.Read(&name[0], nameLength) || !bgzf.Read(buffer, 4) ) { return fail("truncated reference sequence dictionary"); }
+    name.resize(nameLength - 1);
+    references.push_back(RefData(name, unpackInt32(buffer)));
+  }
+  return true;
+}
+
+void bamStream::Close(void) {
+  bgzf.Close();
+}
+
+string bamStream::GetErrorString(void) const {
+  return errorString.empty() ? bgzf.GetErrorString() : errorString;
+}
+
+// Record an error in the alignment records. A failure to read the file itself is reported by
+// the BGZF reader instead.
+bool bamStream::fail(const string& message) {
+  if (bgzf.GetErrorString().empty()) { errorString = filename + ": " + message; }
+  return false;
+}
+
+// Decode the next alignment. The fixed fields and CIGAR are parsed directly from the record; the
+// read name, bases, qualities and tags are not decoded.
+bool bamStream::GetNextAlignmentCore(BamAlignment& al) {
+  char buffer[4];
+  char* data;
+  int32_t blockSize;
+  while (true) {
+    if ( !bgzf.Read(buffer, 4) ) { return false; }
+    blockSize = unpackInt32(buffer);
+    if (blockSize < 32) { return fail("malformed alignment record"); }
+    if ((size_t)blockSize > record.size()) { record.resize(blockSize); }
+    data = &record[0];
+    if ( !bgzf.Read(data, blockSize) ) { return fail("truncated alignment record"); }
+
+    // Test the flag and mapping quality before decoding anything else.
+    if (filter == NULL || filter->pass(unpackUint16(data + 14), (unsigned char)data[9])) { break; }
+  }
+
+  al.RefID         = unpackInt32(data);
+  al.Position      = unpackInt32(data + 4);
+  uint8_t nameSize = data[8];
+  al.MapQuality    = (unsigned char)data[9];
+  al.Bin           = unpackUint16(data + 10);
+  uint16_t ops     = unpackUint16(data + 12);
+  al.AlignmentFlag = unpackUint16(data + 14);
+  al.Length        = unpackInt32(data + 16);
+  al.MateRefID     = unpackInt32(data + 20);
+  al.MatePosition  = unpackInt32(data + 24);
+  al.InsertSize    = unpackInt32(data + 28);
+
+  // The CIGAR follows the read name.
+  if (32 + nameSize + 4 * ops > blockSize) { return fail("malformed alignment record"); }
+  const char* cigar = data + 32 + nameSize;
+  al.CigarData.clear();
+  for (uint16_t i = 0; i < ops; ++i) {
+    uint32_t op = (uint32_t)unpackInt32(cigar + 4 * i);
+    al.CigarData.push_back(CigarOp(CIGAR_TYPES[(op & 0xf) < 9 ? (op & 0xf) : 0], op >> 4));
+  }
+
+  // The read name is needed to track mates.
+  if (filter != NULL && filter->mates.enabled()) { al.Name.assign(data + 32, nameSize > 0 ? nameSize - 1 : 0); }
+
+  // The base qualities follow the bases. They are stored as phred+33 text, as bamtools does, and
+  // are left empty if the read has no qualities.
+  al.Qualities.clear();
+  if (filter != NULL && filter->minBaseQuality > 0 && al.Length > 0) {
+    int32_t offset = 32 + nameSize + 4 * ops + (al.Length + 1) / 2;
+    if (offset + al.Length > blockSize) { return fail("malformed alignment record"); }
+    if ((unsigned char)data[offset] != 0xff) {
+      al.Qualities.assign(data + offset, al.Length);
+      for (int32_t i = 0; i < al.Length; ++i) { al.Qualities[i] += 33; }
+    }
+  }
+  return true;
+}
+
+// Constructor
+bamMultiStream::bamMultiStream(void) {
+}
+
+bamMultiStream::~bamMultiStream(void) {
+  Close();
+}
+
+// Open all of the files. The inflate threads are shared between the files. The filter, which may
+// be NULL, is applied to every file.
+bool bamMultiStream::Open(const vector<string>& filenames, int numberThreads, readFilter* filter) {
+  Close();
+  int threadsPerFile = max(1, numberThreads / (int)filenames.size());
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    bamStream* stream = new bamStream;
+    streams.push_back(stream);
+    if ( !stream->Open(filenames[i], threadsPerFile) ) {
+      errorString = stream->GetErrorString();
+      return false;
+    }
+    stream->SetFilter(filter);
+  }
+
+  // Read the first alignment from each file.
+  next.resize(streams.size());
+  hasNext.resize(streams.size());
+  for (size_t i = 0; i < streams.size(); ++i) { hasNext[i] = streams[i]->GetNextAlignmentCore(next[i]); }
+  return true;
+}
+
+void bamMultiStream::Close(void) {
+  for (size_t i = 0; i < streams.size(); ++i) { delete streams[i]; }
+  streams.clear();
+  next.clear();
+  hasNext.clear();
+}
+
+// Return the next alignment across all files, ordered by reference and position. Unmapped reads
+// (reference -1) sort last.
+bool bamMultiStream::GetNextAlignmentCore(BamAlignment& al) {
+  int first = -1;
+  for (size_t i = 0; i < streams.size(); ++i) {
+    if (!hasNext[i]) { continue; }
+    if (first == -1) { first = i; }
+    else {
+      unsigned int refID      = next[i].RefID;
+      unsigned int firstRefID = next[first].RefID;
+      if (refID < firstRefID || (refID == firstRefID && next[i].Position < next[first].Position)) { first = i; }
+    }
+  }
+  if (first == -1) {
+    for (size_t i = 0; i < streams.size(); ++i) {
+      string error = streams[i]->GetErrorString();
+      if (!error.empty()) { errorString = error; }
+    }
+    return false;
+  }
+
+  // Swap the buffers rather than copying, so no allocation takes place.
+  swap(al, next[first]);
+  hasNext[first] = streams[first]->GetNextAlignmentCore(next[first]);
+  return true;
+}
@@ -0,0 +1,81 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Stream alignments from sorted BAM files using the parallel BGZF reader
+// ***************************************************************************
+
+#ifndef BAM_STREAM_H
+#define BAM_STREAM_H
+
+#include "api/BamAlignment.h"
+#include "bgzfReader.h"
+#include "readFilter.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// Read the alignments in a BAM file from start to finish. Only the core
+// alignment data is decoded, in the same way as BamReader::GetNextAlignmentCore.
+// If a filter is set, records failing the flag and mapping quality tests are
+// skipped before their CIGAR is decoded, and the base qualities are decoded if
+// the filter needs them.
+class bamStream {
+
+  public:
+    bamStream(void);
+    ~bamStream(void);
+
+  // Public methods.
+  public:
+    bool Open(const string&, int);
+    void Close(void);
+    bool GetNextAlignmentCore(BamAlignment&);
+    void SetFilter(readFilter* f) { filter = f; }
+    const RefVector& GetReferenceData(void) const { return references; }
+    const string& GetHeaderText(void) const { return headerText; }
+    string GetErrorString(void) const;
+
+  private:
+    bool fail(const string&);
+
+  private:
+    bgzfReader bgzf;
+    string filename;
+    string headerText;
+    RefVector references;
+    string errorString;
+    readFilter* filter;
+
+    // The raw alignment record, reused for every alignment.
+    vector<char> record;
+};
+
+// Merge the alignments from several sorted BAM files into a single sorted stream,
+// in the same way as BamMultiReader.
+class bamMultiStream {
+
+  public:
+    bamMultiStream(void);
+    ~bamMultiStream(void);
+
+  // Public methods.
+  public:
+    bool Open(const vector<string>&, int, readFilter*);
+    void Close(void);
+    bool GetNextAlignmentCore(BamAlignment&);
+    string GetErrorString(void) const { return errorString; }
+
+  private:
+    vector<bamStream*> streams;
+    vector<BamAlignment> next;
+    vector<bool> hasNext;
+    string errorString;
+};
+
+#endif // BAM_STREAM_H
@@ -0,0 +1,479 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Benchmark the coverage engines and alignment decoding
+// ***************************************************************************
+
+#include "api/BamMultiReader.h"
+#include "api/BamReader.h"
+#include "api/BamWriter.h"
+#include "alignmentReader.h"
+#include "dataProcessing.h"
+#include "depthAccumulator.h"
+#include "outputWriter.h"
+#include "regions.h"
+#include <getopt.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace BamTools;
+
+// Return the current wall clock time in seconds.
+double wallTime() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Return a monotonic time in seconds, for timing short intervals.
+static inline double monotonicTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Order alignments by position, as they would be returned from a sorted BAM.
+bool comparePosition(const BamAlignment& a, const BamAlignment& b) {
+  return a.Position < b.Position;
+}
+
+// Build a set of random alignments covering a region at the requested depth. Alignments
+// may start before the region, as they would when reading a region from an indexed BAM.
+void generateAlignments(int depth, int readLength, int regionLength, double indelRate, double clipRate, vector<BamAlignment>& alignments) {
+  long numberReads = (long)depth * regionLength / readLength;
+  alignments.resize(numberReads);
+
+  for (long i = 0; i < numberReads; ++i) {
+    BamAlignment& al = alignments[i];
+    al.RefID    = 0;
+    al.Position = (rand() % (regionLength + readLength)) - readLength;
+    al.CigarData.clear();
+
+    // Optionally soft clip the start of the read.
+    int remaining = readLength;
+    if (rand() < clipRate * RAND_MAX) {
+      int clip = 1 + rand() % 20;
+      al.CigarData.push_back(CigarOp('S', clip));
+      remaining -= clip;
+    }
+
+    // Split the rest of the read into matches separated by insertions and deletions.
+    int block = 0;
+    for (; remaining > 0; --remaining) {
+      block++;
+      if (remaining > 1 && rand() < indelRate * RAND_MAX) {
+        al.CigarData.push_back(CigarOp('M', block));
+        al.CigarData.push_back(CigarOp((rand() % 2) ? 'I' : 'D', 1 + rand() % 5));
+        block = 0;
+      }
+    }
+    if (block > 0) { al.CigarData.push_back(CigarOp('M', block)); }
+  }
+  sort(alignments.begin(), alignments.end(), comparePosition);
+}
+
+// Compare the per-base and event based accumulation engines on synthetic alignments.
+void benchmarkAccumulation(int depth, int readLength, int regionLength, double indelRate, double clipRate, int repeats, unsigned int seed) {
+
+  // Generate the alignments.
+  srand(seed);
+  vector<BamAlignment> alignments;
+  generateAlignments(depth, readLength, regionLength, indelRate, clipRate, alignments);
+  int coverageStart = alignments.empty() ? 0 : min(alignments.front().Position, 0);
+  int length        = regionLength - coverageStart;
+  BamRegion region(0, 0, 0, regionLength);
+
+  // Time the per-base engine.
+  vector<int> incrementCoverage;
+  double begin = wallTime();
+  for (int r = 0; r < repeats; ++r) {
+    incrementCoverage.assign(length, 0);
+    vector<BamAlignment>::iterator iter    = alignments.begin();
+    vector<BamAlignment>::iterator iterEnd = alignments.end();
+    for (; iter != iterEnd; ++iter) { processCigar(*iter, region, coverageStart, incrementCoverage); }
+  }
+  double incrementTime = (wallTime() - begin) / repeats;
+
+  // Time the event based engine.
+  depthAccumulator accumulator;
+  vector<int> deltaCoverage;
+  begin = wallTime();
+  for (int r = 0; r < repeats; ++r) {
+    accumulator.reset(coverageStart, length);
+    vector<BamAlignment>::iterator iter    = alignments.begin();
+    vector<BamAlignment>::iterator iterEnd = alignments.end();
+    for (; iter != iterEnd; ++iter) { accumulator.addAlignment(*iter); }
+    accumulator.resolve(deltaCoverage);
+  }
+  double deltaTime = (wallTime() - begin) / repeats;
+
+  // The two engines must agree exactly.
+  if (incrementCoverage != deltaCoverage) {
+    cerr << "ERROR: the per-base and event based engines produced different depths." << endl;
+    exit(1);
+  }
+
+  cout << "#engine\treads\tbases\tseconds\treads_per_second" << endl;
+  cout << "increment\t" << alignments.size() << "\t" << length << "\t" << incrementTime << "\t" << alignments.size() / incrementTime << endl;
+  cout << "delta\t" << alignments.size() << "\t" << length << "\t" << deltaTime << "\t" << alignments.size() / deltaTime << endl;
+  cout << "#speedup\t" << incrementTime / deltaTime << endl;
+}
+
+// The length of the gap between simulated genes.
+#define SIMULATED_GENE_GAP 10000
+
+// Write a sorted, indexed BAM file of synthetic alignments, PREFIX.bam, and a matching regions
+// file, PREFIX.regions.txt. The genes are laid out along a single reference, separated by gaps,
+// and the exons are spread evenly across each gene. Each gene is covered end to end at the
+// requested depth. The read names, bases and qualities are random.
+void simulate(const string& prefix, int depth, int readLength, double indelRate, double clipRate, int numberGenes, int numberExons, int geneLength, unsigned int seed) {
+  if (readLength >= SIMULATED_GENE_GAP) {
+    cerr << "The read length must be less than " << SIMULATED_GENE_GAP << " to simulate a BAM file." << endl;
+    exit(1);
+  }
+  srand(seed);
+  long referenceLength = (long)numberGenes * (geneLength + SIMULATED_GENE_GAP) + SIMULATED_GENE_GAP;
+  RefVector references(1, RefData("chr1", referenceLength));
+  ostringstream header;
+  header << "@HD\tVN:1.6\tSO:coordinate\n@SQ\tSN:chr1\tLN:" << referenceLength << "\n@RG\tID:synthetic\tSM:synthetic\n";
+
+  string bamFile = prefix + ".bam";
+  BamWriter writer;
+  if ( !writer.Open(bamFile, header.str(), references) ) {
+    cerr << "ERROR: could not open " << bamFile << " for writing." << endl;
+    exit(1);
+  }
+  string regionsFile = prefix + ".regions.txt";
+  ofstream regions(regionsFile.c_str());
+  if (!regions) {
+    cerr << "ERROR: could not open " << regionsFile << " for writing." << endl;
+    exit(1);
+  }
+
+  // Each exon takes up to a third of its share of the gene.
+  int exonLength = max(1, geneLength / numberExons / 3);
+  const char bases[] = "ACGT";
+  long numberReads   = 0;
+  vector<BamAlignment> alignments;
+  for (int gene = 0; gene < numberGenes; ++gene) {
+    int geneStart = SIMULATED_GENE_GAP + gene * (geneLength + SIMULATED_GENE_GAP);
+    regions << "#GENE" << gene + 1 << "\n";
+    for (int exon = 0; exon < numberExons; ++exon) {
+      int exonStart = geneStart + (long)exon * geneLength / numberExons;
+      regions << "chr1:" << exonStart + 1 << "-" << exonStart + exonLength << "\n";
+    }
+
+    // The genes are further apart than the read length, so the alignments of each gene can be
+    // written in turn and the file remains sorted.
+    generateAlignments(depth, readLength, geneLength, indelRate, clipRate, alignments);
+    vector<BamAlignment>::iterator iter    = alignments.begin();
+    vector<BamAlignment>::iterator iterEnd = alignments.end();
+    for (; iter != iterEnd; ++iter) {
+      BamAlignment& al = *iter;
+      ostringstream name;
+      name << "read" << ++numberReads;
+      al.Name          = name.str();
+      al.Position     += geneStart;
+      al.MapQuality    = 60;
+      al.AlignmentFlag = (rand() % 2) ? 0x10 : 0;
+
+      int queryLength = 0;
+      vector<CigarOp>::const_iterator cigarIter    = al.CigarData.begin();
+      vector<CigarOp>::const_iterator cigarIterEnd = al.CigarData.end();
+      for (; cigarIter != cigarIterEnd; ++cigarIter) {
+        if (cigarIter->Type == 'M' || cigarIter->Type == 'I' || cigarIter->Type == 'S') { queryLength += cigarIter->Length; }
+      }
+      al.QueryBases.resize(queryLength);
+      al.Qualities.resize(queryLength);
+      for (int i = 0; i < queryLength; ++i) {
+        al.QueryBases[i] = bases[rand() % 4];
+        al.Qualities[i]  = '#' + rand() % 39;
+      }
+      if ( !writer.SaveAlignment(al) ) {
+        cerr << "ERROR: could not write to " << bamFile << ": " << writer.GetErrorString() << endl;
+        exit(1);
+      }
+    }
+  }
+  writer.Close();
+  regions.close();
+
+  // Index the file, so the regions can be read through the index.
+  BamReader reader;
+  if ( !reader.Open(bamFile) || !reader.CreateIndex(BamIndex::STANDARD) ) {
+    cerr << "ERROR: could not index " << bamFile << endl;
+    exit(1);
+  }
+  reader.Close();
+  cerr << "Wrote " << numberReads << " alignments to " << bamFile << " and " << numberGenes * numberExons << " regions to " << regionsFile << endl;
+}
+
+// The stages of the coverage calculation that are timed separately.
+enum benchmarkStage { PARSE_REGIONS, SEEK, DECODE, ACCUMULATE, STATISTICS, OUTPUT, NUMBER_STAGES };
+static const char* STAGE_NAMES[NUMBER_STAGES] = {"parse_regions", "seek", "decode", "accumulate", "statistics", "output"};
+
+// Time each stage of the serial coverage calculation: parsing and compiling the regions, setting
+// each region on the reader, decoding the alignments, accumulating their depth, calculating the
+// statistics and formatting the output. The alignments are processed as calculateRegionCoverage
+// processes them. The output is formatted in memory and discarded. The times of the decode and
+// accumulate stages include the cost of reading the clock around each alignment.
+void benchmarkStages(vector<string>& inputFiles, const string& regionsFile, int repeats, const string& label) {
+  vector<double> seconds(NUMBER_STAGES, 0);
+  long numberReads = 0;
+  statisticsOptions statistics;
+  for (int r = 0; r < repeats; ++r) {
+    alignmentReader reader;
+    if ( !reader.Open(inputFiles) ) {
+      cerr << "ERROR: could not open input BAM file(s)... Aborting." << endl;
+      exit(1);
+    }
+    if ( !reader.LocateIndexes() ) {
+      cerr << "ERROR: the stage benchmark requires indexes for all BAM files." << endl;
+      exit(1);
+    }
+
+    double begin = monotonicTime();
+    regionTable table;
+    string error;
+    if ( !loadRegions(regionsFile, "", reader.GetReferenceData(), table, error) ) {
+      cerr << "ERROR: " << error << endl;
+      exit(1);
+    }
+    double end = monotonicTime();
+    seconds[PARSE_REGIONS] += end - begin;
+
+    BamAlignment al;
+    depthAccumulator accumulator;
+    vector<int> coverage;
+    outputWriter output;
+    string buffer;
+    numberReads = 0;
+    for (unsigned int gene = 0; gene < table.numberGenes(); ++gene) {
+      coverageData cov(table.numberRegions(gene), statistics);
+      for (unsigned int i = table.geneOffsets[gene]; i < table.geneOffsets[gene + 1]; ++i) {
+        BamRegion region = table.region(i);
+        int feature = cov.addFeature(table.regionStrings[i], region.RightPosition - region.LeftPosition + 1);
+
+        begin = monotonicTime();
+        reader.SetRegion(region.LeftRefID, region.LeftPosition, region.RightRefID, region.RightPosition);
+        end = monotonicTime();
+        seconds[SEEK] += end - begin;
+
+        begin = end;
+        bool hasAlignment = reader.GetNextAlignmentCore(al);
+        end = monotonicTime();
+        seconds[DECODE] += end - begin;
+        if (!hasAlignment) {
+          begin = end;
+          cov.noCoverage(feature);
+          seconds[STATISTICS] += monotonicTime() - begin;
+          continue;
+        }
+
+        begin = end;
+        int coverageStart = min(al.Position, region.LeftPosition);
+        accumulator.reset(coverageStart, region.RightPosition - coverageStart);
+        while (hasAlignment) {
+          accumulator.addAlignment(al);
+          numberReads++;
+          end = monotonicTime();
+          seconds[ACCUMULATE] += end - begin;
+
+          begin = end;
+          hasAlignment = reader.GetNextAlignmentCore(al);
+          end = monotonicTime();
+          seconds[DECODE] += end - begin;
+          begin = end;
+        }
+        accumulator.resolve(coverage);
+        end = monotonicTime();
+        seconds[ACCUMULATE] += end - begin;
+
+        begin = end;
+        cov.processFeature(coverage, region.LeftPosition - coverageStart, feature);
+        seconds[STATISTICS] += monotonicTime() - begin;
+      }
+      begin = monotonicTime();
+      cov.processGene();
+      end = monotonicTime();
+      seconds[STATISTICS] += end - begin;
+
+      // Format the statistics as the coverage tool does.
+      begin = end;
+      for (size_t i = 0; i < cov.size(); ++i) {
+        size_t idStart = (i > 0) ? cov.idEnds[i - 1] : 0;
+        output.write(cov.idText.data() + idStart, cov.idEnds[i] - idStart);
+        output << "\t" << cov.featureMin[i] << "\t" << cov.featureMax[i] << "\t" << cov.featureQ1[i] << "\t" << cov.featureMedian[i] << "\t" << cov.featureQ3[i] << "\t" << cov.featureMean[i] << "\t" << cov.featureSd[i] << '\n';
+      }
+      output << table.geneNames[gene] << "\tNA\t" << cov.geneMin << "\t" << cov.geneMax << "\t" << cov.geneQ1 << "\t" << cov.geneMedian << "\t" << cov.geneQ3 << "\t" << cov.geneMean << "\t" << cov.geneSd << '\n';
+      output.takeBuffer(buffer);
+      seconds[OUTPUT] += monotonicTime() - begin;
+    }
+    reader.Close();
+  }
+
+  // One line per stage, with the mean time over the repeats.
+  double total = 0;
+  for (int stage = 0; stage < NUMBER_STAGES; ++stage) {
+    seconds[stage] /= repeats;
+    total += seconds[stage];
+  }
+  cout << "#label\tstage\tseconds\tfraction\talignments" << endl;
+  for (int stage = 0; stage < NUMBER_STAGES; ++stage) {
+    cout << label << "\t" << STAGE_NAMES[stage] << "\t" << seconds[stage] << "\t" << seconds[stage] / total << "\t" << numberReads << endl;
+  }
+  cout << label << "\ttotal\t" << total << "\t1\t" << numberReads << endl;
+}
+
+// Read every alignment in a set of BAM files, returning the number read.
+long readAlignments(vector<string>& inputFiles, bool coreOnly) {
+  BamMultiReader reader;
+  if ( !reader.Open(inputFiles) ) {
+    cerr << "ERROR: could not open input BAM file(s)... Aborting." << endl;
+    exit(1);
+  }
+
+  long numberReads = 0;
+  BamAlignment al;
+  if (coreOnly) { while ( reader.GetNextAlignmentCore(al) ) { numberReads++; } }
+  else { while ( reader.GetNextAlignment(al) ) { numberReads++; } }
+  reader.Close();
+  return numberReads;
+}
+
+// Compare decoding of full alignments with decoding of the core data only.
+void benchmarkDecoding(vector<string>& inputFiles, int repeats) {
+  cout << "#decoder\treads\tseconds\treads_per_second" << endl;
+
+  const char* names[2] = {"full", "core"};
+  for (int core = 0; core < 2; ++core) {
+    long numberReads = 0;
+    double begin     = wallTime();
+    for (int r = 0; r < repeats; ++r) { numberReads = readAlignments(inputFiles, core == 1); }
+    double seconds = (wallTime() - begin) / repeats;
+    cout << names[core] << "\t" << numberReads << "\t" << seconds << "\t" << numberReads / seconds << endl;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  int c;
+  int depth          = 300;
+  int readLength     = 150;
+  int regionLength   = 100000;
+  int repeats        = 5;
+  double indelRate   = 0.001;
+  double clipRate    = 0.05;
+  unsigned int seed  = 1;
+  int numberGenes    = 50;
+  int numberExons    = 10;
+  int geneLength     = 20000;
+  string simulatePrefix;
+  string regionsFile;
+  string label       = "current";
+  bool stages        = false;
+  vector<string> inputFiles;
+
+  static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"depth", required_argument, 0, 'd'},
+      {"read-length", required_argument, 0, 'l'},
+      {"region-length", required_argument, 0, 'n'},
+      {"indel-rate", required_argument, 0, 'i'},
+      {"clip-rate", required_argument, 0, 'c'},
+      {"repeats", required_argument, 0, 'r'},
+      {"seed", required_argument, 0, 's'},
+      {"bam", required_argument, 0, 'b'},
+      {"simulate", required_argument, 0, 'S'},
+      {"genes", required_argument, 0, 'g'},
+      {"exons", required_argument, 0, 'e'},
+      {"gene-length", required_argument, 0, 'L'},
+      {"stages", no_argument, 0, 't'},
+      {"regions", required_argument, 0, 'R'},
+      {"label", required_argument, 0, 'a'},
+      {0, 0, 0, 0}
+    };
+
+  while (true) {
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hd:l:n:i:c:r:s:b:S:g:e:L:tR:a:", long_options, &option_index);
+
+    if (c == -1) // end of options
+      break;
+
+    switch (c) {
+      case 'd': depth        = atoi(optarg); break;
+      case 'l': readLength   = atoi(optarg); break;
+      case 'n': regionLength = atoi(optarg); break;
+      case 'i': indelRate    = atof(optarg); break;
+      case 'c': clipRate     = atof(optarg); break;
+      case 'r': repeats      = atoi(optarg); break;
+      case 's': seed         = atoi(optarg); break;
+      case 'b': inputFiles.push_back(optarg); break;
+      case 'S': simulatePrefix = optarg; break;
+      case 'g': numberGenes  = atoi(optarg); break;
+      case 'e': numberExons  = atoi(optarg); break;
+      case 'L': geneLength   = atoi(optarg); break;
+      case 't': stages       = true; break;
+      case 'R': regionsFile  = optarg; break;
+      case 'a': label        = optarg; break;
+
+      case 'h':
+        cout << "Usage: coverageBenchmark [--depth N] [--read-length N] [--region-length N]" << endl;
+        cout << "                         [--indel-rate F] [--clip-rate F] [--repeats N] [--seed N]" << endl;
+        cout << "       coverageBenchmark --bam FILE [--bam FILE] [--repeats N]" << endl;
+        cout << "       coverageBenchmark --simulate PREFIX [--depth N] [--read-length N] [--indel-rate F]" << endl;
+        cout << "                         [--clip-rate F] [--genes N] [--exons N] [--gene-length N] [--seed N]" << endl;
+        cout << "       coverageBenchmark --stages --bam FILE --regions FILE [--repeats N] [--label TEXT]" << endl;
+        cout << endl;
+        cout << "Without --bam, the per-base and event based accumulation engines are compared on" << endl;
+        cout << "synthetic alignments. With --bam, full and core-only alignment decoding are compared." << endl;
+        cout << "--simulate writes a synthetic sorted and indexed BAM, PREFIX.bam, and a matching regions" << endl;
+        cout << "file, PREFIX.regions.txt. --stages times each stage of the coverage calculation." << endl;
+        exit(0);
+
+      default:
+        abort ();
+    }
+  }
+
+  if (depth <= 0 || readLength <= 20 || regionLength <= 0 || repeats <= 0) {
+    cerr << "Depth, region length and repeats must be positive and the read length greater than 20." << endl;
+    exit(1);
+  }
+  if (numberGenes <= 0 || numberExons <= 0 || geneLength < numberExons) {
+    cerr << "The numbers of genes and exons must be positive and the gene length at least the number of exons." << endl;
+    exit(1);
+  }
+
+  // Write a synthetic data set.
+  if (simulatePrefix != "") {
+    simulate(simulatePrefix, depth, readLength, indelRate, clipRate, numberGenes, numberExons, geneLength, seed);
+    return 0;
+  }
+
+  // Time each stage of the coverage calculation.
+  if (stages) {
+    if (inputFiles.empty() || regionsFile == "") {
+      cerr << "The stage benchmark (--stages) requires BAM files (--bam) and a regions file (--regions)." << endl;
+      exit(1);
+    }
+    benchmarkStages(inputFiles, regionsFile, repeats, label);
+    return 0;
+  }
+
+  // Time decoding if BAM files were given, otherwise time accumulation.
+  if (inputFiles.size() > 0) { benchmarkDecoding(inputFiles, repeats); }
+  else { benchmarkAccumulation(depth, readLength, regionLength, indelRate, clipRate, repeats, seed); }
+}
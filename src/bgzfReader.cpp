@@ -0,0 +1,312 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Read BGZF files, inflating blocks ahead of the consumer on worker threads
+// ***************************************************************************
+
+#include "bgzfReader.h"
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#if defined(HAVE_LIBDEFLATE)
+#include <libdeflate.h>
+#elif defined(HAVE_ISAL)
+#include <isa-l/igzip_lib.h>
+#endif
+
+using namespace std;
+
+// BGZF blocks hold at most 64kb of compressed and of uncompressed data.
+#define BGZF_MAX_BLOCK_SIZE 65536
+#define BGZF_FOOTER_SIZE 8
+
+// Read little endian values from a byte buffer.
+static inline uint16_t unpackUint16(const char* data) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  return bytes[0] | (bytes[1] << 8);
+}
+
+static inline uint32_t unpackUint32(const char* data) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+// Inflate the raw deflate data of a single block. Each worker thread has its own decompressor.
+class blockInflater {
+
+  public:
+    blockInflater(void) {
+#if defined(HAVE_LIBDEFLATE)
+      decompressor = libdeflate_alloc_decompressor();
+#elif !defined(HAVE_ISAL)
+      memset(&stream, 0, sizeof(stream));
+      inflateInit2(&stream, -15);
+#endif
+    }
+
+    ~blockInflater(void) {
+#if defined(HAVE_LIBDEFLATE)
+      libdeflate_free_decompressor(decompressor);
+#elif !defined(HAVE_ISAL)
+      inflateEnd(&stream);
+#endif
+    }
+
+    bool inflate(const char* in, size_t inLength, char* out, size_t outLength) {
+#if defined(HAVE_LIBDEFLATE)
+      size_t actual;
+      if (libdeflate_deflate_decompress(decompressor, in, inLength, out, outLength, &actual) != LIBDEFLATE_SUCCESS) { return false; }
+      return actual == outLength;
+#elif defined(HAVE_ISAL)
+      struct inflate_state state;
+      isal_inflate_init(&state);
+      state.next_in   = (uint8_t*)in;
+      state.avail_in  = inLength;
+      state.next_out  = (uint8_t*)out;
+      state.avail_out = outLength;
+      state.crc_flag  = 0;
+      if (isal_inflate(&state) != ISAL_DECOMP_OK) { return false; }
+      return state.block_state == ISAL_BLOCK_FINISH && state.avail_out == 0;
+#else
+      inflateReset(&stream);
+      stream.next_in   = (Bytef*)in;
+      stream.avail_in  = inLength;
+      stream.next_out  = (Bytef*)out;
+      stream.avail_out = outLength;
+      if (::inflate(&stream, Z_FINISH) != Z_STREAM_END) { return false; }
+      return stream.avail_out == 0;
+#endif
+    }
+
+    uint32_t crc32(const char* data, size_t length) {
+#if defined(HAVE_LIBDEFLATE)
+      return libdeflate_crc32(0, data, length);
+#else
+      return ::crc32(0L, (const Bytef*)data, length);
+#endif
+    }
+
+  private:
+#if defined(HAVE_LIBDEFLATE)
+    struct libdeflate_decompressor* decompressor;
+#elif !defined(HAVE_ISAL)
+    z_stream stream;
+#endif
+};
+
+// Constructor
+bgzfReader::bgzfReader(void) {
+  file         = NULL;
+  blocksRead   = 0;
+  currentBlock = -1;
+  offset       = 0;
+  finished     = false;
+  failed       = false;
+  stopping     = false;
+}
+
+bgzfReader::~bgzfReader(void) {
+  Close();
+}
+
+// The inflate backend in use.
+const char* bgzfReader::Backend(void) {
+#if defined(HAVE_LIBDEFLATE)
+  return "libdeflate";
+#elif defined(HAVE_ISAL)
+  return "isa-l";
+#else
+  return "zlib";
+#endif
+}
+
+// Open the file and start the reading and inflating threads.
+bool bgzfReader::Open(const string& name, int numberThreads) {
+  Close();
+  filename = name;
+  file     = fopen(filename.c_str(), "rb");
+  if (file == NULL) {
+    errorString = "could not open " + filename;
+    return false;
+  }
+
+  if (numberThreads < 1) { numberThreads = 1; }
+  ring.resize(numberThreads * BGZF_BLOCKS_PER_THREAD);
+  for (size_t i = 0; i < ring.size(); ++i) {
+    ring[i].state = EMPTY;
+    ring[i].size  = 0;
+    ring[i].compressed.resize(BGZF_MAX_BLOCK_SIZE);
+    ring[i].data.resize(BGZF_MAX_BLOCK_SIZE);
+  }
+  blocksRead   = 0;
+  currentBlock = -1;
+  offset       = 0;
+  finished     = false;
+  failed       = false;
+  stopping     = false;
+
+  threads.push_back(thread(&bgzfReader::readBlocks, this));
+  for (int i = 0; i < numberThreads; ++i) { threads.push_back(thread(&bgzfReader::inflateBlocks, this)); }
+  return true;
+}
+
+// Stop the threads and close the file.
+void bgzfReader::Close(void) {
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  spaceAvailable.notify_all();
+  blockAvailable.notify_all();
+  blockInflated.notify_all();
+  for (size_t i = 0; i < threads.size(); ++i) { threads[i].join(); }
+  threads.clear();
+  toInflate.clear();
+  ring.clear();
+
+  if (file != NULL) {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+string bgzfReader::GetErrorString(void) const {
+  return errorString;
+}
+
+// Record an error. The caller must hold the lock.
+void bgzfReader::fail(const string& message) {
+  if (!failed) { errorString = filename + ": " + message; }
+  failed = true;
+  blockInflated.notify_all();
+}
+
+// Read the compressed blocks from the file into the ring.
+void bgzfReader::readBlocks(void) {
+  while (true) {
+
+    // Wait for the next slot in the ring to be free.
+    bgzfBlock* block;
+    {
+      unique_lock<mutex> guard(lock);
+      block = &ring[blocksRead % ring.size()];
+      spaceAvailable.wait(guard, [this, block] { return stopping || block->state == EMPTY; });
+      if (stopping) { return; }
+    }
+
+    // Read the fixed header and the extra field, and find the size of the block from the BC
+    // subfield.
+    char* data    = &block->compressed[0];
+    size_t header = fread(data, 1, 12, file);
+    if (header == 0 && feof(file)) {
+      lock_guard<mutex> guard(lock);
+      finished = true;
+      blockInflated.notify_all();
+      return;
+    }
+
+    size_t blockSize   = 0;
+    size_t extraLength = (header == 12) ? unpackUint16(data + 10) : 0;
+    if (header == 12 && (unsigned char)data[0] == 31 && (unsigned char)data[1] == 139 && (data[3] & 4) &&
+        fread(data + 12, 1, extraLength, file) == extraLength) {
+      header += extraLength;
+      for (size_t i = 12; i + 4 <= header; i += 4 + unpackUint16(data + i + 2)) {
+        if (data[i] == 'B' && data[i + 1] == 'C' && unpackUint16(data + i + 2) == 2 && i + 6 <= header) { blockSize = unpackUint16(data + i + 4) + 1; }
+      }
+    }
+
+    // Read the rest of the block.
+    if (blockSize < header + BGZF_FOOTER_SIZE || blockSize > BGZF_MAX_BLOCK_SIZE || fread(data + header, 1, blockSize - header, file) != blockSize - header) {
+      lock_guard<mutex> guard(lock);
+      fail("not a BGZF file, or a truncated or malformed block");
+      return;
+    }
+
+    // Hand the block to the inflate threads.
+    lock_guard<mutex> guard(lock);
+    block->size  = blockSize;
+    block->state = COMPRESSED;
+    toInflate.push_back(blocksRead++);
+    blockAvailable.notify_one();
+  }
+}
+
+// Inflate blocks as they are read from the file.
+void bgzfReader::inflateBlocks(void) {
+  blockInflater inflater;
+  while (true) {
+    long blockNumber;
+    {
+      unique_lock<mutex> guard(lock);
+      blockAvailable.wait(guard, [this] { return stopping || !toInflate.empty(); });
+      if (stopping) { return; }
+      blockNumber = toInflate.front();
+      toInflate.pop_front();
+    }
+
+    // The block belongs to this thread until it is marked as inflated.
+    bgzfBlock& block        = ring[blockNumber % ring.size()];
+    const char* compressed  = &block.compressed[0];
+    size_t extraLength      = unpackUint16(compressed + 10);
+    size_t dataOffset       = 12 + extraLength;
+    uint32_t expectedCrc    = unpackUint32(compressed + block.size - 8);
+    uint32_t inflatedLength = unpackUint32(compressed + block.size - 4);
+
+    bool ok = inflatedLength <= BGZF_MAX_BLOCK_SIZE && dataOffset + BGZF_FOOTER_SIZE <= block.size;
+    if (ok && inflatedLength > 0) {
+      ok = inflater.inflate(compressed + dataOffset, block.size - dataOffset - BGZF_FOOTER_SIZE, &block.data[0], inflatedLength) &&
+           inflater.crc32(&block.data[0], inflatedLength) == expectedCrc;
+    }
+
+    lock_guard<mutex> guard(lock);
+    if (!ok) {
+      fail("failed to inflate BGZF block");
+      return;
+    }
+    block.size  = inflatedLength;
+    block.state = INFLATED;
+    blockInflated.notify_all();
+  }
+}
+
+// Move on to the next inflated block, waiting for it if necessary. Returns false at the end of the
+// file or on error.
+bool bgzfReader::nextBlock(void) {
+  unique_lock<mutex> guard(lock);
+
+  // Release the current block back to the reading thread.
+  if (currentBlock >= 0) {
+    ring[currentBlock % ring.size()].state = EMPTY;
+    spaceAvailable.notify_one();
+  }
+  currentBlock++;
+  offset = 0;
+
+  bgzfBlock* block = &ring[currentBlock % ring.size()];
+  blockInflated.wait(guard, [this, block] { return failed || block->state == INFLATED || (finished && currentBlock >= blocksRead); });
+  return !failed && block->state == INFLATED;
+}
+
+// Read the next 'length' bytes of decompressed data. Returns false if the data is not available.
+bool bgzfReader::Read(char* data, size_t length) {
+  if (file == NULL) { return false; }
+  while (length > 0) {
+    if (currentBlock < 0 || offset == ring[currentBlock % ring.size()].size) {
+      if (!nextBlock()) { return false; }
+      continue;
+    }
+
+    bgzfBlock& block = ring[currentBlock % ring.size()];
+    size_t available = min(length, block.size - offset);
+    memcpy(data, &block.data[offset], available);
+    offset += available;
+    data   += available;
+    length -= available;
+  }
+  return true;
+}
@@ -0,0 +1,83 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Read BGZF files, inflating blocks ahead of the consumer on worker threads
+// ***************************************************************************
+
+#ifndef BGZF_READER_H
+#define BGZF_READER_H
+
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// The number of blocks that can be held in the ring for each worker thread.
+#define BGZF_BLOCKS_PER_THREAD 8
+
+// Sequential reader for a BGZF file. One thread reads compressed blocks from the
+// file into a bounded ring, a pool of worker threads inflates them and the
+// consumer reads the decompressed data in order. The inflate backend is chosen
+// at build time: libdeflate (HAVE_LIBDEFLATE), ISA-L (HAVE_ISAL) or zlib.
+class bgzfReader {
+
+  public:
+    bgzfReader(void);
+    ~bgzfReader(void);
+
+  // Public methods.
+  public:
+    bool Open(const string&, int);
+    void Close(void);
+    bool Read(char*, size_t);
+    string GetErrorString(void) const;
+    static const char* Backend(void);
+
+  private:
+    void readBlocks(void);
+    void inflateBlocks(void);
+    bool nextBlock(void);
+    void fail(const string&);
+
+    // States of a block in the ring.
+    enum blockState { EMPTY, COMPRESSED, INFLATED };
+
+    struct bgzfBlock {
+      blockState state;
+      vector<char> compressed;
+      vector<char> data;
+      size_t size;
+    };
+
+    FILE* file;
+    string filename;
+
+    // The ring of blocks. Block n (counting from the start of the file) is held in
+    // slot n % ring.size().
+    vector<bgzfBlock> ring;
+    deque<long> toInflate;
+    long blocksRead;
+    long currentBlock;
+    size_t offset;
+    bool finished;
+    bool failed;
+    bool stopping;
+    string errorString;
+
+    mutex lock;
+    condition_variable spaceAvailable;
+    condition_variable blockAvailable;
+    condition_variable blockInflated;
+    vector<thread> threads;
+};
+
+#endif // BGZF_READER_H
@@ -0,0 +1,124 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Calculate the coverage of fixed size bins across each reference sequence
+// ***************************************************************************
+
+#include "binnedCoverage.h"
+#include <algorithm>
+
+using namespace std;
+
+// Constructor
+binnedCoverage::binnedCoverage(int size, const statisticsOptions& statistics, readFilter& readFilter) : cov(0, statistics), filter(readFilter) {
+  binSize         = size;
+  referenceLength = 0;
+  binStart        = 0;
+  binNumber       = 0;
+  alignmentEnd    = 0;
+  depth           = 0;
+  ring.assign(max(BIN_WINDOW, 2 * binSize), 0);
+  binDepth.reserve(binSize);
+}
+
+binnedCoverage::~binnedCoverage(void) {
+}
+
+// Start binning a reference. The statistics of the previous reference must have been written, as
+// they are cleared.
+void binnedCoverage::beginReference(const string& name, int length) {
+  referenceName   = name;
+  referenceLength = length;
+  binStart        = 0;
+  binNumber       = 0;
+  alignmentEnd    = 0;
+  depth           = 0;
+  farEvents.clear();
+  fill(ring.begin(), ring.end(), 0);
+  cov.reset();
+  filter.mates.clear();
+}
+
+// Record a depth event at a position on the reference. Events before the next bin cannot happen
+// for sorted alignments, and events past the end of the reference are not needed.
+void binnedCoverage::addEvent(int position, int change) {
+  if (position < binStart) { position = binStart; }
+  if (position >= referenceLength) { return; }
+  if (position - binStart < (int)ring.size()) { ring[position % ring.size()] += change; }
+  else { farEvents[position] += change; }
+}
+
+// Close up to maxBins of the bins that end at or before a position. The bins before the start of
+// an alignment can be closed, as no later alignment can reach them, and all of the bins on the
+// reference are closed by passing the length of the reference. Returns false if there are more
+// bins to close.
+bool binnedCoverage::closeBins(int position, size_t maxBins) {
+  for (size_t closed = 0; ; ++closed) {
+    if (binStart >= referenceLength) { return true; }
+    if (position < referenceLength && binStart + binSize > position) { return true; }
+    if (closed == maxBins) { return false; }
+    closeBin();
+  }
+}
+
+// Add an alignment. The bins before its start must have been closed. The alignment is walked in the
+// same way as for a region.
+void binnedCoverage::addAlignment(const BamAlignment& al) {
+  alignmentEnd = max(alignmentEnd, al.GetEndPosition());
+  const vector<coveredBlock>* covered;
+  if (filter.needsBlocks()) { covered = &filter.coveredBlocks(al); }
+  else {
+    unsigned long masked = 0;
+    alignmentBlocks(al, 0, masked, blocks);
+    covered = &blocks;
+  }
+  vector<coveredBlock>::const_iterator iter    = covered->begin();
+  vector<coveredBlock>::const_iterator iterEnd = covered->end();
+  for (; iter != iterEnd; ++iter) {
+    if (iter->first >= iter->second) { continue; }
+    addEvent(iter->first, 1);
+    addEvent(iter->second, -1);
+  }
+}
+
+// Calculate the depth of the next bin from the events, add its statistics and move the window on.
+void binnedCoverage::closeBin(void) {
+  int binEnd = min(binStart + binSize, referenceLength);
+
+  // Bring any far events that are now in the window into the ring.
+  int windowEnd = binStart + (int)ring.size();
+  while ( !farEvents.empty() && farEvents.begin()->first < windowEnd ) {
+    ring[farEvents.begin()->first % ring.size()] += farEvents.begin()->second;
+    farEvents.erase(farEvents.begin());
+  }
+
+  // Resolve the depth of the bin, clearing the events as they are used.
+  binDepth.resize(binEnd - binStart);
+  for (int position = binStart; position < binEnd; ++position) {
+    int& event = ring[position % ring.size()];
+    depth += event;
+    event  = 0;
+    binDepth[position - binStart] = depth;
+  }
+
+  // The feature for the region start-end includes the base before start, which in 0-based
+  // coordinates is the first base of the bin. Every alignment added so far starts before the end of
+  // the bin, so the bin has alignments if any of them ends after its first base.
+  binNumber++;
+  id.clear();
+  id += to_string(binNumber);
+  id += '\t';
+  id += referenceName;
+  id += ':';
+  id += to_string(binStart + 1);
+  id += '-';
+  id += to_string(binEnd);
+  int feature = cov.addFeature(id, binEnd - binStart);
+  if (alignmentEnd <= binStart) { cov.noCoverage(feature); }
+  else if (binDepth.size() > 1) { cov.processFeature(binDepth, 1, feature); }
+  binStart = binEnd;
+}
@@ -0,0 +1,87 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Calculate the coverage of fixed size bins across each reference sequence
+// ***************************************************************************
+
+#ifndef BINNED_COVERAGE_H
+#define BINNED_COVERAGE_H
+
+#include "api/BamAlignment.h"
+#include "dataProcessing.h"
+#include "depthAccumulator.h"
+#include "readFilter.h"
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// The number of bases of depth events held in the window, unless the bins are
+// larger.
+#define BIN_WINDOW 1048576
+
+// Calculate the coverage of fixed size bins across a reference sequence from
+// the alignments on it, read once in position order. The depth events of the
+// alignments are held in a ring covering a window of the reference, and a bin
+// is closed as soon as the alignments have moved past its end. The statistics
+// for each bin are added as a feature to cov, with the reference as the gene,
+// so the features can be written and cleared at any time and memory does not
+// depend on the length of the reference. Each bin is treated as the region
+// "name:start-end", with start and end 1-based and inclusive, and a bin has
+// alignments if any alignment overlaps it under the same rule as when a region
+// is set on the reader, so the results match a regions file listing the bins.
+class binnedCoverage {
+
+  public:
+    binnedCoverage(int, const statisticsOptions&, readFilter&);
+    ~binnedCoverage(void);
+
+  // Public methods.
+  public:
+    void beginReference(const string&, int);
+    bool closeBins(int, size_t);
+    void addAlignment(const BamAlignment&);
+
+  public:
+    coverageData cov;
+
+  private:
+    void addEvent(int, int);
+    void closeBin(void);
+
+  private:
+    int binSize;
+    readFilter& filter;
+
+    // The reference being binned, and the start and number of the next bin to
+    // be closed.
+    string referenceName;
+    int referenceLength;
+    int binStart;
+    int binNumber;
+
+    // The largest end position of the alignments added on the reference.
+    int alignmentEnd;
+
+    // The depth events. The event for a position within the window from the
+    // start of the next bin is held in the ring at the position modulo the
+    // ring size, and any beyond it, from very long alignments, are held in
+    // farEvents until the window reaches them. depth is the depth at the base
+    // before the next bin.
+    vector<int> ring;
+    map<int, int> farEvents;
+    int depth;
+
+    // Working buffers.
+    vector<coveredBlock> blocks;
+    vector<int> binDepth;
+    string id;
+};
+
+#endif // BINNED_COVERAGE_H
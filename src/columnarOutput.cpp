@@ -0,0 +1,284 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Write the statistics as a binary file of column chunks
+// ***************************************************************************
+
+#include "columnarOutput.h"
+#include <cstring>
+#include <map>
+#include <sstream>
+
+using namespace std;
+
+// The header, chunks and trailer start with magic numbers.
+static const char COLUMNAR_MAGIC[4]   = {'G', 'C', 'C', 'F'};
+static const char CHUNK_MAGIC[4]      = {'G', 'C', 'C', 'K'};
+static const char COLUMNAR_TRAILER[4] = {'G', 'C', 'C', 'E'};
+
+// The number of columns before those for the thresholds.
+#define FIXED_COLUMNS 10
+
+// Constructor
+columnarWriter::columnarWriter(outputWriter& outFile, const regionTable& geneTable, const statisticsOptions& statistics, runStatistics* runStats) : out(outFile), table(geneTable), stats(runStats) {
+  numberThresholds = statistics.thresholds.size();
+  offset           = 0;
+  totalRows        = 0;
+
+  const char* names[FIXED_COLUMNS] = {"gene", "feature", "region", "min", "max", "q1", "median", "q3", "mean", "sd"};
+  const uint32_t types[FIXED_COLUMNS] = {COLUMN_UINT32, COLUMN_UINT32, COLUMN_UINT32, COLUMN_INT32, COLUMN_INT32, COLUMN_FLOAT64, COLUMN_FLOAT64, COLUMN_FLOAT64, COLUMN_FLOAT64, COLUMN_FLOAT64};
+  columnNames.assign(names, names + FIXED_COLUMNS);
+  columnTypes.assign(types, types + FIXED_COLUMNS);
+  for (size_t i = 0; i < numberThresholds; ++i) {
+    ostringstream name;
+    name << "pct_" << statistics.thresholds[i] << "x";
+    columnNames.push_back(name.str());
+    columnTypes.push_back(COLUMN_FLOAT64);
+  }
+  above.resize(numberThresholds);
+
+  // Each region string is held once, as the same exon is often listed under several genes.
+  map<string, uint32_t> entries;
+  regionEntries.resize(table.regionStrings.size());
+  for (size_t i = 0; i < table.regionStrings.size(); ++i) {
+    map<string, uint32_t>::iterator found = entries.find(table.regionStrings[i]);
+    if (found == entries.end()) {
+      found = entries.insert(make_pair(table.regionStrings[i], uint32_t(regionDictionary.size()))).first;
+      regionDictionary.push_back(table.regionStrings[i]);
+    }
+    regionEntries[i] = found->second;
+  }
+}
+
+columnarWriter::~columnarWriter(void) {
+}
+
+void columnarWriter::writeBytes(const void* data, size_t length) {
+  out.write((const char*)data, length);
+  offset += length;
+}
+
+// Pad the output to the next 8 byte boundary.
+void columnarWriter::pad(void) {
+  static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  if (offset % 8 != 0) { writeBytes(zeros, 8 - offset % 8); }
+}
+
+void columnarWriter::writeDictionary(const vector<string>& entries) {
+  writeValue<uint64_t>(entries.size());
+  uint64_t textOffset = 0;
+  writeValue<uint64_t>(textOffset);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    textOffset += entries[i].size();
+    writeValue<uint64_t>(textOffset);
+  }
+  for (size_t i = 0; i < entries.size(); ++i) { writeBytes(entries[i].data(), entries[i].size()); }
+  pad();
+}
+
+// Write the header, with the columns and the gene and region dictionaries.
+void columnarWriter::writeHeader(void) {
+  writeBytes(COLUMNAR_MAGIC, 4);
+  writeValue<uint32_t>(COLUMNAR_VERSION);
+  writeValue<uint32_t>(columnNames.size());
+  writeValue<uint32_t>(0);
+  writeBytes(&columnTypes[0], sizeof(uint32_t) * columnTypes.size());
+  pad();
+  writeDictionary(columnNames);
+  writeDictionary(table.geneNames);
+  writeDictionary(regionDictionary);
+}
+
+// Add the rows for the features of a gene and for the gene, writing out the chunk whenever it is
+// full. A gene with more features than a chunk holds is split across chunks.
+void columnarWriter::append(const geneColumns& cov) {
+  unsigned int firstRegion = table.geneOffsets[cov.gene];
+  for (size_t i = 0; i < cov.features; ++i) {
+    genes.push_back(cov.gene);
+    features.push_back(i + 1);
+    regions.push_back(regionEntries[firstRegion + i]);
+    mins.push_back(cov.min[i]);
+    maxs.push_back(cov.max[i]);
+    q1s.push_back(cov.q1[i]);
+    medians.push_back(cov.median[i]);
+    q3s.push_back(cov.q3[i]);
+    means.push_back(cov.mean[i]);
+    sds.push_back(cov.sd[i]);
+    for (size_t j = 0; j < numberThresholds; ++j) { above[j].push_back(cov.above[i * numberThresholds + j]); }
+    if (genes.size() >= COLUMNAR_CHUNK_ROWS) { writeChunk(); }
+  }
+
+  genes.push_back(cov.gene);
+  features.push_back(0);
+  regions.push_back(NO_REGION);
+  mins.push_back(cov.geneMin);
+  maxs.push_back(cov.geneMax);
+  q1s.push_back(cov.geneQ1);
+  medians.push_back(cov.geneMedian);
+  q3s.push_back(cov.geneQ3);
+  means.push_back(cov.geneMean);
+  sds.push_back(cov.geneSd);
+  for (size_t j = 0; j < numberThresholds; ++j) { above[j].push_back(cov.geneAbove[j]); }
+  if (genes.size() >= COLUMNAR_CHUNK_ROWS) { writeChunk(); }
+}
+
+// Add a gene straight from the arrays of its coverageData.
+void columnarWriter::gene(unsigned int gene, const coverageData& cov) {
+  if (stats != NULL) { stats->start(); }
+  geneColumns columns;
+  columns.gene       = gene;
+  columns.features   = cov.size();
+  columns.min        = cov.featureMin.data();
+  columns.max        = cov.featureMax.data();
+  columns.q1         = cov.featureQ1.data();
+  columns.median     = cov.featureMedian.data();
+  columns.q3         = cov.featureQ3.data();
+  columns.mean       = cov.featureMean.data();
+  columns.sd         = cov.featureSd.data();
+  columns.above      = cov.featureAbove.data();
+  columns.geneMin    = cov.geneMin;
+  columns.geneMax    = cov.geneMax;
+  columns.geneQ1     = cov.geneQ1;
+  columns.geneMedian = cov.geneMedian;
+  columns.geneQ3     = cov.geneQ3;
+  columns.geneMean   = cov.geneMean;
+  columns.geneSd     = cov.geneSd;
+  columns.geneAbove  = cov.geneAbove.data();
+  append(columns);
+  if (stats != NULL) { stats->stop(STAGE_OUTPUT); }
+}
+
+// Add a gene packed by a columnarPacker.
+void columnarWriter::addPacked(const string& packed) {
+  uint32_t header[2];
+  memcpy(header, packed.data(), sizeof(header));
+  size_t n = header[1];
+  size_t featureDoubles = n * (5 + numberThresholds);
+  packedInts.resize(2 * n + 2);
+  packedDoubles.resize(featureDoubles + 5 + numberThresholds);
+
+  // The feature arrays, then the gene values.
+  const char* data = packed.data() + sizeof(header);
+  memcpy(&packedInts[0], data, sizeof(int) * 2 * n);
+  data += sizeof(int) * 2 * n;
+  memcpy(&packedDoubles[0], data, sizeof(double) * featureDoubles);
+  data += sizeof(double) * featureDoubles;
+  memcpy(&packedInts[2 * n], data, sizeof(int) * 2);
+  data += sizeof(int) * 2;
+  memcpy(&packedDoubles[featureDoubles], data, sizeof(double) * (5 + numberThresholds));
+
+  const double* gene = &packedDoubles[featureDoubles];
+  geneColumns columns;
+  columns.gene       = header[0];
+  columns.features   = n;
+  columns.min        = &packedInts[0];
+  columns.max        = &packedInts[n];
+  columns.q1         = &packedDoubles[0];
+  columns.median     = &packedDoubles[n];
+  columns.q3         = &packedDoubles[2 * n];
+  columns.mean       = &packedDoubles[3 * n];
+  columns.sd         = &packedDoubles[4 * n];
+  columns.above      = &packedDoubles[5 * n];
+  columns.geneMin    = packedInts[2 * n];
+  columns.geneMax    = packedInts[2 * n + 1];
+  columns.geneQ1     = gene[0];
+  columns.geneMedian = gene[1];
+  columns.geneQ3     = gene[2];
+  columns.geneMean   = gene[3];
+  columns.geneSd     = gene[4];
+  columns.geneAbove  = gene + 5;
+  append(columns);
+}
+
+// Write the rows held as a chunk, with the offset of each column from the start of the chunk.
+void columnarWriter::writeChunk(void) {
+  if (genes.empty()) { return; }
+  size_t rows = genes.size();
+  chunkOffsets.push_back(offset);
+  chunkRows.push_back(rows);
+  totalRows += rows;
+
+  // Each column starts on an 8 byte boundary.
+  size_t headerSize = 8 + 8 * columnTypes.size();
+  vector<uint64_t> columnOffsets(columnTypes.size());
+  uint64_t columnOffset = headerSize;
+  for (size_t i = 0; i < columnTypes.size(); ++i) {
+    columnOffsets[i] = columnOffset;
+    size_t bytes = rows * ((columnTypes[i] == COLUMN_FLOAT64) ? 8 : 4);
+    columnOffset += (bytes + 7) / 8 * 8;
+  }
+  writeBytes(CHUNK_MAGIC, 4);
+  writeValue<uint32_t>(rows);
+  writeBytes(&columnOffsets[0], sizeof(uint64_t) * columnOffsets.size());
+
+  writeColumn(genes);
+  writeColumn(features);
+  writeColumn(regions);
+  writeColumn(mins);
+  writeColumn(maxs);
+  writeColumn(q1s);
+  writeColumn(medians);
+  writeColumn(q3s);
+  writeColumn(means);
+  writeColumn(sds);
+  for (size_t i = 0; i < numberThresholds; ++i) { writeColumn(above[i]); }
+
+  genes.clear();
+  features.clear();
+  regions.clear();
+  mins.clear();
+  maxs.clear();
+  q1s.clear();
+  medians.clear();
+  q3s.clear();
+  means.clear();
+  sds.clear();
+  for (size_t i = 0; i < numberThresholds; ++i) { above[i].clear(); }
+}
+
+// Write the last chunk and the footer.
+void columnarWriter::finish(void) {
+  writeChunk();
+  uint64_t footerOffset = offset;
+  writeValue<uint64_t>(chunkOffsets.size());
+  for (size_t i = 0; i < chunkOffsets.size(); ++i) {
+    writeValue<uint64_t>(chunkOffsets[i]);
+    writeValue<uint64_t>(chunkRows[i]);
+  }
+  writeValue<uint64_t>(totalRows);
+  writeValue<uint64_t>(footerOffset);
+  writeBytes(COLUMNAR_TRAILER, 4);
+  writeValue<uint32_t>(0);
+}
+
+// Constructor
+columnarPacker::columnarPacker(outputWriter& outFile) : out(outFile) {
+}
+
+columnarPacker::~columnarPacker(void) {
+}
+
+// Pack the arrays of a gene, in the order columnarWriter::addPacked reads them.
+void columnarPacker::gene(unsigned int gene, const coverageData& cov) {
+  size_t n = cov.size();
+  uint32_t header[2] = {gene, uint32_t(n)};
+  writeArray(header, 2);
+  writeArray(cov.featureMin.data(), n);
+  writeArray(cov.featureMax.data(), n);
+  writeArray(cov.featureQ1.data(), n);
+  writeArray(cov.featureMedian.data(), n);
+  writeArray(cov.featureQ3.data(), n);
+  writeArray(cov.featureMean.data(), n);
+  writeArray(cov.featureSd.data(), n);
+  writeArray(cov.featureAbove.data(), n * cov.numberThresholds());
+
+  int geneRange[2] = {cov.geneMin, cov.geneMax};
+  double geneValues[5] = {cov.geneQ1, cov.geneMedian, cov.geneQ3, cov.geneMean, cov.geneSd};
+  writeArray(geneRange, 2);
+  writeArray(geneValues, 5);
+  writeArray(cov.geneAbove.data(), cov.numberThresholds());
+}
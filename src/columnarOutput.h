@@ -0,0 +1,167 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Write the statistics as a binary file of column chunks
+// ***************************************************************************
+
+#ifndef COLUMNAR_OUTPUT_H
+#define COLUMNAR_OUTPUT_H
+
+#include "coverageEngine.h"
+#include "dataProcessing.h"
+#include "outputWriter.h"
+#include "regions.h"
+#include "runStatistics.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The columnar output holds the same rows as the table, a row for each feature
+// followed by a row for its gene, as typed columns that can be used in place
+// once the file is memory mapped. All values are in native byte order and every
+// section starts on an 8 byte boundary. The file is laid out as:
+//   header      magic "GCCF", version, number of columns, zero, the type of
+//               each column (COLUMN_UINT32, COLUMN_INT32 or COLUMN_FLOAT64) and
+//               three dictionaries: the column names, the gene names and the
+//               region strings
+//   chunks      up to COLUMNAR_CHUNK_ROWS rows each, as magic "GCCK", number of
+//               rows, and the offset of each column from the start of the
+//               chunk, followed by the columns, each an array of values. The
+//               rows of a gene can be split across consecutive chunks
+//   footer      the number of chunks, the offset and number of rows of each
+//               chunk, and the total number of rows
+//   trailer     the offset of the footer, magic "GCCE" and zero
+// A dictionary is the number of entries, the offset of each entry and of the
+// end of the last from the start of the text, and the text. Counts and offsets
+// are 64 bit unless stated. The columns are:
+//   gene        the gene, as an entry of the gene dictionary
+//   feature     the number of the region in the gene, from 1, or 0 for a gene
+//   region      the region, as an entry of the region dictionary, or
+//               0xffffffff for a gene
+//   min, max    32 bit integers
+//   q1, median, q3, mean, sd, and pct_<threshold>x for each depth threshold
+//               64 bit floating point values
+// Offsets in a compressed (.gz) file refer to the uncompressed data.
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_CHUNK_ROWS 65536
+
+enum columnarType {
+  COLUMN_UINT32 = 1,
+  COLUMN_INT32 = 2,
+  COLUMN_FLOAT64 = 3
+};
+
+// A consumer adding the features and gene line of each gene to the columns,
+// writing a chunk whenever it holds COLUMNAR_CHUNK_ROWS rows. The header is written before the first
+// gene and finish writes the last chunk and the footer.
+class columnarWriter : public coverageConsumer {
+
+  public:
+    columnarWriter(outputWriter&, const regionTable&, const statisticsOptions&, runStatistics*);
+    ~columnarWriter(void);
+
+  // Public methods.
+  public:
+    void writeHeader(void);
+    void gene(unsigned int, const coverageData&);
+    void addPacked(const string&);
+    void finish(void);
+
+  private:
+
+    // The statistics for a gene, from a coverageData or a packed gene. The
+    // percentages above the thresholds are held together for each feature.
+    struct geneColumns {
+      unsigned int gene;
+      size_t features;
+      const int* min;
+      const int* max;
+      const double* q1;
+      const double* median;
+      const double* q3;
+      const double* mean;
+      const double* sd;
+      const double* above;
+      int geneMin;
+      int geneMax;
+      double geneQ1;
+      double geneMedian;
+      double geneQ3;
+      double geneMean;
+      double geneSd;
+      const double* geneAbove;
+    };
+
+    void append(const geneColumns&);
+    void writeChunk(void);
+    void writeDictionary(const vector<string>&);
+    void writeBytes(const void*, size_t);
+    void pad(void);
+    template <typename T> void writeValue(T value) { writeBytes(&value, sizeof(T)); }
+    template <typename T> void writeColumn(const vector<T>& column) { if (!column.empty()) { writeBytes(&column[0], sizeof(T) * column.size()); } pad(); }
+
+    outputWriter& out;
+    const regionTable& table;
+    runStatistics* stats;
+    size_t numberThresholds;
+    vector<string> columnNames;
+    vector<uint32_t> columnTypes;
+
+    // The region dictionary holds each region string once, and regionEntries the
+    // entry for each region of the table.
+    vector<string> regionDictionary;
+    vector<uint32_t> regionEntries;
+
+    // The bytes written so far, and the offset and rows of each chunk.
+    unsigned long long offset;
+    vector<unsigned long long> chunkOffsets;
+    vector<unsigned long long> chunkRows;
+    unsigned long long totalRows;
+
+    // The columns of the chunk being built, with a column for each threshold.
+    vector<uint32_t> genes;
+    vector<uint32_t> features;
+    vector<uint32_t> regions;
+    vector<int32_t> mins;
+    vector<int32_t> maxs;
+    vector<double> q1s;
+    vector<double> medians;
+    vector<double> q3s;
+    vector<double> means;
+    vector<double> sds;
+    vector< vector<double> > above;
+
+    // The arrays of a packed gene, copied out of the string so that they are aligned.
+    vector<int> packedInts;
+    vector<double> packedDoubles;
+};
+
+// A consumer packing the statistics of each gene as the arrays of the
+// coverageData, for genes calculated on a worker thread: the gene and number of
+// features (32 bit), the min and max of each feature (32 bit), q1, median, q3,
+// mean and sd of each feature, the percentages above the thresholds for each
+// feature in turn, and then the same values for the gene. columnarWriter adds
+// the packed genes in gene order.
+class columnarPacker : public coverageConsumer {
+
+  public:
+    columnarPacker(outputWriter&);
+    ~columnarPacker(void);
+
+  // Public methods.
+  public:
+    void gene(unsigned int, const coverageData&);
+
+  private:
+    template <typename T> void writeArray(const T* values, size_t n) { out.write((const char*)values, sizeof(T) * n); }
+
+    outputWriter& out;
+};
+
+#endif // COLUMNAR_OUTPUT_H
@@ -0,0 +1,31 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Per-base depth held in 16 bits, with the deepest bases held separately
+// ***************************************************************************
+
+#include "compactDepth.h"
+#include <algorithm>
+
+using namespace std;
+
+// Constructor
+compactDepth::compactDepth(void) {
+}
+
+compactDepth::~compactDepth(void) {
+}
+
+static bool compareOffset(const depthOverflow& a, int offset) {
+  return a.offset < offset;
+}
+
+// Find the depth of a saturated base in the overflow list.
+int compactDepth::overflowDepth(size_t offset) const {
+  vector<depthOverflow>::const_iterator iter = lower_bound(overflow.begin(), overflow.end(), (int)offset, compareOffset);
+  return (iter != overflow.end() && iter->offset == (int)offset) ? iter->depth : SATURATED_DEPTH;
+}
@@ -0,0 +1,55 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Per-base depth held in 16 bits, with the deepest bases held separately
+// ***************************************************************************
+
+#ifndef COMPACT_DEPTH_H
+#define COMPACT_DEPTH_H
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// The 16-bit value marking a base whose depth is held in the overflow list.
+#define SATURATED_DEPTH 65535
+
+// A base whose depth does not fit in 16 bits.
+struct depthOverflow {
+  int offset;
+  int depth;
+};
+
+// The depth of each base in a region, at 2 bytes per base. Depths from 0 to
+// SATURATED_DEPTH - 1 are held directly. Any other depth is stored as
+// SATURATED_DEPTH, with the real depth in the overflow list, which is in
+// offset order. Outside of amplicon data the list is almost always empty.
+class compactDepth {
+
+  public:
+    compactDepth(void);
+    ~compactDepth(void);
+
+  // Public methods.
+  public:
+    size_t size(void) const { return values.size(); }
+
+    // The depth of a base.
+    int operator[](size_t offset) const {
+      return (values[offset] != SATURATED_DEPTH) ? values[offset] : overflowDepth(offset);
+    }
+
+  public:
+    vector<uint16_t> values;
+    vector<depthOverflow> overflow;
+
+  private:
+    int overflowDepth(size_t) const;
+};
+
+#endif // COMPACT_DEPTH_H
@@ -1,202 +1,719 @@
-#include "api/BamMultiReader.h"
+#include "alignmentReader.h"
+#include "bamStream.h"
+#include "binnedCoverage.h"
+#include "columnarOutput.h"
+#include "coverageArena.h"
+#include "coverageEngine.h"
 #include "dataProcessing.h"
+#include "depthIndex.h"
+#include "outputWriter.h"
+#include "parallel.h"
+#include "regionCoverage.h"
+#include "regions.h"
+#include "resultCache.h"
+#include "runStatistics.h"
+#include "shardResults.h"
+#include <algorithm>
 #include <getopt.h>
 #include <iostream>
-#include <fstream>
 #include <sstream>
+#include <thread>
 
 using namespace std;
 using namespace BamTools;
 
-// Parse a file and add all lines to the list of regions.
-void getRegions(string file, vector<string>& geneNames, vector< vector <string> >& regionList) {
-  vector<string> list;
-  string line;
-  int i = -1;
-  ifstream infile(file.c_str());
-
-  // Open the file reading.
-  while (getline(infile, line)) {
-
-    // Check if the line is a gene name or a region. All gene names must
-    // begin with '_'.
-   
-    if (line[0] == '#') {
-      geneNames.push_back(line.substr(1));
-      if (i != -1) {
-        regionList.push_back(list);
-        list.clear();
-      }
-      i++;
-    } else {
-      list.push_back(line);
+// Calculate the coverage for each of the regions in a gene from a depth index rather than the BAM
+// files. The depth includes the base before each region, which is part of the feature. As with the
+// BAM files, a region is only treated as having no alignments if no alignment spans any of its bases;
+// a region skipped by a spliced read has alignments, but no depth.
+void calculateIndexedGeneCoverage(const depthIndex& index, const regionTable& table, unsigned int gene, coverageArena& arena, coverageData& cov) {
+  vector<int>& depth = arena.depth;
+  for (unsigned int i = table.geneOffsets[gene]; i < table.geneOffsets[gene + 1]; ++i) {
+    BamRegion region = table.region(i);
+    unsigned int length = region.RightPosition - region.LeftPosition + 1;
+    int feature = cov.addFeature(featureId(i - table.geneOffsets[gene] + 1, table.regionStrings[i], arena.id), length);
+
+    int first = max(region.LeftPosition - 1, 0);
+    bool aligned;
+    if (region.LeftRefID != region.RightRefID || !index.depth(region.LeftRefID, first, region.RightPosition, depth, aligned)) {
+      cerr << "ERROR: The region " << table.regionStrings[i] << " is not in the depth index (--depth-index, -I)." << endl;
+      exit(1);
     }
+    if (!aligned) { cov.noCoverage(feature); }
+    else { cov.processFeature(depth, region.LeftPosition - first, feature); }
+  }
+
+  // Calculcate gene level data.
+  cov.processGene();
+}
+
+// Write the feature level statistics for a gene. The prefix (e.g. the sample name followed by a tab)
+// is written at the start of every line.
+void writeFeatures(outputWriter& outFile, const string& prefix, const coverageData& cov) {
+
+  // Iterators for features. The ids are held end to end in a single string.
+  vector<size_t>::const_iterator idIter    = cov.idEnds.begin();
+  vector<size_t>::const_iterator idIterEnd = cov.idEnds.end();
+  size_t idStart = 0;
+
+  vector<int>::const_iterator minIter    = cov.featureMin.begin();
+  vector<int>::const_iterator minIterEnd = cov.featureMin.end();
+
+  vector<int>::const_iterator maxIter    = cov.featureMax.begin();
+  vector<int>::const_iterator maxIterEnd = cov.featureMax.end();
+
+  vector<double>::const_iterator meanIter    = cov.featureMean.begin();
+  vector<double>::const_iterator meanIterEnd = cov.featureMean.end();
+
+  vector<double>::const_iterator q1Iter    = cov.featureQ1.begin();
+  vector<double>::const_iterator q1IterEnd = cov.featureQ1.end();
+
+  vector<double>::const_iterator medIter    = cov.featureMedian.begin();
+  vector<double>::const_iterator medIterEnd = cov.featureMedian.end();
+
+  vector<double>::const_iterator q3Iter    = cov.featureQ3.begin();
+  vector<double>::const_iterator q3IterEnd = cov.featureQ3.end();
+
+  vector<double>::const_iterator sdIter    = cov.featureSd.begin();
+  vector<double>::const_iterator sdIterEnd = cov.featureSd.end();
+
+  // The percentages of bases above each depth threshold, if requested.
+  size_t numberThresholds = cov.numberThresholds();
+  vector<double>::const_iterator aboveIter = cov.featureAbove.begin();
+
+  // Iterate over the feature minimum values and increment all other iterators as we go.
+  for (; idIter != idIterEnd; ++idIter) {
+    vector<double>::const_iterator aboveIterEnd = aboveIter + numberThresholds;
+    outFile << prefix;
+    outFile.write(cov.idText.data() + idStart, *idIter - idStart);
+    idStart = *idIter;
+    outFile << "\t" << *minIter << "\t" << *maxIter << "\t" << *q1Iter << "\t" << *medIter << "\t" << *q3Iter << "\t" << *meanIter << "\t" << *sdIter;
+    for (; aboveIter != aboveIterEnd; ++aboveIter) { outFile << "\t" << *aboveIter; }
+    outFile << '\n';
+
+    // Increment the iterators.
+    ++minIter;
+    ++maxIter;
+    ++q1Iter;
+    ++medIter;
+    ++q3Iter;
+    ++meanIter;
+    ++sdIter;
+  }
+}
+
+// Write the gene level statistics for a gene.
+void writeGeneLine(outputWriter& outFile, const string& prefix, const string& geneName, const coverageData& cov) {
+  size_t numberThresholds = cov.numberThresholds();
+  outFile << prefix << geneName << "\tNA\t" << cov.geneMin << "\t" << cov.geneMax << "\t" << cov.geneQ1 << "\t" << cov.geneMedian << "\t" << cov.geneQ3 << "\t" << cov.geneMean << "\t" << cov.geneSd;
+  for (size_t i = 0; i < numberThresholds; ++i) { outFile << "\t" << cov.geneAbove[i]; }
+  outFile << '\n';
+}
+
+// Write the feature and gene level statistics for a gene.
+void writeGene(outputWriter& outFile, const string& prefix, const string& geneName, const coverageData& cov) {
+  writeFeatures(outFile, prefix, cov);
+  writeGeneLine(outFile, prefix, geneName, cov);
+}
+
+// Write the header, with a column for each depth threshold.
+void writeHeader(outputWriter& outFile, const string& prefix, const statisticsOptions& statistics) {
+  outFile << "#" << prefix << "id\tregion\tmin\tmax\tq1\tmedian\tq3\tmean\tsd";
+  for (size_t i = 0; i < statistics.thresholds.size(); ++i) { outFile << "\tpct_" << statistics.thresholds[i] << "x"; }
+  outFile << '\n';
+}
+
+// Write the intervals in a gene with depth below the lowest threshold as BED. Each interval is
+// named by the gene and the number of the region in the gene, preceded by the sample if given.
+void writeLowCoverage(outputWriter& bedFile, const string& sample, const regionTable& table, const RefVector& references, unsigned int gene, const coverageData& cov) {
+  vector<lowCoverageInterval>::const_iterator iter    = cov.lowCoverage.begin();
+  vector<lowCoverageInterval>::const_iterator iterEnd = cov.lowCoverage.end();
+  for (; iter != iterEnd; ++iter) {
+    const compiledRegion& region = table.regions[table.geneOffsets[gene] + iter->feature];
+
+    // The first base in the feature is the base before the left position.
+    int start = max(region.leftPosition - 1 + iter->start, 0);
+    int end   = region.leftPosition - 1 + iter->end;
+    bedFile << references[region.leftRefID].RefName << '\t' << start << '\t' << end << '\t';
+    if (sample != "") { bedFile << sample << ':'; }
+    bedFile << table.geneNames[gene] << ':' << iter->feature + 1 << '\n';
+  }
+}
+
+// Report the error from a request to the coverage engine and end the program.
+void engineFailed(const coverageEngine& engine) {
+  cerr << "ERROR: " << engine.errorString() << endl;
+  exit(1);
+}
+
+// Open a reader and locate the indexes. Each worker thread has its own reader and index handles.
+// The read names and base qualities are only decoded from CRAM files if the filter needs them.
+// Returns false if the files could not be opened.
+bool openFiles(alignmentReader& reader, const vector<string>& inputFiles, const readFilter& filter) {
+  reader.SetRequiredFields(filter.mates.enabled(), filter.minBaseQuality > 0);
+  if ( !reader.Open(inputFiles) ) { return false; }
+
+  // Attempt to find index files.
+  reader.LocateIndexes();
+  return true;
+}
+
+// Open a reader on the main thread, ending the program if the files could not be opened.
+void openReader(alignmentReader& reader, vector<string>& inputFiles, const readFilter& filter) {
+  if ( !openFiles(reader, inputFiles, filter) ) {
+    if (reader.GetErrorString() != "") { cerr << "ERROR: " << reader.GetErrorString() << endl; }
+    cerr << "bamtools count ERROR: could not open input BAM file(s)... Aborting." << endl;
+    exit(1);
   }
+}
 
-  // Add the final list to regionList.
-  regionList.push_back(list);
+// Record the error of a worker thread and stop the other workers. The worker returns, and the main
+// thread reports the error once every worker has finished.
+void workerFailed(workerError& errors, const string& error, workStealingScheduler& scheduler, orderedOutput& results, orderedOutput& lowCoverageResults) {
+  errors.record(error);
+  scheduler.stop();
+  results.abort();
+  lowCoverageResults.abort();
+}
 
-  // If the number of gene names is not equal to the number of regions lists, fail.
-  if (regionList.size() != geneNames.size()) {
-    cout << "Error with input regions." << endl;
-    cout << "Input regions must be a file with the following format:" << endl;
-    cout << "    #GENE NAME ('#' must prepend gene name)" << endl;
-    cout << "    chr:start-end (first exon)" << endl;
-    cout << "    chr:start-end (second exon)" << endl;
-    cout << "    etc." << endl;
-    cout << endl;
-    cout << "As many genes as desired can be included, but each new set of regions, must" << endl;
-    cout << "start with the _gene name." << endl;
+// Report the error from the worker threads, if any, and end the program. The workers must all
+// have been joined.
+void checkWorkers(workerError& errors) {
+  if ( errors.failed() ) {
+    cerr << "ERROR: " << errors.errorString() << endl;
     exit(1);
   }
 }
 
-// Check that the region string is valid.
-bool ParseRegionString(const string& regionString, const BamMultiReader& reader, BamRegion& region) {
-
-  // Check first for empty string.
-  if ( regionString.empty() ) {
-    return false;
-  }
-
-  // Store the name of the gene.
-  string geneName = "";
-  
-  // Look for a colon.
-  size_t foundFirstColon = regionString.find(':');
-  
-  // Store chrom strings, and numeric positions.
-  string startChrom;
-  string stopChrom;
-  int startPos;
-  int stopPos;
-  
-  // If no colon is found, use entire contents of requested chromosome.
-  // Store the entire region string as startChrom name and use BamReader methods
-  // to check if its valid for current BAM file.
-  if ( foundFirstColon == string::npos ) {
-    startChrom = regionString;
-    startPos   = 0;
-    stopChrom  = regionString;
-    stopPos    = -1;
-  }
-  
-  // If a colon is found, we have some sort of startPos requested.
-  else {
-    
-    // Store the start chrom from beginning to first colon.
-    startChrom = regionString.substr(0, foundFirstColon);
-    
-    // Look for ".." or "-"  after the colon.
-    size_t foundRangeDots = regionString.find("..", foundFirstColon + 1);
-    size_t foundDash      = regionString.find("-", foundFirstColon + 1);
-    
-    // If no dots or dash found, we have a startPos but no range. Store the 
-    // contents before colon as startChrom, after as startPos.
-    if ( foundRangeDots == string::npos and foundDash == string::npos ) {
-      startPos   = atoi( regionString.substr(foundFirstColon + 1).c_str() ); 
-      stopChrom  = startChrom;
-      stopPos    = -1;
-    } 
-    
-    // A ".." or "-" is found, so we have some sort of range selected.
+// Write the results from a coverageEngine as they are delivered: the statistics for each gene to
+// the output, and the low coverage intervals, if requested, to the BED file. In the per-sample mode
+// every line starts with the sample. Writing is timed if run statistics are being collected.
+class geneWriter : public coverageConsumer {
+
+  public:
+    geneWriter(outputWriter& outFile, outputWriter& bedFile, const string& sample, const regionTable& table, const RefVector& references, const statisticsOptions& statistics, runStatistics* stats) :
+      outFile(outFile), bedFile(bedFile), sample(sample), prefix((sample != "") ? sample + "\t" : ""), table(table), references(references), statistics(statistics), stats(stats) {}
+
+  public:
+    void gene(unsigned int gene, const coverageData& cov) {
+      if (stats != NULL) { stats->start(); }
+      writeGene(outFile, prefix, table.geneNames[gene], cov);
+      if (statistics.lowCoverage) { writeLowCoverage(bedFile, sample, table, references, gene, cov); }
+      if (stats != NULL) { stats->stop(STAGE_OUTPUT); }
+    }
+
+  private:
+    outputWriter& outFile;
+    outputWriter& bedFile;
+    string sample;
+    string prefix;
+    const regionTable& table;
+    const RefVector& references;
+    const statisticsOptions& statistics;
+    runStatistics* stats;
+};
+
+// Take the output for a gene from the result cache, or calculate it with a writer filling the
+// buffers and add it to the cache. The entry is locked while the gene is calculated, so another
+// process needing the gene waits for it and then takes it from the cache. Returns false, with the
+// reason in the engine's errorString, if the gene could not be calculated.
+bool cachedGene(resultCache& cache, coverageEngine& engine, alignmentReader& reader, const regionTable& table, unsigned int gene, readFilter& filter, coverageConsumer& writer, outputWriter& buffer, outputWriter& bedBuffer, runStatistics* stats, string& output, string& lowCoverage) {
+  unsigned long long key = cache.geneKey(table, gene);
+  bool found = cache.find(key, output, lowCoverage);
+  if (!found) {
+    int lock = cache.lock(key);
+    found = cache.find(key, output, lowCoverage);
+    if (!found) {
+      if ( !engine.calculateGene(reader, table, gene, filter, writer, stats) ) {
+        cache.unlock(lock);
+        return false;
+      }
+      buffer.takeBuffer(output);
+      bedBuffer.takeBuffer(lowCoverage);
+      cache.store(key, output, lowCoverage);
+    }
+    cache.unlock(lock);
+  }
+  if (found && stats != NULL) { stats->addCachedGene(); }
+  return true;
+}
+
+// Process genes handed out by the scheduler, storing the output for each gene so that it can be
+// written in the original gene order. For a shard of a run, the output is the gene records of the
+// shard file, and any low coverage intervals are held in them. For the columnar output, the output
+// is the packed statistics of each gene. If there is a result cache, genes are taken from it where
+// possible. If the alignments cannot be read, the error is recorded and the workers are stopped.
+void geneWorker(int worker, vector<string>& inputFiles, const RefVector& references, regionTable& table, const statisticsOptions& statistics, readFilter& filter, runStatistics* stats, const shardMapping* shard, bool columnar, resultCache* cache, workStealingScheduler& scheduler, orderedOutput& results, orderedOutput& lowCoverageResults, workerError& errors) {
+  alignmentReader reader;
+  if ( !openFiles(reader, inputFiles, filter) ) {
+    workerFailed(errors, reader.GetErrorString(), scheduler, results, lowCoverageResults);
+    return;
+  }
+  coverageEngine engine(statistics);
+
+  // The output for each gene is built in memory.
+  outputWriter buffer;
+  outputWriter bedBuffer;
+  coverageConsumer* writer;
+  if (shard != NULL) { writer = new shardWriter(buffer, *shard, table); }
+  else if (columnar) { writer = new columnarPacker(buffer); }
+  else { writer = new geneWriter(buffer, bedBuffer, "", table, references, statistics, stats); }
+  string output;
+  string lowCoverage;
+
+  long geneIndex;
+  while (scheduler.next(worker, geneIndex)) {
+    bool calculated;
+    if (cache != NULL) { calculated = cachedGene(*cache, engine, reader, table, geneIndex, filter, *writer, buffer, bedBuffer, stats, output, lowCoverage); }
     else {
-      size_t foundSecondColon;
-      size_t foundRange;
-      size_t offset;
-      if ( foundRangeDots == string::npos) {
-        foundRange = foundDash;
-        offset     = 1;
+      calculated = engine.calculateGene(reader, table, geneIndex, filter, *writer, stats);
+      buffer.takeBuffer(output);
+      bedBuffer.takeBuffer(lowCoverage);
+    }
+    if (!calculated) {
+      workerFailed(errors, engine.errorString(), scheduler, results, lowCoverageResults);
+      break;
+    }
+    results.store(geneIndex, output);
+    if (statistics.lowCoverage && shard == NULL) { lowCoverageResults.store(geneIndex, lowCoverage); }
+  }
+  delete writer;
+  reader.Close();
+}
+
+// The number of bins held before their statistics are written.
+#define BIN_OUTPUT_BATCH 4096
+
+// Close the bins before a position, writing out the statistics for the bins whenever a batch is
+// full.
+void closeBins(binnedCoverage& bins, int position, outputWriter& outFile) {
+  while ( !bins.closeBins(position, BIN_OUTPUT_BATCH - min(bins.cov.size(), size_t(BIN_OUTPUT_BATCH))) ) {
+    writeFeatures(outFile, "", bins.cov);
+    bins.cov.clearFeatures();
+  }
+}
+
+// Write the statistics for the bins on a reference, with the reference as the gene.
+void finishBinnedReference(binnedCoverage& bins, outputWriter& outFile, const RefData& reference) {
+  closeBins(bins, reference.RefLength, outFile);
+  writeFeatures(outFile, "", bins.cov);
+  bins.cov.processGene();
+  writeGeneLine(outFile, "", reference.RefName, bins.cov);
+}
+
+// Calculate the coverage of fixed size bins across every reference, reading the alignments in the
+// files once from start to finish. No index is needed, but the files must be sorted by coordinate.
+// The alignments are either streamed from the files, decompressing blocks in parallel, or read
+// through the reader. The statistics for the bins are written as they are completed, so memory
+// does not depend on the length of the references.
+void binGenome(alignmentReader& reader, vector<string>& inputFiles, int decompressionThreads, const RefVector& references, int binSize, const statisticsOptions& statistics, readFilter& filter, outputWriter& outFile) {
+  bamMultiStream stream;
+  bool streaming = (decompressionThreads > 0 && !reader.IsCram());
+  if (streaming && !stream.Open(inputFiles, decompressionThreads, &filter)) {
+    cerr << "ERROR: " << stream.GetErrorString() << endl;
+    exit(1);
+  }
+  if (!streaming && decompressionThreads > 0) { reader.SetThreads(decompressionThreads); }
+
+  // References are started as their first alignment is seen, and any references without alignments
+  // are binned with no coverage. Unmapped reads are at the end of the files and are not needed.
+  binnedCoverage bins(binSize, statistics, filter);
+  BamAlignment al;
+  int refID = -1;
+  while (streaming ? stream.GetNextAlignmentCore(al) : nextAlignment(reader, al, filter)) {
+    if (al.RefID < 0) { break; }
+    if (al.RefID != refID) {
+      if (al.RefID < refID) {
+        cerr << "ERROR: The binned mode (--bin-size, -B) requires BAM files sorted by coordinate." << endl;
+        exit(1);
+      }
+      if (refID >= 0) { finishBinnedReference(bins, outFile, references[refID]); }
+      for (++refID; refID < al.RefID; ++refID) {
+        bins.beginReference(references[refID].RefName, references[refID].RefLength);
+        finishBinnedReference(bins, outFile, references[refID]);
       }
-      else { 
-        foundRange = foundRangeDots;
-        offset     = 2;
+      bins.beginReference(references[refID].RefName, references[refID].RefLength);
+    }
+    closeBins(bins, al.Position, outFile);
+    bins.addAlignment(al);
+  }
+  if (streaming) {
+    string error = stream.GetErrorString();
+    if (!error.empty()) {
+      cerr << "ERROR: " << error << endl;
+      exit(1);
+    }
+    stream.Close();
+  }
+
+  if (refID >= 0) { finishBinnedReference(bins, outFile, references[refID]); }
+  for (++refID; refID < (int)references.size(); ++refID) {
+    bins.beginReference(references[refID].RefName, references[refID].RefLength);
+    finishBinnedReference(bins, outFile, references[refID]);
+  }
+}
+
+// The number of bases read from the BAM files at a time when building a depth index.
+#define DEPTH_INDEX_WINDOW 1048576
+
+// Write the depth of every base in the regions, or in every reference sequence if there are no
+// regions, to a depth index. Each region is extended by the base before it, which is included in
+// the feature statistics, and overlapping regions are merged. The depth is read through the BAM
+// indexes in windows, so the memory needed does not depend on the length of the references.
+void buildDepthIndex(alignmentReader& reader, const RefVector& references, const regionTable* table, readFilter& filter, const string& indexFile) {
+  vector<depthInterval> intervals;
+  depthInterval interval;
+  interval.reserved   = 0;
+  interval.firstRun   = 0;
+  interval.numberRuns = 0;
+  if (table == NULL) {
+    for (size_t i = 0; i < references.size(); ++i) {
+      interval.refID = i;
+      interval.start = 0;
+      interval.end   = references[i].RefLength;
+      intervals.push_back(interval);
+    }
+  } else {
+    vector<unsigned int>::const_iterator iter    = table->sortedOrder.begin();
+    vector<unsigned int>::const_iterator iterEnd = table->sortedOrder.end();
+    for (; iter != iterEnd; ++iter) {
+      const compiledRegion& region = table->regions[*iter];
+      if (region.leftRefID != region.rightRefID) {
+        cerr << "ERROR: The region " << table->regionStrings[*iter] << " spans more than one reference and cannot be added to a depth index." << endl;
+        exit(1);
       }
+      interval.refID = region.leftRefID;
+      interval.start = max(region.leftPosition - 1, 0);
+      interval.end   = region.rightPosition;
+      if (interval.end <= interval.start) { continue; }
+      if (!intervals.empty() && intervals.back().refID == interval.refID && interval.start <= intervals.back().end) {
+        intervals.back().end = max(intervals.back().end, interval.end);
+      } else { intervals.push_back(interval); }
+    }
+  }
+
+  if ( !reader.HasIndexes() ) {
+    cerr << "ERROR: Building a depth index requires indexes for all BAM files." << endl;
+    exit(1);
+  }
+  depthIndexWriter writer;
+  if ( !writer.open(indexFile, references, headerChecksum(reader.GetHeaderText(), references), intervals) ) {
+    cerr << "ERROR: could not open the depth index " << indexFile << endl;
+    exit(1);
+  }
 
-      // Store the startPos between first colon and range dots ".." or "-" and look for a
-      // second colon.
-      startPos         = atoi( regionString.substr(foundFirstColon + 1, foundRange - foundFirstColon - 1).c_str() );
-      foundSecondColon = regionString.find(':', foundRange + 1);
-      
-      // If no second colon found, so we have a "standard" chrom:start..stop input format (on single chrom).
-      if ( foundSecondColon == string::npos ) {
-        stopChrom  = startChrom;
-        stopPos    = atoi( regionString.substr(foundRange + offset).c_str() );
+  BamAlignment al;
+  depthAccumulator accumulator;
+  vector<int> depth, spanned;
+  vector<depthInterval>::iterator iter    = intervals.begin();
+  vector<depthInterval>::iterator iterEnd = intervals.end();
+  for (; iter != iterEnd; ++iter) {
+    for (int start = iter->start; start < iter->end;) {
+      int end = (iter->end - start > DEPTH_INDEX_WINDOW) ? start + DEPTH_INDEX_WINDOW : iter->end;
+      if ( !calculateDepth(reader, BamRegion(iter->refID, start, iter->refID, end), al, accumulator, filter, depth, spanned) ) {
+        cerr << "ERROR: " << regionError(reader, references[iter->refID].RefName + ":" + to_string(start) + "-" + to_string(end)) << endl;
+        exit(1);
       }
-      
-      // If a second colon is found, we have a range requested across 2 chrom's.
-      else {
-        stopChrom  = regionString.substr(foundRange + offset, foundSecondColon - ( foundRange + offset ));
-        stopPos    = atoi( regionString.substr(foundSecondColon + 1).c_str() );
+      for (size_t i = 0; i < depth.size(); ++i) {
+        if (depth[i] == 0 && spanned[i] > 0) { depth[i] = DEPTH_SPANNED; }
       }
+      writer.add(depth);
+      start = end;
+    }
+  }
+  if ( !writer.close() ) {
+    cerr << "ERROR: could not write the depth index " << indexFile << endl;
+    exit(1);
+  }
+}
+
+// Close the output files, ending the program if any of the output could not be written.
+void closeOutput(outputWriter& outFile, outputWriter& bedFile) {
+  if ( !outFile.close() ) {
+    cerr << "ERROR: could not write the output: " << outFile.errorString() << endl;
+    exit(1);
+  }
+  if ( !bedFile.close() ) {
+    cerr << "ERROR: could not write the low coverage intervals: " << bedFile.errorString() << endl;
+    exit(1);
+  }
+}
+
+// Write the run statistics, if they were collected.
+void writeRunStatistics(runStatistics* stats, const string& statsFile, const readFilter& filter) {
+  if (stats != NULL && !stats->write(statsFile, filter.examined)) {
+    cerr << "ERROR: could not write the run statistics to " << statsFile << endl;
+    exit(1);
+  }
+}
+
+// The name of the sample in a BAM file. This is the sample (SM) of the first read group in the
+// header, or the name of the file if there are no read groups.
+string sampleName(const string& headerText, const string& filename) {
+  istringstream header(headerText);
+  string line;
+  while (getline(header, line)) {
+    if (line.compare(0, 4, "@RG\t") != 0) { continue; }
+    size_t start = line.find("\tSM:");
+    if (start == string::npos) { continue; }
+    start += 4;
+    return line.substr(start, line.find('\t', start) - start);
+  }
+
+  // Remove the path and the extension from the file name.
+  size_t start = filename.rfind('/');
+  start = (start == string::npos) ? 0 : start + 1;
+  string name = filename.substr(start);
+  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bam") == 0) { name.resize(name.size() - 4); }
+  else if (isCramFile(name)) { name.resize(name.size() - 5); }
+  return name;
+}
+
+// Check that a BAM file has the same reference sequences as those the regions were compiled against.
+bool sameReferences(const RefVector& a, const RefVector& b) {
+  if (a.size() != b.size()) { return false; }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].RefName != b[i].RefName || a[i].RefLength != b[i].RefLength) { return false; }
+  }
+  return true;
+}
+
+// Process samples handed out by the scheduler. Each sample is swept on its own reader and the
+// output for the sample is stored so that the samples are written in the original order. If a
+// sample cannot be read, the error is recorded and the workers are stopped.
+void sampleWorker(int worker, const vector<string>& inputFiles, int decompressionThreads, const RefVector& references, regionTable& table, const statisticsOptions& statistics, readFilter& filter, runStatistics* stats, workStealingScheduler& scheduler, orderedOutput& results, orderedOutput& lowCoverageResults, workerError& errors) {
+  coverageEngine engine(statistics);
+  outputWriter buffer;
+  outputWriter bedBuffer;
+  string output;
+
+  long sample;
+  while (scheduler.next(worker, sample)) {
+    sweepOptions options;
+    options.inputFiles.assign(1, inputFiles[sample]);
+    options.decompressionThreads = decompressionThreads;
+    alignmentReader reader;
+    if ( !openFiles(reader, options.inputFiles, filter) ) {
+      workerFailed(errors, reader.GetErrorString(), scheduler, results, lowCoverageResults);
+      return;
+    }
+    if ( !sameReferences(reader.GetReferenceData(), references) ) {
+      workerFailed(errors, inputFiles[sample] + " has different reference sequences from " + inputFiles[0] + ".", scheduler, results, lowCoverageResults);
+      return;
+    }
+    string name = sampleName(reader.GetHeaderText(), inputFiles[sample]);
+
+    geneWriter writer(buffer, bedBuffer, name, table, references, statistics, stats);
+    if ( !engine.sweep(reader, options, table, filter, writer, stats) ) {
+      workerFailed(errors, engine.errorString(), scheduler, results, lowCoverageResults);
+      return;
+    }
+    reader.Close();
+
+    buffer.takeBuffer(output);
+    results.store(sample, output);
+    if (statistics.lowCoverage) {
+      bedBuffer.takeBuffer(output);
+      lowCoverageResults.store(sample, output);
     }
   }
+}
 
-  // Validate reference IDs & genomic positions.
-  const RefVector references = reader.GetReferenceData();
+// Hold the output of each gene delivered by a sweep over the genes missing from the result cache,
+// adding it to the cache. The swept table is part of the full table, and the genes are numbered in
+// the full table from the first region of each.
+class cachingWriter : public coverageConsumer {
 
-  // If startRefID not found, return false.
-  int startRefID = reader.GetReferenceID(startChrom);
-  if ( startRefID == -1 ) return false;
+  public:
+    cachingWriter(resultCache& cache, coverageConsumer& writer, outputWriter& buffer, outputWriter& bedBuffer, const regionTable& table, const regionTable& part, const vector<unsigned int>& originalRegions, vector<string>& outputs, vector<string>& lowCoverage) :
+      cache(cache), writer(writer), buffer(buffer), bedBuffer(bedBuffer), table(table), part(part), originalRegions(originalRegions), outputs(outputs), lowCoverage(lowCoverage) {}
 
-  // startPos cannot be greater than or equal to reference length.
-  const RefData& startReference = references.at(startRefID);
-  if ( startPos >= startReference.RefLength ) return false;
+  public:
+    void gene(unsigned int gene, const coverageData& cov) {
+      unsigned int fullGene = table.regions[originalRegions[part.geneOffsets[gene]]].gene;
+      writer.gene(gene, cov);
+      buffer.takeBuffer(outputs[fullGene]);
+      bedBuffer.takeBuffer(lowCoverage[fullGene]);
+      cache.store(cache.geneKey(table, fullGene), outputs[fullGene], lowCoverage[fullGene]);
+    }
 
-  // If stopRefID not found, return false.
-  int stopRefID = reader.GetReferenceID(stopChrom);
-  if ( stopRefID == -1 ) return false;
+  private:
+    resultCache& cache;
+    coverageConsumer& writer;
+    outputWriter& buffer;
+    outputWriter& bedBuffer;
+    const regionTable& table;
+    const regionTable& part;
+    const vector<unsigned int>& originalRegions;
+    vector<string>& outputs;
+    vector<string>& lowCoverage;
+};
 
-  // stopPosition cannot be larger than reference length.
-  const RefData& stopReference = references.at(stopRefID);
-  if ( stopPos > stopReference.RefLength ) return false;
+// Sweep the genes that are not in the result cache and write the output for every gene in order.
+// The cached genes are read before the sweep and the swept genes are added to the cache as the
+// sweep delivers them. The genes are not locked during the sweep, so processes sweeping at the same
+// time may both calculate a gene, writing the same entry.
+void cachedSweep(resultCache& cache, alignmentReader& reader, const sweepOptions& options, const regionTable& table, const RefVector& references, const statisticsOptions& statistics, readFilter& filter, runStatistics* stats, outputWriter& outFile, outputWriter& bedFile) {
+  vector<string> outputs(table.numberGenes());
+  vector<string> lowCoverage(table.numberGenes());
+  vector<bool> selected(table.regions.size(), false);
+  for (unsigned int gene = 0; gene < table.numberGenes(); ++gene) {
+    if ( cache.find(cache.geneKey(table, gene), outputs[gene], lowCoverage[gene]) ) {
+      if (stats != NULL) { stats->addCachedGene(); }
+      continue;
+    }
+    for (unsigned int i = table.geneOffsets[gene]; i < table.geneOffsets[gene + 1]; ++i) { selected[i] = true; }
+  }
 
-  // If no stopPosition specified, set to reference end.
-  if ( stopPos == -1 ) stopPos = stopReference.RefLength;
+  regionTable part;
+  vector<unsigned int> originalRegions;
+  table.select(selected, part, originalRegions);
+  coverageEngine engine(statistics);
+  if (part.numberGenes() > 0) {
+    outputWriter buffer;
+    outputWriter bedBuffer;
+    geneWriter partWriter(buffer, bedBuffer, "", part, references, statistics, stats);
+    cachingWriter writer(cache, partWriter, buffer, bedBuffer, table, part, originalRegions, outputs, lowCoverage);
+    if ( !engine.sweep(reader, options, part, filter, writer, stats) ) { engineFailed(engine); }
+  }
 
-  // Set up the Region struct & return.
-  region.LeftRefID     = startRefID;
-  region.LeftPosition  = startPos;
-  region.RightRefID    = stopRefID;;
-  region.RightPosition = stopPos;
-  return true;
+  // A gene without regions is not swept, and its statistics are written directly.
+  geneWriter fullWriter(outFile, bedFile, "", table, references, statistics, stats);
+  for (unsigned int gene = 0; gene < table.numberGenes(); ++gene) {
+    if (table.numberRegions(gene) == 0) {
+      if ( !engine.calculateGene(reader, table, gene, filter, fullWriter, stats) ) { engineFailed(engine); }
+      continue;
+    }
+    outFile << outputs[gene];
+    if (statistics.lowCoverage) { bedFile << lowCoverage[gene]; }
+    string().swap(outputs[gene]);
+    string().swap(lowCoverage[gene]);
+  }
 }
 
-bool processCigar(BamAlignment& al, BamRegion& region, int startPosition, vector<int>& coverage) {
-  
-  // Intialize local variables.
-  const int numCigarOps = (const int)al.CigarData.size(); 
-  int positionInRegion  = al.Position - startPosition;
-  
-  // Iterate over the CIGAR operations. 
-  for (int i = 0; i < numCigarOps; ++i ) {
-    const CigarOp& op = al.CigarData.at(i);
-  
-    // If the CIGAR string indicates a match.
-    if (op.Type == 'M') {
-      for (int j = positionInRegion; j < (positionInRegion + (int)op.Length); ++j) {
-        if (j < coverage.size()) {coverage[j]++;}
-      }
-      positionInRegion += (int)op.Length;
-    }
-  
-    // If the bases are soft or hard clipped bases, advance the position in the region, but do not update
-    // coverage.
-    else if (op.Type == 'S' || op.Type == 'H') { positionInRegion += (int)op.Length; }
-  
-    // If there is an insertion, do nothing. All the bases in the insertion do not cover reference bases, so 
-    // should not be counted and the position in the region is not advanced.
-    else if (op.Type == 'I') { }
-  
-    // If there is an deletion, count the deleted bases as covered and advance the position in the region.
-    else if (op.Type == 'D') {
-      for (int j = positionInRegion; j < (positionInRegion + (int)op.Length); ++j) {
-        if (j < coverage.size()) {coverage[j]++;}
+// Combine the shard files from a sharded run into the output of a single run. Every shard of the
+// run must be given, and the regions file must be the one the shards were calculated from. The
+// features of each gene are filled in from the shards that hold them and the gene level totals
+// are added together, so the gene statistics are exactly those of a single run.
+void mergeShards(vector<string>& shardFiles, const string& regionsFile, const string& regionCache, const string& output, const string& lowCoverageFile) {
+  if (shardFiles.empty()) {
+    cerr << "Please specify the shard files to merge." << endl;
+    exit(1);
+  }
+  if (regionsFile == "") {
+    cerr << "Please specify the file containing the list of regions used by the shards (--regions, -r)." << endl;
+    exit(1);
+  }
+
+  // Open the shards, checking that they are all from the same run, calculated from the same
+  // alignments with the same read filter, and that each shard is present once.
+  vector<shardReader*> shards;
+  for (size_t i = 0; i < shardFiles.size(); ++i) {
+    shardReader* shard = new shardReader;
+    if ( !shard->open(shardFiles[i]) ) {
+      cerr << "ERROR: " << shard->errorString() << endl;
+      exit(1);
+    }
+    shards.push_back(shard);
+  }
+  const shardReader& first = *shards[0];
+  vector<bool> found(first.numberShards, false);
+  for (size_t i = 0; i < shards.size(); ++i) {
+    const shardReader& shard = *shards[i];
+    if (shard.numberShards != first.numberShards || shard.fingerprint != first.fingerprint || shard.thresholds != first.thresholds || shard.lowCoverage != first.lowCoverage) {
+      cerr << "ERROR: " << shardFiles[i] << " is not from the same run as " << shardFiles[0] << "." << endl;
+      exit(1);
+    }
+    if (shard.alignments != first.alignments) {
+      cerr << "ERROR: " << shardFiles[i] << " was not calculated from the same alignments as " << shardFiles[0] << "." << endl;
+      exit(1);
+    }
+    if (shard.minMappingQuality != first.minMappingQuality || shard.minBaseQuality != first.minBaseQuality || shard.requiredFlags != first.requiredFlags ||
+        shard.excludedFlags != first.excludedFlags || shard.mateWindow != first.mateWindow) {
+      cerr << "ERROR: " << shardFiles[i] << " was not calculated with the same read filter options as " << shardFiles[0] << "." << endl;
+      exit(1);
+    }
+    if (shard.shard >= first.numberShards) {
+      cerr << "ERROR: " << shardFiles[i] << " holds shard " << shard.shard + 1 << " of a run with " << first.numberShards << " shards." << endl;
+      exit(1);
+    }
+    if (found[shard.shard]) {
+      cerr << "ERROR: Shard " << shard.shard + 1 << "/" << shard.numberShards << " was given more than once." << endl;
+      exit(1);
+    }
+    found[shard.shard] = true;
+  }
+  for (unsigned int i = 0; i < first.numberShards; ++i) {
+    if (!found[i]) {
+      cerr << "ERROR: Shard " << i + 1 << "/" << first.numberShards << " is missing." << endl;
+      exit(1);
+    }
+  }
+
+  // The statistics are those the shards were calculated with.
+  statisticsOptions statistics;
+  statistics.thresholds  = first.thresholds;
+  statistics.lowCoverage = (lowCoverageFile != "");
+  if (statistics.lowCoverage && !first.lowCoverage) {
+    cerr << "The low coverage intervals (--low-coverage, -L) require the shards to be run with depth thresholds (--thresholds, -x)." << endl;
+    exit(1);
+  }
+
+  regionTable table;
+  string error;
+  if ( !loadRegions(regionsFile, regionCache, first.references, table, error) ) {
+    cerr << "ERROR: " << error << endl;
+    exit(1);
+  }
+  if (table.fingerprint != first.fingerprint) {
+    cerr << "ERROR: The shards were not calculated from the regions file " << regionsFile << "." << endl;
+    exit(1);
+  }
+
+  outputWriter outFile;
+  if ( !outFile.open(output) ) {
+    cerr << "ERROR: could not open the output file " << output << endl;
+    exit(1);
+  }
+  outputWriter bedFile;
+  if ( statistics.lowCoverage && !bedFile.open(lowCoverageFile) ) {
+    cerr << "ERROR: could not open the low coverage file " << lowCoverageFile << endl;
+    exit(1);
+  }
+  writeHeader(outFile, "", statistics);
+
+  // Each shard holds its genes in order, so the shards are read in step, a gene at a time.
+  coverageArena arena(statistics);
+  coverageData& cov = *arena.acquire(0);
+  for (unsigned int gene = 0; gene < table.numberGenes(); ++gene) {
+    cov.reset();
+    for (unsigned int i = table.geneOffsets[gene]; i < table.geneOffsets[gene + 1]; ++i) {
+      const compiledRegion& region = table.regions[i];
+      cov.addFeature(featureId(i - table.geneOffsets[gene] + 1, table.regionStrings[i], arena.id), region.rightPosition - region.leftPosition + 1);
+    }
+    for (size_t i = 0; i < shards.size(); ++i) {
+      if (shards[i]->gene() != gene) { continue; }
+      shards[i]->addTo(cov);
+      if ( !shards[i]->next() && shards[i]->errorString() != "" ) {
+        cerr << "ERROR: " << shards[i]->errorString() << endl;
+        exit(1);
       }
-      positionInRegion += (int)op.Length;
     }
+    cov.processGene();
+    writeGene(outFile, "", table.geneNames[gene], cov);
+    if (statistics.lowCoverage) { writeLowCoverage(bedFile, "", table, first.references, gene, cov); }
   }
-  return true;
+  arena.release(&cov);
+
+  // Every gene record should have been used.
+  for (size_t i = 0; i < shards.size(); ++i) {
+    if (shards[i]->gene() != NO_REGION) {
+      cerr << "ERROR: " << shardFiles[i] << " holds genes that are not in the regions file " << regionsFile << "." << endl;
+      exit(1);
+    }
+    delete shards[i];
+  }
+  closeOutput(outFile, bedFile);
 }
 
 int main(int argc, char * argv[])
@@ -209,8 +726,38 @@ int main(int argc, char * argv[])
   string gene = "";
   string transcript;
   string regionsFile;
+  string regionCache;
   string output;
+  string lowCoverageFile;
+  string indexFile;
+  string statsFile;
   vector<string> inputFiles;
+  statisticsOptions statistics;
+  readFilter filter;
+  bool countFragments = false;
+  long mateWindow = 1000000;
+  int numberThreads = 1;
+  int decompressionThreads = 0;
+  bool sweep = false;
+  bool perSample = false;
+  int binSize = 0;
+  bool sharding = false;
+  unsigned int shardNumber = 0;
+  unsigned int numberShards = 0;
+  string resultCacheDirectory;
+  bool columnar = false;
+
+  // The build-index subcommand writes a depth index rather than the coverage statistics, and the
+  // merge subcommand combines the shard files from a sharded run.
+  bool buildIndex = false;
+  bool merge = false;
+  if (argc > 1 && (string(argv[1]) == "build-index" || string(argv[1]) == "merge")) {
+    buildIndex = (string(argv[1]) == "build-index");
+    merge      = (string(argv[1]) == "merge");
+    argv[1] = argv[0];
+    --argc;
+    ++argv;
+  }
 
   static struct option long_options[] =
     {
@@ -218,12 +765,31 @@ int main(int argc, char * argv[])
       {"bam", required_argument, 0, 'b'},
       {"regions", required_argument, 0, 'r'},
       {"output", required_argument, 0, 'o'},
+      {"threads", required_argument, 0, 'T'},
+      {"sweep", no_argument, 0, 'S'},
+      {"region-cache", required_argument, 0, 'c'},
+      {"decompression-threads", required_argument, 0, 'D'},
+      {"per-sample", no_argument, 0, 'P'},
+      {"thresholds", required_argument, 0, 'x'},
+      {"low-coverage", required_argument, 0, 'L'},
+      {"min-mapping-quality", required_argument, 0, 'q'},
+      {"min-base-quality", required_argument, 0, 'Q'},
+      {"require-flags", required_argument, 0, 'f'},
+      {"exclude-flags", required_argument, 0, 'F'},
+      {"fragments", no_argument, 0, 'm'},
+      {"mate-window", required_argument, 0, 'w'},
+      {"depth-index", required_argument, 0, 'I'},
+      {"stats", required_argument, 0, 's'},
+      {"bin-size", required_argument, 0, 'B'},
+      {"shard", required_argument, 0, 'k'},
+      {"result-cache", required_argument, 0, 'R'},
+      {"columnar", no_argument, 0, 'C'},
       {0, 0, 0, 0}
     };
 
   while (true) {
     int option_index = 0;
-    c = getopt_long(argc, argv, "hb:g:t:r:o:", long_options, &option_index);
+    c = getopt_long(argc, argv, "hb:g:t:r:o:T:Sc:D:Px:L:q:Q:f:F:mw:I:s:B:k:R:C", long_options, &option_index);
 
     if (c == -1) // end of options
       break;
@@ -235,197 +801,480 @@ int main(int argc, char * argv[])
         inputFiles.push_back(optarg);
         break;
 
-      // The list of regions.
+      // The list of regions, or a GTF or BED file of the exons of each gene.
       case 'r':
         regionsFile = optarg;
         break;
 
+      // A cache of the compiled regions.
+      case 'c':
+        regionCache = optarg;
+        break;
+
       // The output file.
       case 'o':
         output = optarg;
         break;
 
+      // The number of worker threads.
+      case 'T':
+        numberThreads = atoi(optarg);
+        break;
+
+      // Read each reference in a single pass.
+      case 'S':
+        sweep = true;
+        break;
+
+      // The number of threads decompressing the BAM files in the sweep.
+      case 'D':
+        decompressionThreads = atoi(optarg);
+        break;
+
+      // Calculate the coverage of each BAM file separately.
+      case 'P':
+        perSample = true;
+        break;
+
+      // A comma separated list of depth thresholds.
+      case 'x': {
+        istringstream thresholds(optarg);
+        string threshold;
+        while (getline(thresholds, threshold, ',')) {
+          int depth = atoi(threshold.c_str());
+          if (depth < 1) {
+            cerr << "The depth thresholds (--thresholds, -x) must be positive integers." << endl;
+            exit(1);
+          }
+          statistics.thresholds.push_back(depth);
+        }
+        break;
+      }
+
+      // The BED file of intervals with coverage below the lowest threshold.
+      case 'L':
+        lowCoverageFile = optarg;
+        statistics.lowCoverage = true;
+        break;
+
+      // The minimum mapping quality of an alignment.
+      case 'q':
+        filter.minMappingQuality = atoi(optarg);
+        if (filter.minMappingQuality < 0 || filter.minMappingQuality > 255) {
+          cerr << "The minimum mapping quality (--min-mapping-quality, -q) must be between 0 and 255." << endl;
+          exit(1);
+        }
+        break;
+
+      // The minimum quality of a base.
+      case 'Q':
+        filter.minBaseQuality = atoi(optarg);
+        if (filter.minBaseQuality < 0 || filter.minBaseQuality > 93) {
+          cerr << "The minimum base quality (--min-base-quality, -Q) must be between 0 and 93." << endl;
+          exit(1);
+        }
+        break;
+
+      // Flags that must all be set, as a decimal or hexadecimal (0x) mask.
+      case 'f':
+        filter.requiredFlags = strtoul(optarg, NULL, 0);
+        break;
+
+      // Flags that must not be set.
+      case 'F':
+        filter.excludedFlags = strtoul(optarg, NULL, 0);
+        break;
+
+      // Count the bases covered by both mates of a fragment once.
+      case 'm':
+        countFragments = true;
+        break;
+
+      // The maximum number of mates held while waiting for the other mate.
+      case 'w':
+        mateWindow = atol(optarg);
+        break;
+
+      // The depth index to build, or to read the depth from.
+      case 'I':
+        indexFile = optarg;
+        break;
+
+      // Write timings and counters for the run to a JSON file.
+      case 's':
+        statsFile = optarg;
+        break;
+
+      // Calculate the coverage of fixed size bins across the genome instead of a list of regions.
+      case 'B':
+        binSize = atoi(optarg);
+        if (binSize < 1) {
+          cerr << "The bin size (--bin-size, -B) must be at least one." << endl;
+          exit(1);
+        }
+        break;
+
+      // Calculate one of a number of shards of the run, given as i/N, writing a shard file for merge.
+      case 'k':
+        if (sscanf(optarg, "%u/%u", &shardNumber, &numberShards) != 2 || shardNumber < 1 || shardNumber > numberShards) {
+          cerr << "The shard (--shard, -k) must be given as i/N, with i from 1 to N." << endl;
+          exit(1);
+        }
+        sharding = true;
+        break;
+
+      // Keep the output of each gene in a cache directory, and take genes already in it from there.
+      case 'R':
+        resultCacheDirectory = optarg;
+        break;
+
+      // Write the statistics as binary columns rather than a table (see columnarOutput.h).
+      case 'C':
+        columnar = true;
+        break;
+
       default:
         abort ();
     }
   }
 
+  // The shard files are listed after the options.
+  if (merge) {
+    vector<string> shardFiles(argv + optind, argv + argc);
+    mergeShards(shardFiles, regionsFile, regionCache, output, lowCoverageFile);
+    return 0;
+  }
+
+  // The depth index is written by build-index, and replaces the BAM files otherwise.
+  bool useIndex = (indexFile != "" && !buildIndex);
+  if (buildIndex && indexFile == "") {
+    cerr << "Please specify the depth index to build (--depth-index, -I)." << endl;
+    exit(1);
+  }
+
   // Bam files must be specified.
-  if (inputFiles.size() == 0) {
+  if (inputFiles.size() == 0 && !useIndex) {
     cerr << "Please specify a BAM file or files (--bam, -b)." << endl;
     exit(1);
   }
 
-  // A file containing a list of regions must be specified.
-  if (regionsFile == "" ) {
+  // A file containing a list of regions must be specified. A depth index can be built for the whole
+  // genome, and the binned mode covers the whole genome.
+  if (regionsFile == "" && !buildIndex && binSize == 0) {
     cerr << "Please specify a file containing a list of regions (--regions, -r)." << endl;
     exit(1);
   }
 
-  // Read the file containing regions and add all regions to the list.
-  vector< vector <string> > regionLists;
-  vector<string> geneNames;
-  getRegions(regionsFile, geneNames, regionLists);
+  // The binned mode reads every alignment once on a single reader and writes the results as the
+  // bins are completed.
+  if (binSize > 0 && (regionsFile != "" || buildIndex || indexFile != "" || sweep || perSample || numberThreads > 1 || statistics.lowCoverage)) {
+    cerr << "The binned mode (--bin-size, -B) cannot be combined with the regions, depth index, sweep, per-sample, threads or low coverage options." << endl;
+    exit(1);
+  }
 
-  // Loop over all genes and associated sets of regions.
-  vector<string>::iterator geneIter    = geneNames.begin();
-  vector<string>::iterator geneIterEnd = geneNames.end();
-  vector< vector <string> >::iterator regionIter    = regionLists.begin();
-  vector< vector <string> >::iterator regionIterEnd = regionLists.end();
+  // At least one thread is required.
+  if (numberThreads < 1) {
+    cerr << "The number of threads (--threads, -T) must be at least one." << endl;
+    exit(1);
+  }
 
-  // Open output file (or stdout) for writing.
-  ofstream outputFile;
-  bool outputRequested = false;
-  if (output != "") {
-    outputRequested = true;
-    outputFile.open(output.c_str(), std::ios::out);
+  // The sweep reads each reference once on a single reader. In the per-sample mode, each sample is
+  // swept separately and the threads share the samples.
+  if (sweep && numberThreads > 1 && !perSample) {
+    cerr << "The sweep mode (--sweep, -S) cannot be combined with multiple threads (--threads, -T)." << endl;
+    exit(1);
   }
-  ostream & outFile = ( outputRequested ? outputFile : cout);
 
-  // Write out header information once.
-  outFile << "#id\tregion\tmin\tmax\tq1\tmedian\tq3\tmean\tsd" << endl;
+  // Streaming the files with parallel decompression is only available in the sweep.
+  if (decompressionThreads < 0 || (decompressionThreads > 0 && !sweep && !perSample && binSize == 0)) {
+    cerr << "The number of decompression threads (--decompression-threads, -D) must be positive and requires the sweep (--sweep, -S), per-sample (--per-sample, -P) or binned (--bin-size, -B) mode." << endl;
+    exit(1);
+  }
 
-  // Open the multireader
-  BamMultiReader reader;
-  if ( !reader.Open(inputFiles) ) {
-    cerr << "bamtools count ERROR: could not open input BAM file(s)... Aborting." << endl;
+  // Mates are held in a bounded window.
+  if (mateWindow < 1) {
+    cerr << "The mate window (--mate-window, -w) must be at least one." << endl;
     exit(1);
   }
+  if (countFragments) { filter.mates.setCapacity(mateWindow); }
 
-  // Define a region and alignment.
-  BamRegion region;
+  // The depth index already holds the depth of the alignments that passed the filters it was built
+  // with, and is read on a single thread.
+  if (useIndex && (sweep || perSample || numberThreads > 1 || decompressionThreads > 0 || filter.active())) {
+    cerr << "The depth index (--depth-index, -I) cannot be combined with the sweep, per-sample, threads or read filter options." << endl;
+    exit(1);
+  }
 
-  // Retrieve references.
-  BamTools::RefVector references = reader.GetReferenceData();
+  // The low coverage intervals are defined by the depth thresholds.
+  if (statistics.lowCoverage && statistics.thresholds.empty()) {
+    cerr << "The low coverage intervals (--low-coverage, -L) require depth thresholds (--thresholds, -x)." << endl;
+    exit(1);
+  }
 
-  for (; geneIter != geneIterEnd; geneIter++) {
+  // A shard writes the results for its part of the regions to a shard file. The low coverage
+  // intervals are always held in the file if there are depth thresholds, and are written by merge.
+  if (sharding && (buildIndex || perSample || binSize > 0 || statistics.lowCoverage)) {
+    cerr << "The shard option (--shard, -k) cannot be combined with build-index or the per-sample, binned or low coverage options." << endl;
+    exit(1);
+  }
+  if (sharding) { statistics.lowCoverage = !statistics.thresholds.empty(); }
 
-    // Define a structure for holding mean information.
-    coverageData cov((*regionIter).size());
-  
-    // Create a vector to store the info for each transcript.
-    vector<double> means;
-    vector<double> sds;
-  
-    // Variables for defining a feature id.
-    int exonId = 1;
-  
-    // Loop over all regions.
-    vector<string>::iterator iter    = (*regionIter).begin();
-    vector<string>::iterator iterEnd = (*regionIter).end();
-    for (; iter != iterEnd; ++iter) {
+  // The result cache holds the output of genes calculated from the BAM files, one gene at a time or
+  // in the sweep.
+  if (resultCacheDirectory != "" && (buildIndex || useIndex || perSample || binSize > 0 || sharding)) {
+    cerr << "The result cache (--result-cache, -R) cannot be combined with build-index or the depth index, per-sample, binned or shard options." << endl;
+    exit(1);
+  }
 
-      // Check that the region is valid and locate indexes.
-      if ( !ParseRegionString(*iter, reader, region) ) {
-        cerr << "ERROR: Invalid region string: " << *iter << endl;
+  // The columnar output holds the rows of the table for a single set of regions, and the result
+  // cache holds the table text. The low coverage intervals are written by the table writer.
+  if (columnar && (buildIndex || perSample || binSize > 0 || sharding || resultCacheDirectory != "" || statistics.lowCoverage)) {
+    cerr << "The columnar output (--columnar, -C) cannot be combined with build-index or the per-sample, binned, shard, result cache or low coverage options." << endl;
+    exit(1);
+  }
+
+  // The run statistics are only collected if requested.
+  runStatistics runStats;
+  runStatistics* stats = (statsFile != "") ? &runStats : NULL;
+
+  // Open the multireader. This is also used to validate the regions against the references. When
+  // reading from a depth index, the regions are validated against the references in the index, and
+  // any BAM files given are only used to check that the index was built from them.
+  alignmentReader reader;
+  RefVector references;
+  depthIndex index;
+  if (useIndex) {
+    if ( !index.open(indexFile) ) {
+      cerr << "ERROR: " << index.errorString() << endl;
+      exit(1);
+    }
+    references = index.references();
+    if (inputFiles.size() > 0) {
+      openReader(reader, inputFiles, filter);
+      if (headerChecksum(reader.GetHeaderText(), reader.GetReferenceData()) != index.checksum()) {
+        cerr << "ERROR: The depth index " << indexFile << " was not built from these BAM files, or they have changed. Rebuild it with build-index." << endl;
         exit(1);
       }
+      reader.Close();
+    }
+  } else {
+    openReader(reader, inputFiles, filter);
+    references = reader.GetReferenceData();
+  }
 
-      // Attempt to find index files.
-      reader.LocateIndexes();
-  
-      // If index data available for all BAM files, we can use SetRegion.
-      if ( reader.HasIndexes() ) {
-  
-        // Attempt to set region on reader.
-        if ( !reader.SetRegion(region.LeftRefID, region.LeftPosition, region.RightRefID, region.RightPosition) ) {
-          cerr << "bamtools count ERROR: set region failed. Check that REGION describes a valid range" << endl;
-          reader.Close();
-          exit(1);
-        }
-  
-        // Determine the length of the region and use this to define the start of each feature in the array of
-        // coverage data.
-        unsigned int length = region.RightPosition - region.LeftPosition + 1;
-        cov.featureLengths.push_back(length);
-  
-        // Create an id with the region included.
-        ostringstream oss;
-        oss << exonId << "\t" << *iter;
-        cov.ids.push_back(oss.str());
-        exonId++;
-  
-        // Define a new BamAlignment. Declaring here will ensure that if this region has no reads, but the previous
-        // region did, the alignment object will be cleared.
-        BamAlignment al;
-  
-        // Get the first alignment to set the start coordinate of the first base in the first read.
-        reader.GetNextAlignment(al);
-  
-        // If there are no alignments.
-        if (al.Position == -1) { cov.noCoverage(); }
-        else {
-  
-          // Initialise variables.
-          int coverageStart;
-          if (al.Position < region.LeftPosition) {coverageStart = al.Position;}
-          else {coverageStart = region.LeftPosition;}
-          vector<int> coverage(region.RightPosition - coverageStart);
-  
-          // Process the first read.
-          processCigar(al, region, coverageStart, coverage);
-  
-          // Loop over the remaining reads spanning the region.
-          while ( reader.GetNextAlignment(al) ) { processCigar(al, region, coverageStart, coverage); }
-  
-          // Process the coverage data for the feature.
-          int start = region.LeftPosition - coverageStart;
-
-          // Only process regions with more than a single base.
-          if (coverage.size() - start > 0) {
-            cov.processFeature(coverage, start);
-          }
-        }
-      }
+  // Read the file containing regions and compile the regions into a table, or read the table
+  // from the cache.
+  regionTable table;
+  if (stats != NULL) { stats->start(); }
+  string error;
+  if (regionsFile != "" && !loadRegions(regionsFile, regionCache, references, table, error)) {
+    cerr << "ERROR: " << error << endl;
+    exit(1);
+  }
+  if (stats != NULL) { stats->stop(STAGE_PARSE_REGIONS); }
+
+  // The fingerprint of the alignments identifies the genes in the result cache and the shards of a
+  // run. A depth index stands in for the BAM files it was built from.
+  unsigned long long alignments = 0;
+  if (resultCacheDirectory != "" || sharding) {
+    alignments = useIndex ? index.fingerprint() : alignmentFingerprint(inputFiles, reader.GetHeaderText(), references);
+  }
+
+  // The genes are keyed on the alignments and options of the run, as well as their regions.
+  resultCache cache;
+  if (resultCacheDirectory != "") {
+    if ( !cache.open(resultCacheDirectory) ) {
+      cerr << "ERROR: " << cache.errorString() << endl;
+      exit(1);
     }
+    cache.setRun(alignments, statistics, filter);
+  }
 
-    // Calculcate gene level data.
-    cov.processGene();
-  
-    // Iterators for features.
-    vector<string>::iterator idIter    = cov.ids.begin();
-    vector<string>::iterator idIterEnd = cov.ids.end();
-  
-    vector<int>::iterator minIter    = cov.featureMin.begin();
-    vector<int>::iterator minIterEnd = cov.featureMin.end();
-  
-    vector<int>::iterator maxIter    = cov.featureMax.begin();
-    vector<int>::iterator maxIterEnd = cov.featureMax.end();
-  
-    vector<double>::iterator meanIter    = cov.featureMean.begin();
-    vector<double>::iterator meanIterEnd = cov.featureMean.end();
-  
-    vector<double>::iterator q1Iter    = cov.featureQ1.begin();
-    vector<double>::iterator q1IterEnd = cov.featureQ1.end();
-  
-    vector<double>::iterator medIter    = cov.featureMedian.begin();
-    vector<double>::iterator medIterEnd = cov.featureMedian.end();
-  
-    vector<double>::iterator q3Iter    = cov.featureQ3.begin();
-    vector<double>::iterator q3IterEnd = cov.featureQ3.end();
-  
-    vector<double>::iterator sdIter    = cov.featureSd.begin();
-    vector<double>::iterator sdIterEnd = cov.featureSd.end();
-  
-    // Iterate over the feature minimum values and increment all other iterators as we go.
-    for (; idIter != idIterEnd; ++idIter) {
-      outFile << *idIter << "\t" << *minIter << "\t" << *maxIter << "\t" << *q1Iter << "\t" << *medIter << "\t" << *q3Iter << "\t" << *meanIter << "\t" << *sdIter << endl;
-  
-      // Increment the exon id.
-      exonId++;
-  
-      // Increment the iterators.
-      ++minIter;
-      ++maxIter;
-      ++q1Iter;
-      ++medIter;
-      ++q3Iter;
-      ++meanIter;
-      ++sdIter;
-    }
-  
-    // Now include the gene level information.
-    outFile << *geneIter << "\tNA\t" << cov.geneMin << "\t" << cov.geneMax << "\t" << cov.geneQ1 << "\t" << cov.geneMedian << "\t" << cov.geneQ3 << "\t" << cov.geneMean << "\t" << cov.geneSd << endl;
-    regionIter++;
+  // Write the depth of the regions, or the whole genome, to the depth index.
+  if (buildIndex) {
+    buildDepthIndex(reader, references, (regionsFile != "") ? &table : NULL, filter, indexFile);
+    if (filter.active()) { filter.report(cerr); }
+    writeRunStatistics(stats, statsFile, filter);
+    return 0;
+  }
+
+  // Open output file (or stdout) for writing. The output is buffered and only written out when
+  // the buffer is full, and is compressed if the file name ends in ".gz".
+  outputWriter outFile;
+  if ( !outFile.open(output) ) {
+    cerr << "ERROR: could not open the output file " << output << endl;
+    exit(1);
+  }
+  outputWriter bedFile;
+  if ( statistics.lowCoverage && !sharding && !bedFile.open(lowCoverageFile) ) {
+    cerr << "ERROR: could not open the low coverage file " << lowCoverageFile << endl;
+    exit(1);
+  }
+
+  // In the binned mode, the statistics for each bin are written as the alignments are read, with
+  // each reference sequence as the gene.
+  if (binSize > 0) {
+    writeHeader(outFile, "", statistics);
+    binGenome(reader, inputFiles, decompressionThreads, references, binSize, statistics, filter, outFile);
+    if (filter.active()) { filter.report(cerr); }
+    closeOutput(outFile, bedFile);
+    writeRunStatistics(stats, statsFile, filter);
+    return 0;
+  }
+
+  // In the per-sample mode, each BAM file is swept separately, with the results written as a long
+  // table with the sample as the first column. The regions are only compiled once and the samples are
+  // shared between the threads.
+  if (perSample) {
+    writeHeader(outFile, "sample\t", statistics);
+    reader.Close();
+
+    int workers = min(numberThreads, int(inputFiles.size()));
+    workStealingScheduler scheduler(inputFiles.size(), workers);
+    orderedOutput results(inputFiles.size());
+    orderedOutput lowCoverageResults(inputFiles.size());
+    vector<readFilter> filters(workers, filter);
+    vector<runStatistics> workerStats(workers);
+    workerError errors;
+    vector<thread> threads;
+    for (int i = 0; i < workers; ++i) {
+      runStatistics* workerStatsPointer = (stats != NULL) ? &workerStats[i] : NULL;
+      threads.push_back(thread(sampleWorker, i, cref(inputFiles), decompressionThreads, cref(references), ref(table), cref(statistics), ref(filters[i]), workerStatsPointer, ref(scheduler), ref(results), ref(lowCoverageResults), ref(errors)));
+    }
+    results.write(outFile);
+    if (statistics.lowCoverage) { lowCoverageResults.write(bedFile); }
+    for (int i = 0; i < workers; ++i) {
+      threads[i].join();
+      filter.merge(filters[i]);
+      runStats.merge(workerStats[i]);
+    }
+    checkWorkers(errors);
+    if (filter.active()) { filter.report(cerr); }
+    closeOutput(outFile, bedFile);
+    writeRunStatistics(stats, statsFile, filter);
+    return 0;
+  }
+
+  // A shard calculates the coverage of its part of the regions and writes the results for the genes
+  // in it to a shard file in place of the table. The full table is kept to number the genes and
+  // features in the file.
+  shardMapping shard;
+  if (sharding) {
+    shard.shard        = shardNumber - 1;
+    shard.numberShards = numberShards;
+    shard.alignments   = alignments;
+    shard.table.swap(table);
+    shard.table.shard(shard.shard, numberShards, table, shard.originalRegions);
+  }
+  geneWriter textWriter(outFile, bedFile, "", table, references, statistics, stats);
+  shardWriter partWriter(outFile, shard, table);
+  columnarWriter columnWriter(outFile, table, statistics, stats);
+  coverageConsumer* writerPointer = &textWriter;
+  if (sharding) { writerPointer = &partWriter; }
+  else if (columnar) { writerPointer = &columnWriter; }
+  coverageConsumer& writer = *writerPointer;
+
+  // Write out header information once.
+  if (sharding) { writeShardHeader(outFile, shard, table, statistics, filter, references); }
+  else if (columnar) { columnWriter.writeHeader(); }
+  else { writeHeader(outFile, "", statistics); }
+
+  // Calculate the statistics from the depth index, without reading the BAM files.
+  if (useIndex) {
+    coverageArena arena(statistics);
+    coverageData& cov = *arena.acquire(0);
+    for (unsigned int gene = 0; gene < table.numberGenes(); ++gene) {
+      cov.reset();
+      calculateIndexedGeneCoverage(index, table, gene, arena, cov);
+      writer.gene(gene, cov);
+    }
+    arena.release(&cov);
+    if (sharding) { writeShardTrailer(outFile); }
+    if (columnar) { columnWriter.finish(); }
+    closeOutput(outFile, bedFile);
+    writeRunStatistics(stats, statsFile, filter);
+    return 0;
+  }
+
+  // In sweep mode the alignments on each reference are read once, in order. The results are
+  // written out in the original order once all references have been read. With a result cache,
+  // only the genes missing from the cache are swept.
+  if (sweep) {
+    coverageEngine engine(statistics);
+    sweepOptions options;
+    options.inputFiles           = inputFiles;
+    options.decompressionThreads = decompressionThreads;
+    if (cache.isOpen()) { cachedSweep(cache, reader, options, table, references, statistics, filter, stats, outFile, bedFile); }
+    else if ( !engine.sweep(reader, options, table, filter, writer, stats) ) { engineFailed(engine); }
+    if (sharding) { writeShardTrailer(outFile); }
+    if (columnar) { columnWriter.finish(); }
+    if (filter.active()) { filter.report(cerr); }
+    closeOutput(outFile, bedFile);
+    writeRunStatistics(stats, statsFile, filter);
+    return 0;
+  }
+
+  // If multiple threads were requested, the genes are shared between a pool of workers and the
+  // output is written in the original gene order.
+  if (numberThreads > 1) {
+    reader.Close();
+    workStealingScheduler scheduler(table.numberGenes(), numberThreads);
+    orderedOutput results(table.numberGenes());
+    orderedOutput lowCoverageResults(table.numberGenes());
+    vector<readFilter> filters(numberThreads, filter);
+    vector<runStatistics> workerStats(numberThreads);
+    workerError errors;
+    vector<thread> workers;
+    for (int i = 0; i < numberThreads; ++i) {
+      runStatistics* workerStatsPointer = (stats != NULL) ? &workerStats[i] : NULL;
+      const shardMapping* workerShard = sharding ? &shard : NULL;
+      resultCache* workerCache = cache.isOpen() ? &cache : NULL;
+      workers.push_back(thread(geneWorker, i, ref(inputFiles), cref(references), ref(table), cref(statistics), ref(filters[i]), workerStatsPointer, workerShard, columnar, workerCache, ref(scheduler), ref(results), ref(lowCoverageResults), ref(errors)));
+    }
+    if (columnar) {
+      string packed;
+      while (results.next(packed)) { columnWriter.addPacked(packed); }
+    } else {
+      results.write(outFile);
+    }
+    if (statistics.lowCoverage && !sharding) { lowCoverageResults.write(bedFile); }
+    for (int i = 0; i < numberThreads; ++i) {
+      workers[i].join();
+      filter.merge(filters[i]);
+      runStats.merge(workerStats[i]);
+    }
+    checkWorkers(errors);
+    if (columnar) { columnWriter.finish(); }
+    if (sharding) { writeShardTrailer(outFile); }
+    if (filter.active()) { filter.report(cerr); }
+    closeOutput(outFile, bedFile);
+    writeRunStatistics(stats, statsFile, filter);
+    return 0;
   }
+
+  // The working buffers and the structures holding the statistics are held by the engine and reused
+  // for every region and gene. With a result cache, the output for each gene is built in memory so
+  // that it can be kept.
+  coverageEngine engine(statistics);
+  if (cache.isOpen()) {
+    outputWriter buffer;
+    outputWriter bedBuffer;
+    geneWriter bufferWriter(buffer, bedBuffer, "", table, references, statistics, stats);
+    string geneOutput;
+    string lowCoverage;
+    for (unsigned int gene = 0; gene < table.numberGenes(); ++gene) {
+      if ( !cachedGene(cache, engine, reader, table, gene, filter, bufferWriter, buffer, bedBuffer, stats, geneOutput, lowCoverage) ) { engineFailed(engine); }
+      outFile << geneOutput;
+      if (statistics.lowCoverage) { bedFile << lowCoverage; }
+    }
+  } else if ( !engine.calculate(reader, table, filter, writer, stats) ) {
+    engineFailed(engine);
+  }
+  if (sharding) { writeShardTrailer(outFile); }
+  if (columnar) { columnWriter.finish(); }
+
+  // Report the number of alignments and bases removed by each filter.
+  if (filter.active()) { filter.report(cerr); }
+  closeOutput(outFile, bedFile);
+  writeRunStatistics(stats, statsFile, filter);
 }
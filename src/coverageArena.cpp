@@ -0,0 +1,77 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Working buffers reused by a worker from region to region and gene to gene
+// ***************************************************************************
+
+#include "coverageArena.h"
+
+using namespace std;
+
+// Constructor
+coverageArena::coverageArena(const statisticsOptions& statistics) : options(statistics) {
+}
+
+coverageArena::~coverageArena(void) {
+  for (size_t i = 0; i < freeData.size(); ++i) { delete freeData[i]; }
+  map<unsigned int, sharedDepth*>::iterator iter    = shared.begin();
+  map<unsigned int, sharedDepth*>::iterator iterEnd = shared.end();
+  for (; iter != iterEnd; ++iter) { delete iter->second; }
+  for (size_t i = 0; i < freeShared.size(); ++i) { delete freeShared[i]; }
+}
+
+// Hand out an empty coverageData object for a gene with the given number of features, reusing a
+// released object if there is one.
+coverageData* coverageArena::acquire(size_t features) {
+  if (freeData.empty()) { return new coverageData(features, options); }
+  coverageData* cov = freeData.back();
+  freeData.pop_back();
+  cov->reset();
+  return cov;
+}
+
+// Return a coverageData object to the pool once its results have been written.
+void coverageArena::release(coverageData* cov) {
+  freeData.push_back(cov);
+}
+
+// Find the depth kept for a span, or NULL if it has not been kept.
+coverageArena::sharedDepth* coverageArena::findShared(unsigned int span) {
+  map<unsigned int, sharedDepth*>::iterator found = shared.find(span);
+  return (found == shared.end()) ? NULL : found->second;
+}
+
+// Keep the depth of a span for the later regions with the same span.
+void coverageArena::keepShared(unsigned int span, const compactDepth& coverage, int start) {
+  if (shared.size() >= MAX_SHARED_DEPTHS) { return; }
+  sharedDepth* depth;
+  if (freeShared.empty()) { depth = new sharedDepth; }
+  else {
+    depth = freeShared.back();
+    freeShared.pop_back();
+  }
+  depth->coverage = coverage;
+  depth->start    = start;
+  shared[span]    = depth;
+}
+
+// Release the depth of a span once the last region with the span has been processed.
+void coverageArena::releaseShared(unsigned int span) {
+  map<unsigned int, sharedDepth*>::iterator found = shared.find(span);
+  if (found == shared.end()) { return; }
+  freeShared.push_back(found->second);
+  shared.erase(found);
+}
+
+// Release the depths of every span, at the end of a request. Spans whose later regions were not
+// calculated in the request (e.g. they were in genes handled by another worker) are released here.
+void coverageArena::clearShared(void) {
+  map<unsigned int, sharedDepth*>::iterator iter    = shared.begin();
+  map<unsigned int, sharedDepth*>::iterator iterEnd = shared.end();
+  for (; iter != iterEnd; ++iter) { freeShared.push_back(iter->second); }
+  shared.clear();
+}
@@ -0,0 +1,81 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Working buffers reused by a worker from region to region and gene to gene
+// ***************************************************************************
+
+#ifndef COVERAGE_ARENA_H
+#define COVERAGE_ARENA_H
+
+#include "api/BamAlignment.h"
+#include "dataProcessing.h"
+#include "depthAccumulator.h"
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// The buffers needed to calculate the coverage of a region, along with a pool
+// of coverageData objects for the genes. Each worker thread owns one arena.
+// Nothing is freed until the arena is destroyed, so every buffer stays at the
+// largest size it has needed and, once the largest region and gene have been
+// seen, processing a region makes no heap allocations.
+//
+// The arena also keeps the depth of regions whose span is listed again later in
+// the region table, so the alignments in a shared span are only read once. At
+// most MAX_SHARED_DEPTHS are kept; beyond that the depth is read again. The
+// spans are regions of one table on one reader, so the kept depths only hold
+// for a single request and are cleared at its end.
+#define MAX_SHARED_DEPTHS 1024
+
+class coverageArena {
+
+  public:
+    coverageArena(const statisticsOptions&);
+    ~coverageArena(void);
+
+  // Public methods.
+  public:
+    coverageData* acquire(size_t);
+    void release(coverageData*);
+
+    // The depth of a span and the offset of the region in it, or -1 if the span has
+    // no alignments.
+    struct sharedDepth {
+      compactDepth coverage;
+      int start;
+    };
+    sharedDepth* findShared(unsigned int);
+    void keepShared(unsigned int, const compactDepth&, int);
+    void releaseShared(unsigned int);
+    void clearShared(void);
+
+  // Working buffers.
+  public:
+    BamAlignment alignment;
+    depthAccumulator accumulator;
+    compactDepth coverage;
+    string id;
+
+    // The depth read from a depth index.
+    vector<int> depth;
+
+  private:
+    const statisticsOptions& options;
+
+    // coverageData objects that have been released and can be handed out again.
+    vector<coverageData*> freeData;
+
+    // The depths kept for shared spans, by the first region with the span, and those
+    // that have been released.
+    map<unsigned int, sharedDepth*> shared;
+    vector<sharedDepth*> freeShared;
+};
+
+#endif // COVERAGE_ARENA_H
@@ -0,0 +1,291 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Calculate the coverage of the genes in a region table, for use as a library
+// ***************************************************************************
+
+#include "coverageEngine.h"
+#include "bamStream.h"
+#include "regionCoverage.h"
+#include <algorithm>
+
+using namespace std;
+using namespace BamTools;
+
+// Create an id for a feature with the region included. The id is built in a buffer that is reused
+// for every feature.
+const string& featureId(int exonId, const string& regionString, string& id) {
+  id.clear();
+  id += to_string(exonId);
+  id += '\t';
+  id += regionString;
+  return id;
+}
+
+// Calculate the coverage for each of the regions in a gene, and the gene level statistics. If run
+// statistics are being collected, each stage is timed, along with the gene as a whole. Returns false,
+// with the reason in error, if the alignments in a region could not be read.
+bool calculateGeneCoverage(alignmentReader& reader, const regionTable& table, unsigned int gene, coverageArena& arena, readFilter& filter, coverageData& cov, runStatistics* stats, string& error) {
+
+  // Index data must be available for all BAM files to use SetRegion.
+  bool hasIndexes = reader.HasIndexes();
+
+  double geneStart        = 0;
+  unsigned long geneReads = 0;
+  if (stats != NULL) {
+    geneStart = runStatistics::wallTime();
+    geneReads = stats->reads();
+  }
+
+  // Loop over all regions.
+  for (unsigned int i = table.geneOffsets[gene]; i < table.geneOffsets[gene + 1]; ++i) {
+    if (hasIndexes) {
+      BamRegion region = table.region(i);
+
+      // Determine the length of the region and use this to define the start of each feature in the array of
+      // coverage data.
+      unsigned int length = region.RightPosition - region.LeftPosition + 1;
+
+      // Create an id with the region included.
+      int feature = cov.addFeature(featureId(i - table.geneOffsets[gene] + 1, table.regionStrings[i], arena.id), length);
+
+      // A region with the same span as one already calculated takes its statistics from the kept
+      // depth, and the depth is kept until the last region with the span.
+      coverageArena::sharedDepth* shared = table.sharesSpan(i) ? arena.findShared(table.spanSource[i]) : NULL;
+      if (shared != NULL) {
+        if (stats != NULL) { stats->start(); }
+        projectCoverage(shared->coverage, shared->start, cov, feature);
+        if (stats != NULL) { stats->stop(STAGE_STATISTICS); }
+        if (table.spanNext[i] == NO_REGION) { arena.releaseShared(table.spanSource[i]); }
+        continue;
+      }
+
+      // Calculate the coverage of the region.
+      int start;
+      bool read;
+      if (stats == NULL) { read = calculateRegionCoverage(reader, region, arena.alignment, arena.accumulator, arena.coverage, filter, cov, feature, start); }
+      else { read = calculateRegionCoverage(reader, region, arena.alignment, arena.accumulator, arena.coverage, filter, cov, feature, start, *stats); }
+      if (!read) {
+        error = regionError(reader, table.regionStrings[i]);
+        return false;
+      }
+      if (table.spanNext[i] != NO_REGION) { arena.keepShared(table.spanSource[i], arena.coverage, start); }
+    }
+  }
+
+  // Calculcate gene level data.
+  if (stats == NULL) { cov.processGene(); }
+  else {
+    stats->start();
+    cov.processGene();
+    stats->stop(STAGE_STATISTICS);
+    stats->addGene(table.geneNames[gene], runStatistics::wallTime() - geneStart, table.numberRegions(gene), stats->reads() - geneReads);
+  }
+  return true;
+}
+
+// Calculate the coverage of every region in every gene, reading each reference once. The alignments
+// are either streamed from the files, decompressing blocks in parallel, or read on each reference
+// through the index. If run statistics are being collected, the sweep counts the work done in each
+// region, and each gene is timed from when the sweep reaches its first region to when its last
+// region is finished. Genes that overlap share this time. Returns false, with the reason in error,
+// if the alignments could not be read.
+bool sweepGenes(alignmentReader& reader, const sweepOptions& options, const regionTable& table, coverageArena& arena, readFilter& filter, runStatistics* stats, vector<coverageData*>& genes, string& error) {
+  for (unsigned int gene = 0; gene < table.numberGenes(); ++gene) {
+    coverageData* cov = arena.acquire(table.numberRegions(gene));
+    for (unsigned int i = table.geneOffsets[gene]; i < table.geneOffsets[gene + 1]; ++i) {
+      const compiledRegion& region = table.regions[i];
+      cov->addFeature(featureId(i - table.geneOffsets[gene] + 1, table.regionStrings[i], arena.id), region.rightPosition - region.leftPosition + 1);
+    }
+    genes.push_back(cov);
+  }
+
+  // Add the regions to the sweep in position order. Each span is only added once, with the other
+  // regions with the same span added to it as copies.
+  regionSweep sweeper(filter, stats);
+  vector<size_t> sweepRegions(table.regions.size());
+  vector<unsigned int>::const_iterator iter    = table.sortedOrder.begin();
+  vector<unsigned int>::const_iterator iterEnd = table.sortedOrder.end();
+  for (; iter != iterEnd; ++iter) {
+    if (table.spanSource[*iter] != *iter) { continue; }
+    unsigned int gene = table.regions[*iter].gene;
+    size_t sweepRegion = sweeper.addRegion(table.region(*iter), genes[gene], *iter - table.geneOffsets[gene]);
+    sweepRegions[*iter] = sweepRegion;
+    for (unsigned int copy = table.spanNext[*iter]; copy != NO_REGION; copy = table.spanNext[copy]) {
+      unsigned int copyGene = table.regions[copy].gene;
+      sweeper.addCopy(sweepRegion, genes[copyGene], copy - table.geneOffsets[copyGene]);
+    }
+  }
+
+  // CRAM files are read through the index, with the decompression threads given to htslib.
+  bool swept;
+  if (options.decompressionThreads > 0 && !reader.IsCram()) {
+    bamMultiStream stream;
+    if (stats != NULL) { stats->start(); }
+    bool opened = stream.Open(options.inputFiles, options.decompressionThreads, &filter);
+    if (stats != NULL) { stats->stop(STAGE_SWEEP); }
+    if (!opened) {
+      error = stream.GetErrorString();
+      return false;
+    }
+    swept = sweeper.run(stream, reader);
+    stream.Close();
+  } else {
+    if ( !reader.HasIndexes() ) {
+      error = "A sweep requires indexes for all of the files, unless BAM files are streamed with decompression threads";
+      return false;
+    }
+    if (options.decompressionThreads > 0) { reader.SetThreads(options.decompressionThreads); }
+    swept = sweeper.run(reader);
+  }
+  if (!swept) {
+    error = sweeper.errorString();
+    return false;
+  }
+
+  // Time each gene from its regions, each of which has the alignments of its span.
+  if (stats != NULL) {
+    for (unsigned int gene = 0; gene < table.numberGenes(); ++gene) {
+      double started = 0, finished = 0;
+      unsigned long reads = 0;
+      for (unsigned int i = table.geneOffsets[gene]; i < table.geneOffsets[gene + 1]; ++i) {
+        size_t sweepRegion = sweepRegions[table.spanSource[i]];
+        if (i == table.geneOffsets[gene] || sweeper.regionStarted(sweepRegion) < started) { started = sweeper.regionStarted(sweepRegion); }
+        finished = max(finished, sweeper.regionFinished(sweepRegion));
+        reads += sweeper.regionReads(sweepRegion);
+      }
+      stats->addGene(table.geneNames[gene], finished - started, table.numberRegions(gene), reads);
+    }
+  }
+  return true;
+}
+
+coverageConsumer::~coverageConsumer(void) {
+}
+
+// By default a consumer only looks at whole genes.
+void coverageConsumer::feature(unsigned int gene, int feature, const coverageData& cov) {
+}
+
+void coverageConsumer::gene(unsigned int gene, const coverageData& cov) {
+}
+
+// Constructor
+coverageBuffer::coverageBuffer(void) {
+  numberThresholds = 0;
+}
+
+coverageBuffer::~coverageBuffer(void) {
+}
+
+// Remove the results, keeping the memory for the next request.
+void coverageBuffer::clear(void) {
+  features.clear();
+  genes.clear();
+  featureAbove.clear();
+  geneAbove.clear();
+}
+
+void coverageBuffer::feature(unsigned int gene, int feature, const coverageData& cov) {
+  coverageRecord record;
+  record.gene    = gene;
+  record.feature = feature;
+  record.min     = cov.featureMin[feature];
+  record.max     = cov.featureMax[feature];
+  record.q1      = cov.featureQ1[feature];
+  record.median  = cov.featureMedian[feature];
+  record.q3      = cov.featureQ3[feature];
+  record.mean    = cov.featureMean[feature];
+  record.sd      = cov.featureSd[feature];
+  features.push_back(record);
+
+  numberThresholds = cov.numberThresholds();
+  vector<double>::const_iterator aboveIter = cov.featureAbove.begin() + feature * numberThresholds;
+  featureAbove.insert(featureAbove.end(), aboveIter, aboveIter + numberThresholds);
+}
+
+void coverageBuffer::gene(unsigned int gene, const coverageData& cov) {
+  coverageRecord record;
+  record.gene    = gene;
+  record.feature = -1;
+  record.min     = cov.geneMin;
+  record.max     = cov.geneMax;
+  record.q1      = cov.geneQ1;
+  record.median  = cov.geneMedian;
+  record.q3      = cov.geneQ3;
+  record.mean    = cov.geneMean;
+  record.sd      = cov.geneSd;
+  genes.push_back(record);
+
+  numberThresholds = cov.numberThresholds();
+  geneAbove.insert(geneAbove.end(), cov.geneAbove.begin(), cov.geneAbove.begin() + numberThresholds);
+}
+
+// Constructor. The options are held by reference, so must outlive the engine.
+coverageEngine::coverageEngine(const statisticsOptions& statistics) : arena(statistics) {
+}
+
+coverageEngine::~coverageEngine(void) {
+}
+
+// Pass the results for a gene to the consumer, each feature in turn and then the gene.
+void coverageEngine::deliver(unsigned int gene, const coverageData& cov, coverageConsumer& consumer) {
+  for (size_t feature = 0; feature < cov.size(); ++feature) { consumer.feature(gene, feature, cov); }
+  consumer.gene(gene, cov);
+}
+
+// Calculate the coverage of a gene and pass it to the consumer. The depths kept for shared spans
+// are left for the rest of the request. A gene that could not be calculated is not delivered.
+bool coverageEngine::calculateOne(alignmentReader& reader, const regionTable& table, unsigned int gene, readFilter& filter, coverageConsumer& consumer, runStatistics* stats) {
+  coverageData* cov = arena.acquire(table.numberRegions(gene));
+  bool calculated = calculateGeneCoverage(reader, table, gene, arena, filter, *cov, stats, error);
+  if (calculated) { deliver(gene, *cov, consumer); }
+  arena.release(cov);
+  return calculated;
+}
+
+// Calculate the coverage of a single gene, seeking to each of its regions. The files must be
+// indexed. Spans are only shared within the gene, as the next request may be on another reader or
+// table. Returns false, with the reason in errorString, if the alignments could not be read.
+bool coverageEngine::calculateGene(alignmentReader& reader, const regionTable& table, unsigned int gene, readFilter& filter, coverageConsumer& consumer, runStatistics* stats) {
+  error.clear();
+  bool calculated = calculateOne(reader, table, gene, filter, consumer, stats);
+  arena.clearShared();
+  return calculated;
+}
+
+// Calculate the coverage of every gene in the table in order, seeking to each region. Spans are
+// shared between the genes of the table. The request stops at the first gene that cannot be
+// calculated.
+bool coverageEngine::calculate(alignmentReader& reader, const regionTable& table, readFilter& filter, coverageConsumer& consumer, runStatistics* stats) {
+  error.clear();
+  bool calculated = true;
+  for (unsigned int gene = 0; calculated && gene < table.numberGenes(); ++gene) { calculated = calculateOne(reader, table, gene, filter, consumer, stats); }
+  arena.clearShared();
+  return calculated;
+}
+
+// Calculate the coverage of every gene in the table with a single pass over each reference (see
+// sweepGenes). The results are delivered in the order of the table once the sweep is complete, so
+// none are delivered if the sweep fails.
+bool coverageEngine::sweep(alignmentReader& reader, const sweepOptions& options, const regionTable& table, readFilter& filter, coverageConsumer& consumer, runStatistics* stats) {
+  error.clear();
+  if ( !sweepGenes(reader, options, table, arena, filter, stats, genes, error) ) {
+    for (size_t i = 0; i < genes.size(); ++i) { arena.release(genes[i]); }
+    genes.clear();
+    return false;
+  }
+  for (size_t i = 0; i < genes.size(); ++i) {
+    if (stats != NULL) { stats->start(); }
+    genes[i]->processGene();
+    if (stats != NULL) { stats->stop(STAGE_STATISTICS); }
+    deliver(i, *genes[i], consumer);
+    arena.release(genes[i]);
+  }
+  genes.clear();
+  return true;
+}
@@ -0,0 +1,136 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Calculate the coverage of the genes in a region table, for use as a library
+// ***************************************************************************
+
+#ifndef COVERAGE_ENGINE_H
+#define COVERAGE_ENGINE_H
+
+#include "alignmentReader.h"
+#include "coverageArena.h"
+#include "dataProcessing.h"
+#include "readFilter.h"
+#include "regions.h"
+#include "runStatistics.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Create the id of a feature, the number of the region in the gene and the
+// region string, in a reusable buffer.
+const string& featureId(int, const string&, string&);
+
+// How a sweep reads the alignments. With decompression threads, BAM files are
+// streamed from start to finish, decompressing blocks in parallel, and need no
+// index; the files must be those the reader was opened on. Otherwise each
+// reference is read through the indexes, with any threads given to htslib for
+// CRAM files.
+struct sweepOptions {
+  vector<string> inputFiles;
+  int decompressionThreads;
+
+  sweepOptions(void) : decompressionThreads(0) {}
+};
+
+// Calculate the coverage of each region in a gene, setting each region on the
+// reader in turn, and the gene level statistics. Returns false, setting the
+// error, if the alignments in a region could not be read.
+bool calculateGeneCoverage(alignmentReader&, const regionTable&, unsigned int, coverageArena&, readFilter&, coverageData&, runStatistics*, string&);
+
+// Calculate the coverage of every region in every gene with a single pass over
+// each reference. The coverageData for the genes are taken from the arena.
+// Returns false, setting the error, if the alignments could not be read.
+bool sweepGenes(alignmentReader&, const sweepOptions&, const regionTable&, coverageArena&, readFilter&, runStatistics*, vector<coverageData*>&, string&);
+
+// Receives the results from a coverageEngine. For each gene, feature is called
+// for every feature in order and then gene is called, once the gene level
+// statistics are complete. The coverageData is only valid during the call. The
+// gene is its index in the region table and the feature is the index of the
+// region within the gene.
+class coverageConsumer {
+
+  public:
+    virtual ~coverageConsumer(void);
+
+  // Public methods.
+  public:
+    virtual void feature(unsigned int, int, const coverageData&);
+    virtual void gene(unsigned int, const coverageData&);
+};
+
+// The statistics for a feature or a gene, as held by coverageBuffer.
+struct coverageRecord {
+  unsigned int gene;
+  int feature;
+  int min;
+  int max;
+  double q1;
+  double median;
+  double q3;
+  double mean;
+  double sd;
+};
+
+// A consumer that keeps the results in memory as fixed size records. Genes
+// have a feature of -1. The percentages of bases at or above each depth
+// threshold are held in above, with numberThresholds values per record. The
+// buffers keep their memory when cleared, so can be reused between requests.
+class coverageBuffer : public coverageConsumer {
+
+  public:
+    coverageBuffer(void);
+    ~coverageBuffer(void);
+
+  // Public methods.
+  public:
+    void clear(void);
+    void feature(unsigned int, int, const coverageData&);
+    void gene(unsigned int, const coverageData&);
+
+  public:
+    vector<coverageRecord> features;
+    vector<coverageRecord> genes;
+    vector<double> featureAbove;
+    vector<double> geneAbove;
+    size_t numberThresholds;
+};
+
+// Calculate the coverage of the genes in a compiled region table from open
+// readers, passing the results to a consumer rather than formatting them. The
+// engine holds the working buffers, so a long lived engine can be given many
+// requests, on any number of readers, without allocating once its buffers
+// have grown. An engine must only be used by one thread at a time; a program
+// reading on several threads creates an engine per thread. A request returns
+// false if the alignments could not be read, with the reason in errorString;
+// the genes already delivered by calculate are complete, and sweep delivers
+// nothing.
+class coverageEngine {
+
+  public:
+    coverageEngine(const statisticsOptions&);
+    ~coverageEngine(void);
+
+  // Public methods.
+  public:
+    bool calculateGene(alignmentReader&, const regionTable&, unsigned int, readFilter&, coverageConsumer&, runStatistics*);
+    bool calculate(alignmentReader&, const regionTable&, readFilter&, coverageConsumer&, runStatistics*);
+    bool sweep(alignmentReader&, const sweepOptions&, const regionTable&, readFilter&, coverageConsumer&, runStatistics*);
+    const string& errorString(void) const { return error; }
+
+  private:
+    bool calculateOne(alignmentReader&, const regionTable&, unsigned int, readFilter&, coverageConsumer&, runStatistics*);
+    void deliver(unsigned int, const coverageData&, coverageConsumer&);
+
+  private:
+    coverageArena arena;
+    vector<coverageData*> genes;
+    string error;
+};
+
+#endif // COVERAGE_ENGINE_H
@@ -15,17 +15,79 @@
 using namespace std;
 
 // Constructor
-coverageData::coverageData(size_t size) {
+coverageData::coverageData(size_t size, const statisticsOptions& statistics) : options(statistics) {
 
   // Initialise arrays.
-  featureLengths[size];
+  idEnds.reserve(size);
+  featureLengths.reserve(size);
+  featureMean.reserve(size);
+  featureMedian.reserve(size);
+  featureQ1.reserve(size);
+  featureQ3.reserve(size);
+  featureIqr.reserve(size);
+  featureSd.reserve(size);
+  featureMin.reserve(size);
+  featureMax.reserve(size);
+  featureAbove.reserve(size * options.thresholds.size());
+  geneBasesAbove.resize(options.thresholds.size(), 0);
+  geneBases  = 0;
+  geneMean   = 0;
+  geneMedian = 0;
+  geneQ1     = 0;
+  geneQ3     = 0;
+  geneIqr    = 0;
+  geneSd     = 0;
+  geneMin    = 0;
+  geneMax    = 0;
 }
 
 coverageData::~coverageData(void) {
 }
 
-// If a feature has no coverage, add the statistics to the correct fields.
-void coverageData::noCoverage() {
+// Remove all features and gene level statistics so the object can be used for another gene. Clearing
+// the arrays keeps their memory.
+void coverageData::reset(void) {
+  clearFeatures();
+  geneAbove.clear();
+  geneBases = 0;
+  geneBasesAbove.assign(options.thresholds.size(), 0);
+  geneHistogram.clear();
+  geneMean   = 0;
+  geneMedian = 0;
+  geneQ1     = 0;
+  geneQ3     = 0;
+  geneIqr    = 0;
+  geneSd     = 0;
+  geneMin    = 0;
+  geneMax    = 0;
+}
+
+// Remove the features that have been written, keeping the gene level totals, so that a gene with
+// a very large number of features can be written a part at a time.
+void coverageData::clearFeatures(void) {
+  idText.clear();
+  idEnds.clear();
+  featureLengths.clear();
+  featureMean.clear();
+  featureMedian.clear();
+  featureQ1.clear();
+  featureQ3.clear();
+  featureIqr.clear();
+  featureSd.clear();
+  featureMin.clear();
+  featureMax.clear();
+  featureAbove.clear();
+  lowCoverage.clear();
+}
+
+// Add a new feature and return its index. The statistics for the feature are
+// filled in by processFeature or noCoverage. Features do not need to be
+// processed in the order they were added.
+int coverageData::addFeature(const string& id, int length) {
+  idText += id;
+  idEnds.push_back(idText.size());
+  featureLengths.push_back(length);
+  geneBases += length;
   featureMin.push_back(0);
   featureMax.push_back(0);
   featureMean.push_back(0);
@@ -34,58 +96,54 @@ void coverageData::noCoverage() {
   featureQ3.push_back(0);
   featureIqr.push_back(0);
   featureSd.push_back(0);
+  featureAbove.resize(featureAbove.size() + options.thresholds.size(), 0);
+  return idEnds.size() - 1;
 }
 
-// Process a single feature.
-void coverageData::processFeature(vector<int>& coverage, int start) {
-
-  // Initialise variables.
-  int length  = coverage.size() - start;
-  int sum     = 0;
-  double sd   = 0.;
-  vector<int> newCoverage;
-
-  // Loop over the coverage data for the feature.
-  vector<int>::iterator iter    = coverage.begin() + start - 1;
-  vector<int>::iterator iterEnd = coverage.end();
-  for (; iter != iterEnd; ++iter) {
-
-    // keep a sum of the coverage values.
-    sum += *iter;
+// If a feature has no coverage, add the statistics to the correct fields.
+void coverageData::noCoverage(int feature) {
+  featureMin[feature]    = 0;
+  featureMax[feature]    = 0;
+  featureMean[feature]   = 0;
+  featureMedian[feature] = 0;
+  featureQ1[feature]     = 0;
+  featureQ3[feature]     = 0;
+  featureIqr[feature]    = 0;
+  featureSd[feature]     = 0;
 
-    // Add the value to the newCoverage vector. This will create the vector with the correct
-    // number of entries to be sorted for calculating the median.
-    newCoverage.push_back(*iter);
-    geneCoverage.push_back(*iter);
+  // The whole feature is below every threshold.
+  if (options.lowCoverage) {
+    lowCoverageInterval interval;
+    interval.feature = feature;
+    interval.start   = 0;
+    interval.end     = featureLengths[feature];
+    lowCoverage.push_back(interval);
   }
+}
 
-  // Calculate the mean.
-  double mean = sum / double(length);
-  featureMean.push_back(mean);
-
-  // Sort the newCoverage vector.
-  std::sort(newCoverage.begin(), newCoverage.end());
+// Calculate the statistics for a set of values held in a histogram. The mean, standard deviation
+// and quartile positions are based on 'length', which for features is one less than the number
+// of values in the histogram.
+void coverageData::calculateStatistics(const depthHistogram& histogram, long length, int& min, int& max, double& mean, double& median, double& q1, double& q3, double& sd) {
 
-  // Now calculate the standard deviation for the feature.
-  iter    = newCoverage.begin();
-  iterEnd = newCoverage.end();
-  for (; iter != iterEnd; ++iter) { sd += pow( double(*iter - mean) , 2.0 ); }
-  featureSd.push_back( sqrt(sd / double(length)) );
+  // Calculate the mean and standard deviation.
+  mean = histogram.sum() / double(length);
+  sd   = sqrt(histogram.squaredDeviation(mean) / double(length));
 
   // Calculate the median and quartiles. If the length is odd, this is the middle value.
   if (length % 2) {
-    int middle = (length + 1) / 2 - 1;
-    featureMedian.push_back( *(newCoverage.begin() + middle));
+    long middle = (length + 1) / 2 - 1;
+    median = histogram.valueAt(middle);
 
     // Now calculate the first and third quartiles. If there are (4n + 1) points,
     if (remainder(length - 1, 4) == 0) {
-      int n = (length - 1) / 4;
-      featureQ1.push_back((0.25 * *(newCoverage.begin() + n - 1)) + (0.75 * *(newCoverage.begin() + n)));
-      featureQ3.push_back((0.75 * *(newCoverage.begin() + (3 * n))) + (0.25 * *(newCoverage.begin() + (3 * n) + 1)));
+      long n = (length - 1) / 4;
+      q1 = (0.25 * histogram.valueAt(n - 1)) + (0.75 * histogram.valueAt(n));
+      q3 = (0.75 * histogram.valueAt(3 * n)) + (0.25 * histogram.valueAt((3 * n) + 1));
     } else if (remainder(length - 3, 4) == 0) {
-      int n = (length - 3) / 4;
-      featureQ1.push_back((0.75 * *(newCoverage.begin() + n)) + (0.25 * *(newCoverage.begin() + n + 1)));
-      featureQ3.push_back((0.25 * *(newCoverage.begin() + (3 * n) + 1)) + (0.75 * *(newCoverage.begin() + (3 * n) + 2)));
+      long n = (length - 3) / 4;
+      q1 = (0.75 * histogram.valueAt(n)) + (0.25 * histogram.valueAt(n + 1));
+      q3 = (0.25 * histogram.valueAt((3 * n) + 1)) + (0.75 * histogram.valueAt((3 * n) + 2));
     } else {
       cout << "Mathematical error in quartile calculation" << endl;
       exit(1);
@@ -93,40 +151,143 @@ void coverageData::processFeature(vector<int>& coverage, int start) {
 
   // If the length is even, take the average of the middle two values.
   } else {
-    int value1 = *(newCoverage.begin() + (length / 2) - 1);
-    int value2 = *(newCoverage.begin() + ( (length / 2)) );
-    featureMedian.push_back( (double(value1) + value2) / 2);
+    int value1 = histogram.valueAt((length / 2) - 1);
+    int value2 = histogram.valueAt(length / 2);
+    median = (double(value1) + value2) / 2;
 
     // And determine the quartiles. If the lower half of the data has an odd length,
     // the quartiles are the midpoint of the lower and upper halves.
     if ( (length / 2) % 2) {
-      int middle = ((length / 2) + 1) / 2;
-      featureQ1.push_back( *(newCoverage.begin() + middle - 1));
-      featureQ3.push_back( *(newCoverage.begin() + middle + (length / 2) ) - 1);
+      long middle = ((length / 2) + 1) / 2;
+      q1 = histogram.valueAt(middle - 1);
+      q3 = histogram.valueAt(middle + (length / 2)) - 1;
 
     // If the lower half has an even length, take the average of the middle two points.
     } else {
-      int value1 = *(newCoverage.begin() + (length / 4) - 1);
-      int value2 = *(newCoverage.begin() + (length / 4));
-      featureQ1.push_back( (double(value1) + value2) / 2);
-      value1 = *(newCoverage.begin() + 3 * (length / 4) - 1);
-      value2 = *(newCoverage.begin() + 3 * (length / 4));
-      featureQ3.push_back( (double(value1) + value2) / 2);
+      int value1 = histogram.valueAt((length / 4) - 1);
+      int value2 = histogram.valueAt(length / 4);
+      q1 = (double(value1) + value2) / 2;
+      value1 = histogram.valueAt(3 * (length / 4) - 1);
+      value2 = histogram.valueAt(3 * (length / 4));
+      q3 = (double(value1) + value2) / 2;
+    }
+  }
+
+  // Now store the minimum and maximum values.
+  min = histogram.minimum();
+  max = histogram.maximum();
+}
+
+// Process a single feature.
+void coverageData::processFeature(vector<int>& coverage, int start, int feature) {
+
+  // The feature includes the base preceding 'start'. If no read started before the region, this
+  // base is not in the coverage vector and has no coverage.
+  featureHistogram.clear();
+  int previous = (start > 0) ? coverage[start - 1] : 0;
+  featureHistogram.add(previous);
+
+  // Loop over the coverage data for the feature and build the histogram of values.
+  vector<int>::iterator iter    = coverage.begin() + start;
+  vector<int>::iterator iterEnd = coverage.end();
+  for (; iter != iterEnd; ++iter) {
+    featureHistogram.add(*iter);
+  }
+  storeFeature(coverage.size() - start, feature);
+  if (options.lowCoverage) { findLowCoverage(coverage, start, feature); }
+}
+
+// Process a single feature from depth held in 16 bits. The results are the same as for the 32-bit
+// depth above.
+void coverageData::processFeature(const compactDepth& coverage, int start, int feature) {
+  featureHistogram.clear();
+  int previous = (start > 0) ? coverage[start - 1] : 0;
+  featureHistogram.add(previous);
+  featureHistogram.add(coverage, start);
+  storeFeature(coverage.size() - start, feature);
+  if (options.lowCoverage) { findLowCoverage(coverage, start, feature); }
+}
+
+// Calculate and store the statistics for a feature from the feature histogram.
+void coverageData::storeFeature(int length, int feature) {
+  int min, max;
+  double mean, median, q1, q3, sd;
+  geneHistogram.merge(featureHistogram);
+
+  // Calculate and store the statistics.
+  calculateStatistics(featureHistogram, length, min, max, mean, median, q1, q3, sd);
+  featureMin[feature]    = min;
+  featureMax[feature]    = max;
+  featureMean[feature]   = mean;
+  featureMedian[feature] = median;
+  featureQ1[feature]     = q1;
+  featureQ3[feature]     = q3;
+  featureSd[feature]     = sd;
+
+  // The percentage of the bases in the feature at or above each depth threshold.
+  size_t numberThresholds = options.thresholds.size();
+  for (size_t i = 0; i < numberThresholds; ++i) {
+    unsigned long above = featureHistogram.countAtLeast(options.thresholds[i]);
+    featureAbove[feature * numberThresholds + i] = 100. * above / featureHistogram.count();
+    geneBasesAbove[i] += above;
+  }
+}
+
+// Find the intervals in a feature with depth below the lowest threshold. As for the statistics,
+// the feature starts with the base preceding 'start'. The depth is either a vector<int> or a
+// compactDepth.
+template <class depthValues>
+void coverageData::findLowCoverage(const depthValues& coverage, int start, int feature) {
+  int threshold = *min_element(options.thresholds.begin(), options.thresholds.end());
+  int length    = coverage.size() - start + 1;
+  int offset    = start - 1;
+
+  lowCoverageInterval interval;
+  interval.feature = feature;
+  interval.start   = -1;
+  for (int i = 0; i < length; ++i) {
+    int depth = (i + offset >= 0) ? coverage[i + offset] : 0;
+    if (depth < threshold) {
+      if (interval.start < 0) { interval.start = i; }
+    } else if (interval.start >= 0) {
+      interval.end = i;
+      lowCoverage.push_back(interval);
+      interval.start = -1;
     }
   }
+  if (interval.start >= 0) {
+    interval.end = length;
+    lowCoverage.push_back(interval);
+  }
+}
 
-  // Now store the minimum and maximum values in the feature.
-  featureMin.push_back(*(newCoverage.begin()));
-  featureMax.push_back(*(newCoverage.end() - 1));
+// Order low coverage intervals by feature.
+bool coverageData::compareFeature(const lowCoverageInterval& a, const lowCoverageInterval& b) {
+  return a.feature < b.feature;
 }
 
-// Calculate the same values at the gene level.
+// Add the histogram of depths and the number of bases at or above each threshold from part of the
+// gene. The number of bases in the gene is set by the features that are added.
+void coverageData::addGeneTotals(const depthHistogram& histogram, const vector<unsigned long>& basesAbove) {
+  geneHistogram.merge(histogram);
+  for (size_t i = 0; i < geneBasesAbove.size() && i < basesAbove.size(); ++i) { geneBasesAbove[i] += basesAbove[i]; }
+}
+
+// Calculate the same values at the gene level from the merged feature histograms.
 void coverageData::processGene() {
 
+  // Features may have been processed in any order, so put the low coverage intervals in feature order.
+  stable_sort(lowCoverage.begin(), lowCoverage.end(), compareFeature);
+
+  // The percentage of bases at or above each threshold is over all of the features, including
+  // those without any reads.
+  geneAbove.resize(options.thresholds.size());
+  for (size_t i = 0; i < options.thresholds.size(); ++i) {
+    geneAbove[i] = (geneBases > 0) ? 100. * geneBasesAbove[i] / geneBases : 0;
+  }
+
   // Initialise variables.
-  int length = geneCoverage.size();
-  int sum    = 0;
-  double sd  = 0.;
+  long length = geneHistogram.count();
   
   // If there were no reads in the entire gene, return.
   if (length == 0) {
@@ -140,62 +301,6 @@ void coverageData::processGene() {
     return;
   }
 
-  // Sort the gene level coverage.
-  std::sort(geneCoverage.begin(), geneCoverage.end());
-
   // Calculate values.
-  vector<int>::iterator iter    = geneCoverage.begin();
-  vector<int>::iterator iterEnd = geneCoverage.end();
-  geneMin = *iter;
-  geneMax = *(iterEnd - 1);
-
-  // The mean for the gene.
-  for (; iter != iterEnd; ++iter) { sum += *iter; }
-  geneMean = sum / double(length);
-
-  // The standard deviation for the gene.
-  iter = geneCoverage.begin();
-  for (; iter != iterEnd; ++iter) { sd += pow( double(*iter - geneMean) , 2.0 ); }
-  geneSd = sqrt(sd / length);
-
-  // The gene median.
-  if (length % 2) {
-    int middle = (length + 1) / 2 - 1;
-    geneMedian = *(geneCoverage.begin() + middle);
-
-    // Now calculate the first and third quartiles. If there are (4n + 1) points,
-    if (remainder(length - 1, 4) == 0) {
-      int n = (length - 1) / 4;
-      geneQ1 = ((0.25 * *(geneCoverage.begin() + n - 1)) + (0.75 * *(geneCoverage.begin() + n)));
-      geneQ3 = ((0.75 * *(geneCoverage.begin() + (3 * n))) + (0.25 * *(geneCoverage.begin() + (3 * n) + 1)));
-    } else if (remainder(length - 3, 4) == 0) {
-      int n = (length - 3) / 4;
-      geneQ1 = ((0.75 * *(geneCoverage.begin() + n)) + (0.25 * *(geneCoverage.begin() + n + 1)));
-      geneQ3 = ((0.25 * *(geneCoverage.begin() + (3 * n) + 1)) + (0.75 * *(geneCoverage.begin() + (3 * n) + 2)));
-    } else {
-      cout << "Mathematical error in quartile calculation" << endl;
-      exit(1);
-    }
-  } else {
-    int value1 = *(geneCoverage.begin() + (length / 2) - 1);
-    int value2 = *(geneCoverage.begin() + ( (length / 2)) );
-    geneMedian = (double(value1) + value2) / 2;
-
-    // And determine the quartiles. If the lower half of the data has an odd length,
-    // the quartiles are the midpoint of the lower and upper halves.
-    if ( (length / 2) % 2) {
-      int middle = ((length / 2) + 1) / 2;
-      geneQ1 = ( *(geneCoverage.begin() + middle - 1));
-      geneQ3 = ( *(geneCoverage.begin() + middle + (length / 2) ) - 1);
-
-    // If the lower half has an even length, take the average of the middle two points.
-    } else {
-      int value1 = *(geneCoverage.begin() + (length / 4) - 1);
-      int value2 = *(geneCoverage.begin() + (length / 4));
-      geneQ1 = ( (double(value1) + value2) / 2);
-      value1 = *(geneCoverage.begin() + 3 * (length / 4) - 1);
-      value2 = *(geneCoverage.begin() + 3 * (length / 4));
-      geneQ3 = ( (double(value1) + value2) / 2);
-    }
-  }
+  calculateStatistics(geneHistogram, length, geneMin, geneMax, geneMean, geneMedian, geneQ1, geneQ3, geneSd);
 }
@@ -14,15 +14,41 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include "compactDepth.h"
+#include "depthHistogram.h"
 
 using namespace std;
 
+// Optional statistics. For each depth threshold, the percentage of bases with at
+// least that depth is reported. If requested, the intervals with depth below the
+// lowest threshold are also found.
+struct statisticsOptions {
+  vector<int> thresholds;
+  bool lowCoverage;
+
+  statisticsOptions(void) : lowCoverage(false) {}
+};
+
+// An interval of low coverage within a feature. The start and end are offsets
+// from the first base of the feature, with the end excluded.
+struct lowCoverageInterval {
+  int feature;
+  int start;
+  int end;
+};
+
+// The statistics for the features in a gene, and for the gene as a whole. The
+// feature statistics are held as a table with one array per column, and reset
+// keeps the arrays at their largest size, so an object that is reused from gene
+// to gene stops allocating once it has held the largest gene.
 class coverageData {
 
   public:
 
-    // id for the region.
-    std::vector<string> ids;
+    // ids for the regions, held end to end in a single string. The id of a feature
+    // runs from the end of the previous id to idEnds[feature].
+    std::string idText;
+    std::vector<size_t> idEnds;
 
     // Hold the data for generating the data.
     std::vector<int> featureLengths;
@@ -37,8 +63,12 @@ class coverageData {
     std::vector<int> featureMin;
     std::vector<int> featureMax;
 
+    // The percentage of bases at or above each threshold, with the values for each
+    // feature stored together, and the intervals below the lowest threshold.
+    std::vector<double> featureAbove;
+    std::vector<lowCoverageInterval> lowCoverage;
+
     // And the same values for the gene level.
-    vector<int> geneCoverage;
     double geneMean;
     double geneMedian;
     double geneQ1;
@@ -47,16 +77,50 @@ class coverageData {
     double geneSd;
     int geneMin;
     int geneMax;
+    std::vector<double> geneAbove;
 
   public:
-    coverageData(std::size_t);
+    coverageData(std::size_t, const statisticsOptions&);
     ~coverageData(void);
 
   // Public methods.
   public:
-    void noCoverage();
-    void processFeature(vector<int>&, int);
+    void reset(void);
+    void clearFeatures(void);
+    size_t size(void) const { return idEnds.size(); }
+    size_t numberThresholds(void) const { return options.thresholds.size(); }
+    int addFeature(const string&, int);
+    void noCoverage(int);
+    void processFeature(vector<int>&, int, int);
+    void processFeature(const compactDepth&, int, int);
     void processGene();
+
+    // The gene level totals, which can be added to those of the same gene
+    // calculated elsewhere (e.g. in another shard of the run) before processGene.
+    const depthHistogram& geneDepths(void) const { return geneHistogram; }
+    const vector<unsigned long>& geneCountsAbove(void) const { return geneBasesAbove; }
+    void addGeneTotals(const depthHistogram&, const vector<unsigned long>&);
+
+  // Private methods.
+  private:
+    void calculateStatistics(const depthHistogram&, long, int&, int&, double&, double&, double&, double&, double&);
+    void storeFeature(int, int);
+    template <class depthValues> void findLowCoverage(const depthValues&, int, int);
+    static bool compareFeature(const lowCoverageInterval&, const lowCoverageInterval&);
+
+  private:
+    const statisticsOptions& options;
+
+    // The number of bases in the gene, and the number at or above each threshold.
+    long geneBases;
+    vector<unsigned long> geneBasesAbove;
+
+
+    // Histograms of the depth values in the current feature and gene. The gene
+    // histogram is the sum of the feature histograms, so memory for a gene is
+    // independent of its length.
+    depthHistogram featureHistogram;
+    depthHistogram geneHistogram;
 };
 
 #endif // DATA_PROCESSING_H
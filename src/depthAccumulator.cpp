@@ -0,0 +1,275 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Accumulate per-base depth from alignment CIGAR strings
+// ***************************************************************************
+
+#include "depthAccumulator.h"
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+bool processCigar(BamAlignment& al, BamRegion& region, int startPosition, vector<int>& coverage) {
+  
+  // Intialize local variables.
+  const int numCigarOps = (const int)al.CigarData.size(); 
+  int positionInRegion  = al.Position - startPosition;
+  
+  // Iterate over the CIGAR operations. 
+  for (int i = 0; i < numCigarOps; ++i ) {
+    const CigarOp& op = al.CigarData.at(i);
+  
+    // If the CIGAR string indicates a match.
+    if (op.Type == 'M') {
+      for (int j = positionInRegion; j < (positionInRegion + (int)op.Length); ++j) {
+        if (j < coverage.size()) {coverage[j]++;}
+      }
+      positionInRegion += (int)op.Length;
+    }
+  
+    // If the bases are soft or hard clipped bases, advance the position in the region, but do not update
+    // coverage.
+    else if (op.Type == 'S' || op.Type == 'H') { positionInRegion += (int)op.Length; }
+  
+    // If there is an insertion, do nothing. All the bases in the insertion do not cover reference bases, so 
+    // should not be counted and the position in the region is not advanced.
+    else if (op.Type == 'I') { }
+  
+    // If there is an deletion, count the deleted bases as covered and advance the position in the region.
+    else if (op.Type == 'D') {
+      for (int j = positionInRegion; j < (positionInRegion + (int)op.Length); ++j) {
+        if (j < coverage.size()) {coverage[j]++;}
+      }
+      positionInRegion += (int)op.Length;
+    }
+  }
+  return true;
+}
+
+// Constructor
+depthAccumulator::depthAccumulator(void) {
+  start  = 0;
+  length = 0;
+}
+
+depthAccumulator::~depthAccumulator(void) {
+}
+
+// Prepare for a new region. The delta vector keeps its capacity, so regions
+// after the first largest one do not allocate.
+void depthAccumulator::reset(int startPosition, int regionLength) {
+  start  = startPosition;
+  length = (regionLength > 0) ? regionLength : 0;
+  delta.assign(length + 1, 0);
+}
+
+// Record the blocks covered by an alignment. The walk over the CIGAR string
+// follows processCigar exactly, so that the two engines produce the same depth.
+void depthAccumulator::addAlignment(const BamAlignment& al) {
+  int position = al.Position - start;
+
+  vector<CigarOp>::const_iterator iter    = al.CigarData.begin();
+  vector<CigarOp>::const_iterator iterEnd = al.CigarData.end();
+  for (; iter != iterEnd; ++iter) {
+    int opLength = (int)iter->Length;
+
+    // Matches and deletions cover reference bases.
+    if (iter->Type == 'M' || iter->Type == 'D') {
+      addInterval(position, position + opLength);
+      position += opLength;
+    }
+
+    // Clipped bases advance the position without adding coverage.
+    else if (iter->Type == 'S' || iter->Type == 'H') { position += opLength; }
+  }
+}
+
+// Find the blocks of reference positions covered by an alignment, in the same way as addAlignment,
+// leaving out any aligned bases with a base quality below the minimum (if the minimum is above
+// zero). Each 'M' operation is split into runs of bases that pass, and the number of bases left out
+// is added to maskedBases. If the alignment has no base qualities, or the CIGAR does not match the
+// length of the read, no bases are left out. The blocks are in position order.
+void alignmentBlocks(const BamAlignment& al, int minBaseQuality, unsigned long& maskedBases, vector<coveredBlock>& blocks) {
+  blocks.clear();
+  vector<CigarOp>::const_iterator iter    = al.CigarData.begin();
+  vector<CigarOp>::const_iterator iterEnd = al.CigarData.end();
+
+  // Only use the base qualities if they match the CIGAR.
+  const char* qualities = NULL;
+  if (minBaseQuality > 0 && al.Qualities.size() == (size_t)al.Length) {
+    int queryLength = 0;
+    for (; iter != iterEnd; ++iter) {
+      if (iter->Type == 'M' || iter->Type == 'I' || iter->Type == 'S') { queryLength += (int)iter->Length; }
+    }
+    if (queryLength == al.Length) { qualities = al.Qualities.data(); }
+  }
+  char minimum = (char)(minBaseQuality + 33);
+  int position = al.Position;
+  int query    = 0;
+
+  for (iter = al.CigarData.begin(); iter != iterEnd; ++iter) {
+    int opLength = (int)iter->Length;
+    if (iter->Type == 'M') {
+      if (qualities == NULL) { blocks.push_back(coveredBlock(position, position + opLength)); }
+      else {
+        int runStart = -1;
+        for (int i = 0; i < opLength; ++i) {
+          if (qualities[query + i] >= minimum) {
+            if (runStart < 0) { runStart = i; }
+          } else {
+            maskedBases++;
+            if (runStart >= 0) {
+              blocks.push_back(coveredBlock(position + runStart, position + i));
+              runStart = -1;
+            }
+          }
+        }
+        if (runStart >= 0) { blocks.push_back(coveredBlock(position + runStart, position + opLength)); }
+      }
+      position += opLength;
+      query    += opLength;
+    }
+
+    // Deleted bases have no quality and are always covered.
+    else if (iter->Type == 'D') {
+      blocks.push_back(coveredBlock(position, position + opLength));
+      position += opLength;
+    }
+    else if (iter->Type == 'S') {
+      position += opLength;
+      query    += opLength;
+    }
+    else if (iter->Type == 'H') { position += opLength; }
+    else if (iter->Type == 'I') { query += opLength; }
+  }
+}
+
+// Add blocks of covered reference positions.
+void depthAccumulator::addBlocks(const vector<coveredBlock>& blocks) {
+  vector<coveredBlock>::const_iterator iter    = blocks.begin();
+  vector<coveredBlock>::const_iterator iterEnd = blocks.end();
+  for (; iter != iterEnd; ++iter) { addInterval(iter->first - start, iter->second - start); }
+}
+
+// Add a block of coverage over [begin, end), given relative to the start of the
+// region. Bases falling outside of the region are ignored.
+void depthAccumulator::addInterval(int begin, int end) {
+  if (begin < 0) { begin = 0; }
+  if (end > length) { end = length; }
+  if (begin >= end) { return; }
+  delta[begin]++;
+  delta[end]--;
+}
+
+// Convert the boundary events into per-base depth.
+void depthAccumulator::resolve(vector<int>& coverage) {
+  coverage.resize(length);
+  if (length == 0) { return; }
+
+  const int* in = &delta[0];
+  int* out      = &coverage[0];
+  int i         = 0;
+  int carry     = 0;
+
+#ifdef __SSE2__
+  // Prefix sum of four values at a time. Each block is scanned in register with
+  // two shifted additions and the running total from the previous block is
+  // then broadcast across it.
+  __m128i running = _mm_setzero_si128();
+  for (; i + 4 <= length; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi32(x, running);
+    _mm_storeu_si128((__m128i*)(out + i), x);
+    running = _mm_shuffle_epi32(x, 0xFF);
+  }
+  carry = _mm_cvtsi128_si32(running);
+#endif
+
+  // Scalar tail (or the whole region if SSE2 is unavailable).
+  for (; i < length; ++i) {
+    carry += in[i];
+    out[i] = carry;
+  }
+}
+
+// Convert the boundary events into per-base depth held in 16 bits. The prefix sum is the same as
+// above and is carried in 32 bits, so the depth is exact however deep the region is. Depths outside
+// of [0, SATURATED_DEPTH) are added to the overflow list.
+void depthAccumulator::resolve(compactDepth& coverage) {
+  coverage.values.resize(length);
+  coverage.overflow.clear();
+  if (length == 0) { return; }
+
+  const int* in = &delta[0];
+  uint16_t* out = &coverage.values[0];
+  int i         = 0;
+  int carry     = 0;
+  depthOverflow deep;
+
+#ifdef __SSE2__
+  // Prefix sums of eight values at a time, packed to 16 bits. SSE2 only packs with signed
+  // saturation, so the values are shifted down by 32768 before packing and back up after, which
+  // saturates anything at or above SATURATED_DEPTH to SATURATED_DEPTH. Blocks holding any value
+  // that is out of range are then checked one value at a time.
+  __m128i running = _mm_setzero_si128();
+  __m128i bias    = _mm_set1_epi32(32768);
+  __m128i flip    = _mm_set1_epi16((short)0x8000);
+  __m128i highest = _mm_set1_epi32(SATURATED_DEPTH - 1);
+  __m128i zero    = _mm_setzero_si128();
+  for (; i + 8 <= length; i += 8) {
+    __m128i low = _mm_loadu_si128((const __m128i*)(in + i));
+    low = _mm_add_epi32(low, _mm_slli_si128(low, 4));
+    low = _mm_add_epi32(low, _mm_slli_si128(low, 8));
+    low = _mm_add_epi32(low, running);
+    running = _mm_shuffle_epi32(low, 0xFF);
+
+    __m128i high = _mm_loadu_si128((const __m128i*)(in + i + 4));
+    high = _mm_add_epi32(high, _mm_slli_si128(high, 4));
+    high = _mm_add_epi32(high, _mm_slli_si128(high, 8));
+    high = _mm_add_epi32(high, running);
+    running = _mm_shuffle_epi32(high, 0xFF);
+
+    __m128i packed = _mm_packs_epi32(_mm_sub_epi32(low, bias), _mm_sub_epi32(high, bias));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(packed, flip));
+
+    __m128i outside = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(low, highest), _mm_cmplt_epi32(low, zero)),
+                                   _mm_or_si128(_mm_cmpgt_epi32(high, highest), _mm_cmplt_epi32(high, zero)));
+    if (_mm_movemask_epi8(outside) != 0) {
+      int depths[8];
+      _mm_storeu_si128((__m128i*)depths, low);
+      _mm_storeu_si128((__m128i*)(depths + 4), high);
+      for (int j = 0; j < 8; ++j) {
+        if ((unsigned int)depths[j] >= SATURATED_DEPTH) {
+          out[i + j]  = SATURATED_DEPTH;
+          deep.offset = i + j;
+          deep.depth  = depths[j];
+          coverage.overflow.push_back(deep);
+        }
+      }
+    }
+  }
+  carry = _mm_cvtsi128_si32(running);
+#endif
+
+  // Scalar tail (or the whole region if SSE2 is unavailable).
+  for (; i < length; ++i) {
+    carry += in[i];
+    if ((unsigned int)carry < SATURATED_DEPTH) { out[i] = carry; }
+    else {
+      out[i]      = SATURATED_DEPTH;
+      deep.offset = i;
+      deep.depth  = carry;
+      coverage.overflow.push_back(deep);
+    }
+  }
+}
@@ -0,0 +1,60 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Accumulate per-base depth from alignment CIGAR strings
+// ***************************************************************************
+
+#ifndef DEPTH_ACCUMULATOR_H
+#define DEPTH_ACCUMULATOR_H
+
+#include "api/BamAlignment.h"
+#include "compactDepth.h"
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// Per-base accumulation. Every base of every 'M' and 'D' operation is
+// incremented in the coverage vector. Retained as the reference engine.
+bool processCigar(BamAlignment&, BamRegion&, int, vector<int>&);
+
+// A block of reference positions, [first, second), covered by an alignment.
+typedef pair<int, int> coveredBlock;
+void alignmentBlocks(const BamAlignment&, int, unsigned long&, vector<coveredBlock>&);
+
+// Event based accumulation. Each block of reference bases covered by an
+// alignment records a +1 at its first base and a -1 after its last base. The
+// depth is recovered with a single prefix sum over the region.
+class depthAccumulator {
+
+  public:
+    depthAccumulator(void);
+    ~depthAccumulator(void);
+
+  // Public methods.
+  public:
+    void reset(int, int);
+    void addAlignment(const BamAlignment&);
+    void addBlocks(const vector<coveredBlock>&);
+    void addInterval(int, int);
+    void resolve(vector<int>&);
+    void resolve(compactDepth&);
+
+  private:
+
+    // The reference position of the first base in the region and the number
+    // of bases in the region.
+    int start;
+    int length;
+
+    // Boundary events. This has one more entry than the region so that blocks
+    // ending at the last base can record their -1.
+    vector<int> delta;
+};
+
+#endif // DEPTH_ACCUMULATOR_H
@@ -0,0 +1,182 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Histogram of per-base depth values
+// ***************************************************************************
+
+#include "depthHistogram.h"
+#include <algorithm>
+
+using namespace std;
+
+// Constructor
+depthHistogram::depthHistogram(void) {
+  maxDense = -1;
+  total    = 0;
+}
+
+depthHistogram::~depthHistogram(void) {
+}
+
+// Reset the counts. Only the part of the dense array that was used is cleared.
+void depthHistogram::clear() {
+  if (maxDense >= 0) { fill(dense.begin(), dense.begin() + maxDense + 1, 0); }
+  overflow.clear();
+  maxDense = -1;
+  total    = 0;
+}
+
+// Grow the dense array so that it can hold the given depth. The size is at
+// least doubled to keep the number of reallocations small.
+void depthHistogram::grow(int depth) {
+  size_t size = max(size_t(depth) + 1, 2 * dense.size());
+  dense.resize(min(size, size_t(DENSE_DEPTH_LIMIT)), 0);
+}
+
+// Add the counts from another histogram. This allows statistics for a set of
+// features to be built from the histograms of the individual features.
+void depthHistogram::merge(const depthHistogram& other) {
+  if (other.maxDense >= 0) {
+    if (other.maxDense >= (int)dense.size()) { grow(other.maxDense); }
+    for (int i = 0; i <= other.maxDense; ++i) { dense[i] += other.dense[i]; }
+    if (other.maxDense > maxDense) { maxDense = other.maxDense; }
+  }
+
+  map<int, unsigned long>::const_iterator iter    = other.overflow.begin();
+  map<int, unsigned long>::const_iterator iterEnd = other.overflow.end();
+  for (; iter != iterEnd; ++iter) { overflow[iter->first] += iter->second; }
+  total += other.total;
+}
+
+// Add the depths of the bases from 'first' to the end of a region. Every 16-bit value, including
+// the saturated ones, is below DENSE_DEPTH_LIMIT, so the values are counted with no test on each
+// one once the dense array is large enough for the largest. The saturated bases are then moved
+// from the count for SATURATED_DEPTH to their real depth.
+void depthHistogram::add(const compactDepth& depth, size_t first) {
+  if (first >= depth.size()) { return; }
+  const uint16_t* values = &depth.values[first];
+  size_t count           = depth.size() - first;
+
+  uint16_t largest = 0;
+  for (size_t i = 0; i < count; ++i) { largest = max(largest, values[i]); }
+  if (largest >= dense.size()) { grow(largest); }
+  unsigned long* counts = &dense[0];
+  for (size_t i = 0; i < count; ++i) { counts[values[i]]++; }
+  if (largest > maxDense) { maxDense = largest; }
+  total += count;
+
+  vector<depthOverflow>::const_iterator iter    = depth.overflow.begin();
+  vector<depthOverflow>::const_iterator iterEnd = depth.overflow.end();
+  if (iter == iterEnd) { return; }
+  for (; iter != iterEnd; ++iter) {
+    if (iter->offset < (int)first) { continue; }
+    dense[SATURATED_DEPTH]--;
+    total--;
+    add(iter->depth);
+  }
+  while (maxDense >= 0 && dense[maxDense] == 0) { maxDense--; }
+}
+
+// Add a number of bases with the same depth.
+void depthHistogram::add(int depth, unsigned long count) {
+  if ((unsigned int)depth < DENSE_DEPTH_LIMIT) {
+    if ((unsigned int)depth >= dense.size()) { grow(depth); }
+    dense[depth] += count;
+    if (count > 0 && depth > maxDense) { maxDense = depth; }
+  } else {
+    overflow[depth] += count;
+  }
+  total += count;
+}
+
+// List the depths that have been counted along with their counts, in order of depth, so that a
+// histogram can be stored and added to another later.
+void depthHistogram::counts(vector< pair<int, unsigned long> >& values) const {
+  values.clear();
+  map<int, unsigned long>::const_iterator iter    = overflow.begin();
+  map<int, unsigned long>::const_iterator iterEnd = overflow.end();
+  for (; iter != iterEnd && iter->first < 0; ++iter) { values.push_back(*iter); }
+  for (int i = 0; i <= maxDense; ++i) {
+    if (dense[i] > 0) { values.push_back(make_pair(i, dense[i])); }
+  }
+  for (; iter != iterEnd; ++iter) { values.push_back(*iter); }
+}
+
+// The sum of all values.
+double depthHistogram::sum() const {
+  long long sum = 0;
+  for (int i = 1; i <= maxDense; ++i) { sum += (long long)i * dense[i]; }
+
+  map<int, unsigned long>::const_iterator iter    = overflow.begin();
+  map<int, unsigned long>::const_iterator iterEnd = overflow.end();
+  for (; iter != iterEnd; ++iter) { sum += (long long)iter->first * iter->second; }
+  return double(sum);
+}
+
+// The smallest value.
+int depthHistogram::minimum() const {
+  return valueAt(0);
+}
+
+// The largest value.
+int depthHistogram::maximum() const {
+  return valueAt(long(total) - 1);
+}
+
+// Return the value with the given rank (counting from zero) in the sorted
+// data. Ranks outside of the data are clamped to the first or last value.
+int depthHistogram::valueAt(long rank) const {
+  if (total == 0) { return 0; }
+  if (rank < 0) { rank = 0; }
+  if (rank >= long(total)) { rank = long(total) - 1; }
+
+  // Negative values are held in the overflow map and sort first.
+  long seen = 0;
+  map<int, unsigned long>::const_iterator iter    = overflow.begin();
+  map<int, unsigned long>::const_iterator iterEnd = overflow.end();
+  for (; iter != iterEnd && iter->first < 0; ++iter) {
+    seen += iter->second;
+    if (rank < seen) { return iter->first; }
+  }
+
+  // Then the dense counts.
+  for (int i = 0; i <= maxDense; ++i) {
+    seen += dense[i];
+    if (rank < seen) { return i; }
+  }
+
+  // And finally the large values.
+  for (; iter != iterEnd; ++iter) {
+    seen += iter->second;
+    if (rank < seen) { return iter->first; }
+  }
+  return 0;
+}
+
+// The sum of the squared deviations of all values from the given mean.
+double depthHistogram::squaredDeviation(double mean) const {
+  double sd = 0.;
+  for (int i = 0; i <= maxDense; ++i) {
+    if (dense[i] > 0) { sd += dense[i] * (double(i - mean) * double(i - mean)); }
+  }
+
+  map<int, unsigned long>::const_iterator iter    = overflow.begin();
+  map<int, unsigned long>::const_iterator iterEnd = overflow.end();
+  for (; iter != iterEnd; ++iter) { sd += iter->second * (double(iter->first - mean) * double(iter->first - mean)); }
+  return sd;
+}
+
+// The number of values greater than or equal to the given depth.
+unsigned long depthHistogram::countAtLeast(int depth) const {
+  unsigned long count = 0;
+  for (int i = max(depth, 0); i <= maxDense; ++i) { count += dense[i]; }
+
+  map<int, unsigned long>::const_iterator iter    = overflow.lower_bound(depth);
+  map<int, unsigned long>::const_iterator iterEnd = overflow.end();
+  for (; iter != iterEnd; ++iter) { count += iter->second; }
+  return count;
+}
@@ -0,0 +1,73 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Histogram of per-base depth values
+// ***************************************************************************
+
+#ifndef DEPTH_HISTOGRAM_H
+#define DEPTH_HISTOGRAM_H
+
+#include "compactDepth.h"
+#include <map>
+#include <vector>
+
+using namespace std;
+
+// Depths below this value are counted in a dense array. Anything larger (or
+// negative) is counted in a sparse overflow map.
+#define DENSE_DEPTH_LIMIT 65536
+
+class depthHistogram {
+
+  public:
+    depthHistogram(void);
+    ~depthHistogram(void);
+
+  // Public methods.
+  public:
+    void clear();
+    void merge(const depthHistogram&);
+    unsigned long count() const { return total; }
+    double sum() const;
+    int minimum() const;
+    int maximum() const;
+    int valueAt(long) const;
+    double squaredDeviation(double) const;
+    unsigned long countAtLeast(int) const;
+    void add(const compactDepth&, size_t);
+    void add(int, unsigned long);
+    void counts(vector< pair<int, unsigned long> >&) const;
+
+    // Add a single depth value.
+    void add(int depth) {
+      if ((unsigned int)depth < DENSE_DEPTH_LIMIT) {
+        if ((unsigned int)depth >= dense.size()) { grow(depth); }
+        dense[depth]++;
+        if (depth > maxDense) { maxDense = depth; }
+      } else {
+        overflow[depth]++;
+      }
+      total++;
+    }
+
+  private:
+    void grow(int);
+
+  private:
+
+    // Counts for each depth value. The dense array only grows as large as the
+    // largest depth seen, so many histograms can be held at once.
+    vector<unsigned long> dense;
+    map<int, unsigned long> overflow;
+
+    // The largest depth counted in the dense array (-1 if none) and the total
+    // number of values.
+    int maxDense;
+    unsigned long total;
+};
+
+#endif // DEPTH_HISTOGRAM_H
@@ -0,0 +1,303 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Persistent, memory mapped index of per-base depth
+// ***************************************************************************
+
+#include "depthIndex.h"
+#include "regions.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+
+using namespace std;
+
+// The index starts with a magic number and version.
+static const char DEPTH_INDEX_MAGIC[4] = {'G', 'C', 'D', 'I'};
+static const uint32_t DEPTH_INDEX_VERSION = 2;
+
+// The number of runs held in memory before they are written out.
+static const size_t DEPTH_INDEX_RUN_BUFFER = 65536;
+
+// Round an offset up to a multiple of eight bytes, so the records that follow are aligned.
+static inline uint64_t align8(uint64_t offset) {
+  return (offset + 7) & ~uint64_t(7);
+}
+
+// The CRC32 of the header text followed by the name and length of each reference sequence.
+uint32_t headerChecksum(const string& headerText, const RefVector& references) {
+  uLong crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, (const Bytef*)headerText.data(), headerText.size());
+  RefVector::const_iterator iter    = references.begin();
+  RefVector::const_iterator iterEnd = references.end();
+  for (; iter != iterEnd; ++iter) {
+    int32_t length = iter->RefLength;
+    crc = crc32(crc, (const Bytef*)iter->RefName.c_str(), iter->RefName.size() + 1);
+    crc = crc32(crc, (const Bytef*)&length, sizeof(length));
+  }
+  return crc;
+}
+
+// Constructor
+depthIndexWriter::depthIndexWriter(void) {
+  file   = NULL;
+  failed = false;
+}
+
+depthIndexWriter::~depthIndexWriter(void) {
+  if (file != NULL) {
+    fclose(file);
+    remove((filename + ".tmp").c_str());
+  }
+}
+
+// Open the index for writing. The intervals must be sorted by reference and start, and must not
+// overlap. The header, references and space for the intervals are written straight away, and the
+// runs follow as the depth is added.
+bool depthIndexWriter::open(const string& indexFile, const RefVector& references, uint32_t checksum, const vector<depthInterval>& indexIntervals) {
+  filename  = indexFile;
+  intervals = indexIntervals;
+  failed    = false;
+  file      = fopen((filename + ".tmp").c_str(), "wb");
+  if (file == NULL) { return false; }
+
+  uint64_t referencesSize = 0;
+  for (size_t i = 0; i < references.size(); ++i) { referencesSize += 8 + references[i].RefName.size(); }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DEPTH_INDEX_MAGIC, 4);
+  header.version          = DEPTH_INDEX_VERSION;
+  header.checksum         = checksum;
+  header.numberReferences = references.size();
+  header.referencesOffset = sizeof(header);
+  header.intervalsOffset  = align8(header.referencesOffset + referencesSize);
+  header.numberIntervals  = intervals.size();
+  header.runsOffset       = header.intervalsOffset + intervals.size() * sizeof(depthInterval);
+  header.numberRuns       = 0;
+
+  fwrite(&header, sizeof(header), 1, file);
+  for (size_t i = 0; i < references.size(); ++i) {
+    uint32_t nameLength = references[i].RefName.size();
+    int32_t length      = references[i].RefLength;
+    fwrite(&nameLength, sizeof(nameLength), 1, file);
+    fwrite(references[i].RefName.data(), 1, nameLength, file);
+    fwrite(&length, sizeof(length), 1, file);
+  }
+
+  // The intervals are written again once their runs are known.
+  vector<char> padding(header.runsOffset - header.referencesOffset - referencesSize, 0);
+  if (!padding.empty()) { fwrite(&padding[0], 1, padding.size(), file); }
+  if (ferror(file)) { failed = true; }
+
+  startInterval(0);
+  return !failed;
+}
+
+// Start filling an interval, skipping any that are empty.
+void depthIndexWriter::startInterval(size_t interval) {
+  for (current = interval; current < intervals.size(); ++current) {
+    intervals[current].firstRun   = header.numberRuns;
+    intervals[current].numberRuns = 0;
+    position = intervals[current].start;
+    if (position < intervals[current].end) { break; }
+  }
+}
+
+// Add the depth of the next bases in the current interval, moving on to the next interval when
+// it is full. A new run starts whenever the depth changes.
+void depthIndexWriter::add(const vector<int>& depth) {
+  vector<int>::const_iterator iter    = depth.begin();
+  vector<int>::const_iterator iterEnd = depth.end();
+  for (; iter != iterEnd; ++iter) {
+    if (current == intervals.size()) {
+      failed = true;
+      return;
+    }
+    depthInterval& interval = intervals[current];
+    if (interval.numberRuns == 0 || *iter != lastDepth) {
+      depthRun run;
+      run.position = position;
+      run.depth    = *iter;
+      runs.push_back(run);
+      interval.numberRuns++;
+      header.numberRuns++;
+      lastDepth = *iter;
+      if (runs.size() == DEPTH_INDEX_RUN_BUFFER) { flush(); }
+    }
+    if (++position == interval.end) { startInterval(current + 1); }
+  }
+}
+
+// Write out the buffered runs.
+bool depthIndexWriter::flush(void) {
+  if (!runs.empty() && fwrite(&runs[0], sizeof(depthRun), runs.size(), file) != runs.size()) { failed = true; }
+  runs.clear();
+  return !failed;
+}
+
+// Write the header and intervals and move the file into place, so a partially written index is
+// never read. Every interval must have been filled.
+bool depthIndexWriter::close(void) {
+  if (file == NULL) { return false; }
+  flush();
+  if (current != intervals.size()) { failed = true; }
+  if (!failed) {
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) { failed = true; }
+    else if (fseek(file, header.intervalsOffset, SEEK_SET) != 0) { failed = true; }
+    else if (!intervals.empty() && fwrite(&intervals[0], sizeof(depthInterval), intervals.size(), file) != intervals.size()) { failed = true; }
+  }
+  if (fclose(file) != 0) { failed = true; }
+  file = NULL;
+
+  string temporary = filename + ".tmp";
+  if (failed || rename(temporary.c_str(), filename.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Constructor
+depthIndex::depthIndex(void) {
+  data      = NULL;
+  size      = 0;
+  header    = NULL;
+  intervals = NULL;
+  runs      = NULL;
+}
+
+depthIndex::~depthIndex(void) {
+  close();
+}
+
+bool depthIndex::fail(const string& message) {
+  error = message;
+  close();
+  return false;
+}
+
+// Map the index into memory and check that it is complete. Only the reference sequences are
+// copied out; the intervals and runs are read in place.
+bool depthIndex::open(const string& indexFile) {
+  close();
+  int fd = ::open(indexFile.c_str(), O_RDONLY);
+  if (fd < 0) { return fail(indexFile + ": could not open the depth index"); }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(depthIndexHeader)) {
+    ::close(fd);
+    return fail(indexFile + ": not a depth index");
+  }
+  size = status.st_size;
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    size = 0;
+    return fail(indexFile + ": could not map the depth index");
+  }
+  data   = (const char*)mapped;
+  header = (const depthIndexHeader*)data;
+
+  if ( !equal(header->magic, header->magic + 4, DEPTH_INDEX_MAGIC) ) { return fail(indexFile + ": not a depth index"); }
+  if (header->version != DEPTH_INDEX_VERSION) { return fail(indexFile + ": unsupported depth index version"); }
+  if (header->intervalsOffset % 8 != 0 || header->runsOffset % 8 != 0 ||
+      header->intervalsOffset > size || header->numberIntervals > (size - header->intervalsOffset) / sizeof(depthInterval) ||
+      header->runsOffset > size || header->numberRuns > (size - header->runsOffset) / sizeof(depthRun)) {
+    return fail(indexFile + ": truncated depth index");
+  }
+  intervals = (const depthInterval*)(data + header->intervalsOffset);
+  runs      = (const depthRun*)(data + header->runsOffset);
+
+  // Read the reference sequences.
+  uint64_t offset = header->referencesOffset;
+  for (uint32_t i = 0; i < header->numberReferences; ++i) {
+    uint32_t nameLength;
+    int32_t length;
+    if (offset + 4 > header->intervalsOffset) { return fail(indexFile + ": truncated depth index"); }
+    memcpy(&nameLength, data + offset, 4);
+    if (offset + 8 + nameLength > header->intervalsOffset) { return fail(indexFile + ": truncated depth index"); }
+    memcpy(&length, data + offset + 4 + nameLength, 4);
+    referenceData.push_back(RefData(string(data + offset + 4, nameLength), length));
+    offset += 8 + nameLength;
+  }
+
+  // Every interval must hold its runs.
+  for (uint64_t i = 0; i < header->numberIntervals; ++i) {
+    const depthInterval& interval = intervals[i];
+    if (interval.firstRun > header->numberRuns || interval.numberRuns > header->numberRuns - interval.firstRun ||
+        (interval.numberRuns == 0) != (interval.start >= interval.end) ||
+        (interval.numberRuns > 0 && runs[interval.firstRun].position != interval.start)) {
+      return fail(indexFile + ": corrupt depth index");
+    }
+  }
+  return true;
+}
+
+void depthIndex::close(void) {
+  if (data != NULL) { munmap((void*)data, size); }
+  data      = NULL;
+  size      = 0;
+  header    = NULL;
+  intervals = NULL;
+  runs      = NULL;
+  referenceData.clear();
+}
+
+// The fingerprint of the index, from its header and intervals, which record the BAM files it was
+// built from and the number of runs in each interval. The runs themselves are not read.
+unsigned long long depthIndex::fingerprint(void) const {
+  unsigned long long hash = FNV_OFFSET_BASIS;
+  hashBytes(hash, (const char*)header, sizeof(depthIndexHeader));
+  hashBytes(hash, (const char*)intervals, sizeof(depthInterval) * header->numberIntervals);
+  return hash;
+}
+
+// Order intervals by reference and start.
+static bool compareInterval(const depthInterval& a, const depthInterval& b) {
+  return a.refID < b.refID || (a.refID == b.refID && a.start < b.start);
+}
+
+// Order runs by position.
+static bool compareRun(const depthRun& a, const depthRun& b) {
+  return a.position < b.position;
+}
+
+// Get the depth of the bases [start, end) on a reference, and whether any of them lie within the
+// span of an alignment. Returns false if the bases are not all within a single interval of the index.
+bool depthIndex::depth(int refID, int start, int end, vector<int>& values, bool& aligned) const {
+  depthInterval key;
+  key.refID = refID;
+  key.start = start;
+  const depthInterval* intervalsEnd = intervals + header->numberIntervals;
+  const depthInterval* interval     = upper_bound(intervals, intervalsEnd, key, compareInterval);
+  if (interval == intervals) { return false; }
+  --interval;
+  if (interval->refID != refID || start < interval->start || end > interval->end) { return false; }
+
+  values.resize(end > start ? end - start : 0);
+  aligned = false;
+  if (values.empty()) { return true; }
+
+  // Find the run holding the first base, then fill in the runs up to the end.
+  depthRun runKey;
+  runKey.position = start;
+  const depthRun* runsBegin = runs + interval->firstRun;
+  const depthRun* runsEnd   = runsBegin + interval->numberRuns;
+  const depthRun* run       = upper_bound(runsBegin, runsEnd, runKey, compareRun) - 1;
+  int position = start;
+  for (; position < end; ++run) {
+    int runEnd = (run + 1 < runsEnd) ? run[1].position : interval->end;
+    if (runEnd > end) { runEnd = end; }
+    if (run->depth != 0) { aligned = true; }
+    fill(values.begin() + (position - start), values.begin() + (runEnd - start), (run->depth == DEPTH_SPANNED) ? 0 : run->depth);
+    position = runEnd;
+  }
+  return true;
+}
@@ -0,0 +1,133 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Persistent, memory mapped index of per-base depth
+// ***************************************************************************
+
+#ifndef DEPTH_INDEX_H
+#define DEPTH_INDEX_H
+
+#include "api/BamAux.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// The depth index holds the per-base depth of a set of intervals as runs of
+// equal depth. All values are stored in native byte order, so the file can be
+// memory mapped and read in place. The file is laid out as:
+//   header      depthIndexHeader
+//   references  the name length, name and length of each reference sequence
+//   intervals   depthInterval records, sorted by reference and start
+//   runs        depthRun records
+// The runs of each interval are contiguous, and the first run starts at the
+// start of the interval. Each run extends to the next run or the end of the
+// interval. Bases with no depth that lie within the span of an alignment, such
+// as the bases skipped by a spliced read, have the depth DEPTH_SPANNED, so that
+// a region they cover is not mistaken for one with no alignments.
+struct depthIndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t checksum;
+  uint32_t numberReferences;
+  uint64_t referencesOffset;
+  uint64_t intervalsOffset;
+  uint64_t numberIntervals;
+  uint64_t runsOffset;
+  uint64_t numberRuns;
+};
+
+// An interval of reference positions, [start, end), held in the index.
+struct depthInterval {
+  int32_t refID;
+  int32_t start;
+  int32_t end;
+  int32_t reserved;
+  uint64_t firstRun;
+  uint64_t numberRuns;
+};
+
+// A run of bases with the same depth, starting at position.
+#define DEPTH_SPANNED -1
+struct depthRun {
+  int32_t position;
+  int32_t depth;
+};
+
+// The checksum of a BAM header and reference sequences. An index is only used
+// with BAM files that have the same checksum as the files it was built from.
+uint32_t headerChecksum(const string&, const RefVector&);
+
+// Write a depth index. The depth of each interval is added in position order,
+// in as many pieces as needed, and the intervals are filled in turn. The index
+// is written to a temporary file and moved into place when it is closed.
+class depthIndexWriter {
+
+  public:
+    depthIndexWriter(void);
+    ~depthIndexWriter(void);
+
+  // Public methods.
+  public:
+    bool open(const string&, const RefVector&, uint32_t, const vector<depthInterval>&);
+    void add(const vector<int>&);
+    bool close(void);
+
+  private:
+    void startInterval(size_t);
+    bool flush(void);
+
+  private:
+    FILE* file;
+    string filename;
+    depthIndexHeader header;
+    vector<depthInterval> intervals;
+
+    // The interval being filled and the position of the next base in it.
+    size_t current;
+    int position;
+    int lastDepth;
+
+    // Runs waiting to be written.
+    vector<depthRun> runs;
+    bool failed;
+};
+
+// Read a depth index through a memory map.
+class depthIndex {
+
+  public:
+    depthIndex(void);
+    ~depthIndex(void);
+
+  // Public methods.
+  public:
+    bool open(const string&);
+    void close(void);
+    bool depth(int, int, int, vector<int>&, bool&) const;
+    const RefVector& references(void) const { return referenceData; }
+    uint32_t checksum(void) const { return header->checksum; }
+    unsigned long long fingerprint(void) const;
+    string errorString(void) const { return error; }
+
+  private:
+    bool fail(const string&);
+
+  private:
+    const char* data;
+    size_t size;
+    const depthIndexHeader* header;
+    const depthInterval* intervals;
+    const depthRun* runs;
+    RefVector referenceData;
+    string error;
+};
+
+#endif // DEPTH_INDEX_H
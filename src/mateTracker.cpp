@@ -0,0 +1,124 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Count the bases covered by overlapping mates once per fragment
+// ***************************************************************************
+
+#include "mateTracker.h"
+#include <algorithm>
+
+using namespace std;
+
+// Constructor
+mateTracker::mateTracker(void) {
+  capacity         = 0;
+  added            = 0;
+  overlappingPairs = 0;
+  overlappingBases = 0;
+  evicted          = 0;
+  expired          = 0;
+}
+
+mateTracker::~mateTracker(void) {
+}
+
+// Set the maximum number of mates that can be held. A capacity of zero disables the tracker.
+void mateTracker::setCapacity(size_t size) {
+  capacity = size;
+}
+
+// Forget all held mates, e.g. when moving to a new region or reference.
+void mateTracker::clear(void) {
+  pending.clear();
+  arrival.clear();
+}
+
+// Add the counters from another tracker, e.g. one used by a different thread.
+void mateTracker::merge(const mateTracker& other) {
+  overlappingPairs += other.overlappingPairs;
+  overlappingBases += other.overlappingBases;
+  evicted          += other.evicted;
+  expired          += other.expired;
+}
+
+void mateTracker::report(ostream& out) const {
+  out << "overlapping mate pairs:\t" << overlappingPairs << endl;
+  out << "overlapping bases counted once:\t" << overlappingBases << endl;
+  out << "held mates evicted:\t" << evicted << endl;
+  out << "held mates expired:\t" << expired << endl;
+}
+
+// Remove the entry at the front of the arrival queue, if it is still held.
+void mateTracker::release(void) {
+  unordered_map<string, pendingMate>::iterator held = pending.find(arrival.front().first);
+  if (held != pending.end() && held->second.order == arrival.front().second) { pending.erase(held); }
+  arrival.pop_front();
+}
+
+// Process the blocks covered by an alignment. If this is the second mate of a held pair, the
+// blocks covered by the first mate are removed. If it is the first mate of a pair that may
+// overlap, its blocks are held.
+void mateTracker::removeOverlap(const BamAlignment& al, vector<coveredBlock>& blocks) {
+
+  // Release held mates whose mate should already have been seen.
+  while (!arrival.empty()) {
+    unordered_map<string, pendingMate>::iterator held = pending.find(arrival.front().first);
+    if (held == pending.end() || held->second.order != arrival.front().second) { arrival.pop_front(); }
+    else if (held->second.matePosition < al.Position) {
+      expired++;
+      release();
+    }
+    else { break; }
+  }
+  if ( !needsName(al) ) { return; }
+
+  // The second mate: subtract the blocks of the first mate. Both sets of blocks are in position order.
+  unordered_map<string, pendingMate>::iterator held = pending.find(al.Name);
+  if (held != pending.end()) {
+    const vector<coveredBlock>& first = held->second.blocks;
+    remaining.clear();
+    size_t j = 0;
+    unsigned long removed = 0;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      int begin = blocks[i].first;
+      int end   = blocks[i].second;
+      while (j < first.size() && first[j].second <= begin) { ++j; }
+      for (size_t k = j; k < first.size() && first[k].first < end && begin < end; ++k) {
+        if (first[k].first > begin) { remaining.push_back(coveredBlock(begin, first[k].first)); }
+        int overlapEnd = min(end, first[k].second);
+        removed += overlapEnd - max(begin, first[k].first);
+        begin = max(begin, overlapEnd);
+      }
+      if (begin < end) { remaining.push_back(coveredBlock(begin, end)); }
+    }
+    if (removed > 0) {
+      overlappingPairs++;
+      overlappingBases += removed;
+    }
+    blocks.swap(remaining);
+    pending.erase(held);
+    return;
+  }
+
+  // The first mate: hold its blocks if the mate starts at or after it. Make room by evicting the
+  // oldest held mates if necessary.
+  if (al.MatePosition < al.Position) { return; }
+  while (pending.size() >= capacity && !arrival.empty()) {
+    unordered_map<string, pendingMate>::iterator oldest = pending.find(arrival.front().first);
+    if (oldest != pending.end() && oldest->second.order == arrival.front().second) { evicted++; }
+    release();
+  }
+  pendingMate& mate = pending[al.Name];
+  int end           = al.GetEndPosition();
+  mate.blocks.clear();
+  for (size_t i = 0; i < blocks.size() && blocks[i].first < end; ++i) {
+    mate.blocks.push_back(coveredBlock(blocks[i].first, min(blocks[i].second, end)));
+  }
+  mate.matePosition = al.MatePosition;
+  mate.order        = ++added;
+  arrival.push_back(make_pair(al.Name, added));
+}
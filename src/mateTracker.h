@@ -0,0 +1,83 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Count the bases covered by overlapping mates once per fragment
+// ***************************************************************************
+
+#ifndef MATE_TRACKER_H
+#define MATE_TRACKER_H
+
+#include "api/BamAlignment.h"
+#include "depthAccumulator.h"
+#include <deque>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// Remove the bases covered by both mates of a fragment from the second mate.
+// Alignments arrive in position order, so when the first mate of a pair is
+// seen and its mate starts before it ends, the blocks it covers are held until
+// the second mate arrives. The held mates are keyed by read name and limited
+// in number: once the limit is reached, the oldest are evicted (and their
+// fragments counted twice). A held mate whose mate should already have been
+// seen (e.g. because it was filtered out) expires. Only the blocks within the
+// aligned span of the first mate are held; clipped bases advance the position
+// when counting, which can push blocks past the end of the alignment, but the
+// first mate is only read for regions overlapping its aligned span.
+class mateTracker {
+
+  public:
+    mateTracker(void);
+    ~mateTracker(void);
+
+  // Public methods.
+  public:
+    void setCapacity(size_t);
+    bool enabled(void) const { return capacity > 0; }
+    size_t window(void) const { return capacity; }
+    void clear(void);
+    void merge(const mateTracker&);
+    void report(ostream&) const;
+    void removeOverlap(const BamAlignment&, vector<coveredBlock>&);
+
+    // Whether the alignment could overlap its mate, in which case its name is needed.
+    bool needsName(const BamAlignment& al) const {
+      return (al.AlignmentFlag & 0x90D) == 0x1 && al.MateRefID == al.RefID && al.MatePosition < al.GetEndPosition();
+    }
+
+  // Counters.
+  public:
+    unsigned long overlappingPairs;
+    unsigned long overlappingBases;
+    unsigned long evicted;
+    unsigned long expired;
+
+  private:
+    void release(void);
+
+    // A first mate waiting for its mate, and the position at which the mate starts.
+    struct pendingMate {
+      vector<coveredBlock> blocks;
+      int matePosition;
+      unsigned long order;
+    };
+
+    size_t capacity;
+    unordered_map<string, pendingMate> pending;
+
+    // The names of the held mates in the order they were added. Entries for mates that
+    // have been matched are skipped when they reach the front.
+    deque<pair<string, unsigned long> > arrival;
+    unsigned long added;
+    vector<coveredBlock> remaining;
+};
+
+#endif // MATE_TRACKER_H
@@ -0,0 +1,201 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Buffered output of the coverage tables, optionally BGZF compressed
+// ***************************************************************************
+
+#include "outputWriter.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace std;
+
+// Constructor
+outputWriter::outputWriter(void) {
+  fd       = -1;
+  ownsFile = false;
+  compress = false;
+  failed   = false;
+  used     = 0;
+  buffer.resize(4096);
+}
+
+outputWriter::~outputWriter(void) {
+  close();
+}
+
+// Open the output file, or stdout if no file name is given.
+bool outputWriter::open(const string& filename) {
+  close();
+  if (filename == "") {
+    fd       = STDOUT_FILENO;
+    ownsFile = false;
+  } else {
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) { return false; }
+    ownsFile = true;
+  }
+  buffer.resize(OUTPUT_BUFFER_SIZE);
+  used   = 0;
+  failed = false;
+
+  // Compress the output if a gzipped file was requested. Each block is a raw deflate stream.
+  compress = filename.size() > 3 && filename.compare(filename.size() - 3, 3, ".gz") == 0;
+  if (compress) {
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) { return false; }
+    block.resize(65536);
+  }
+  return true;
+}
+
+// Write out anything left in the buffer and close the file. Compressed output ends with an
+// empty block to mark the end of the file. Returns false if any of the output could not be written,
+// with the reason in errorString.
+bool outputWriter::close(void) {
+  if (fd < 0) { return !failed; }
+  flush();
+  if (compress) {
+    if (!failed) { writeBlock(NULL, 0); }
+    deflateEnd(&stream);
+    compress = false;
+  }
+  if (ownsFile && ::close(fd) != 0 && !failed) { fail(strerror(errno)); }
+  fd = -1;
+  return !failed;
+}
+
+// Move the contents of an in-memory writer into a string, leaving the writer empty.
+void outputWriter::takeBuffer(string& output) {
+  output.assign(buffer.begin(), buffer.begin() + used);
+  used = 0;
+}
+
+// Add text to the buffer, writing out the buffer when it is full. An in-memory writer grows
+// its buffer instead.
+void outputWriter::write(const char* text, size_t length) {
+  if (used + length > buffer.size()) {
+    if (fd < 0) { buffer.resize(max(buffer.size() * 2, used + length)); }
+    else {
+      flush();
+      if (length > buffer.size()) { buffer.resize(length); }
+    }
+  }
+  memcpy(&buffer[used], text, length);
+  used += length;
+}
+
+outputWriter& outputWriter::operator<<(char c) {
+  if (used == buffer.size()) {
+    if (fd < 0) { buffer.resize(buffer.size() * 2); }
+    else { flush(); }
+  }
+  buffer[used++] = c;
+  return *this;
+}
+
+// Write a double in the default ostream format (%g with six significant figures). Whole
+// numbers, such as depths and most medians and quartiles, do not need printf.
+outputWriter& outputWriter::operator<<(double value) {
+  if (value == floor(value) && fabs(value) < 1e6 && !(value == 0 && signbit(value))) {
+    writeInteger((long)value);
+  } else {
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%g", value);
+    write(text, length);
+  }
+  return *this;
+}
+
+// Write an integer without going through printf.
+void outputWriter::writeInteger(long value) {
+  char text[24];
+  char* end = text + sizeof(text);
+  char* start = end;
+  unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+  do {
+    *--start = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0) { *--start = '-'; }
+  write(start, end - start);
+}
+
+// Write the buffer to the file, compressing it into BGZF blocks if required. A failure is recorded
+// by writeFile or writeBlock.
+void outputWriter::flush(void) {
+  if (fd < 0 || used == 0) { return; }
+  if (failed) {
+    used = 0;
+    return;
+  }
+  if (compress) {
+    for (size_t offset = 0; !failed && offset < used; offset += BGZF_BLOCK_DATA) {
+      writeBlock(&buffer[offset], min((size_t)BGZF_BLOCK_DATA, used - offset));
+    }
+  } else {
+    writeFile(&buffer[0], used);
+  }
+  used = 0;
+}
+
+// Record a failed write, with the reason. Once a write has failed, the rest of the output is
+// discarded.
+void outputWriter::fail(const string& message) {
+  failed = true;
+  error  = message;
+}
+
+// Write data to the file, retrying partial writes. Returns false, recording the failure, if the
+// data could not be written.
+bool outputWriter::writeFile(const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t written = ::write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) { continue; }
+      fail(strerror(errno));
+      return false;
+    }
+    data   += written;
+    length -= written;
+  }
+  return true;
+}
+
+// Compress data into a single BGZF block: a gzip header with the BC extra field holding the
+// block size, the raw deflate stream, and the CRC and length of the uncompressed data. Returns
+// false, recording the failure, if the data could not be compressed or written.
+bool outputWriter::writeBlock(const char* data, size_t length) {
+  static const unsigned char header[18] = { 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 0, 0 };
+  memcpy(&block[0], header, 18);
+
+  deflateReset(&stream);
+  stream.next_in   = (Bytef*)data;
+  stream.avail_in  = length;
+  stream.next_out  = (Bytef*)&block[18];
+  stream.avail_out = block.size() - 26;
+  if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+    fail(string("compression failed") + ((stream.msg != NULL) ? string(": ") + stream.msg : ""));
+    return false;
+  }
+  size_t blockSize = 18 + stream.total_out + 8;
+
+  unsigned long crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef*)data, length);
+  unsigned char* footer = (unsigned char*)&block[blockSize - 8];
+  for (int i = 0; i < 4; ++i) {
+    footer[i]     = (crc >> (8 * i)) & 0xff;
+    footer[i + 4] = (length >> (8 * i)) & 0xff;
+  }
+  block[16] = (blockSize - 1) & 0xff;
+  block[17] = ((blockSize - 1) >> 8) & 0xff;
+  return writeFile(&block[0], blockSize);
+}
@@ -0,0 +1,77 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Buffered output of the coverage tables, optionally BGZF compressed
+// ***************************************************************************
+
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
+
+// The size of the output buffer, and the amount of uncompressed data in each
+// BGZF block.
+#define OUTPUT_BUFFER_SIZE 1048576
+#define BGZF_BLOCK_DATA 65280
+
+// Write text to a file or stdout through a large buffer that is only written out
+// when it is full or the writer is closed. Numbers are formatted exactly as an
+// ostream with default settings would format them. If the file name ends in
+// ".gz", the output is compressed as BGZF, which can be read by gzip or indexed
+// with tabix. A writer that has not been opened keeps all of its output in
+// memory, so the output for a gene can be built on a worker thread. If a write
+// fails, the rest of the output is discarded and close returns false.
+class outputWriter {
+
+  public:
+    outputWriter(void);
+    ~outputWriter(void);
+
+  // Public methods.
+  public:
+    bool open(const string&);
+    bool close(void);
+    const string& errorString(void) const { return error; }
+    void takeBuffer(string&);
+    void write(const char*, size_t);
+
+    outputWriter& operator<<(const string& text) { write(text.data(), text.size()); return *this; }
+    outputWriter& operator<<(const char* text) { write(text, strlen(text)); return *this; }
+    outputWriter& operator<<(char);
+    outputWriter& operator<<(int value) { writeInteger(value); return *this; }
+    outputWriter& operator<<(unsigned int value) { writeInteger(value); return *this; }
+    outputWriter& operator<<(long value) { writeInteger(value); return *this; }
+    outputWriter& operator<<(double);
+
+  private:
+    void writeInteger(long);
+    void flush(void);
+    void fail(const string&);
+    bool writeFile(const char*, size_t);
+    bool writeBlock(const char*, size_t);
+
+    int fd;
+    bool ownsFile;
+    bool compress;
+    vector<char> buffer;
+    size_t used;
+
+    // Set once a write has failed.
+    bool failed;
+    string error;
+
+    // Compression state, reused for every BGZF block.
+    z_stream stream;
+    vector<char> block;
+};
+
+#endif // OUTPUT_WRITER_H
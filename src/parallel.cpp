@@ -0,0 +1,157 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Scheduling of genes across worker threads and ordering of their output
+// ***************************************************************************
+
+#include "parallel.h"
+
+using namespace std;
+
+// Constructor. Split the items evenly between the workers.
+workStealingScheduler::workStealingScheduler(long numberItems, int numberWorkers) {
+  for (int i = 0; i < numberWorkers; ++i) {
+    workRange* range = new workRange;
+    range->next = numberItems * i / numberWorkers;
+    range->end  = numberItems * (i + 1) / numberWorkers;
+    ranges.push_back(range);
+  }
+}
+
+workStealingScheduler::~workStealingScheduler(void) {
+  for (size_t i = 0; i < ranges.size(); ++i) { delete ranges[i]; }
+}
+
+// Get the next item for a worker. Returns false once there is no work left anywhere.
+bool workStealingScheduler::next(int worker, long& item) {
+  workRange* range = ranges[worker];
+  while (true) {
+    {
+      lock_guard<mutex> guard(range->lock);
+      if (range->next < range->end) {
+        item = range->next++;
+        return true;
+      }
+    }
+    if (!steal(worker)) { return false; }
+  }
+}
+
+// Stop handing out items, leaving any that remain unprocessed. Items already handed out are
+// finished by their workers.
+void workStealingScheduler::stop(void) {
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    lock_guard<mutex> guard(ranges[i]->lock);
+    ranges[i]->next = ranges[i]->end;
+  }
+}
+
+// Move the back half of the largest remaining range to the given worker.
+bool workStealingScheduler::steal(int worker) {
+  while (true) {
+
+    // Find the victim with the most remaining work. The sizes are only a hint,
+    // so are checked again once the victim is locked.
+    int victim    = -1;
+    long largest  = 0;
+    for (int i = 0; i < (int)ranges.size(); ++i) {
+      if (i == worker) { continue; }
+      lock_guard<mutex> guard(ranges[i]->lock);
+      long remaining = ranges[i]->end - ranges[i]->next;
+      if (remaining > largest) {
+        largest = remaining;
+        victim  = i;
+      }
+    }
+    if (victim == -1) { return false; }
+
+    // Take the back half (at least one item) of the victim's range.
+    long begin, end;
+    {
+      lock_guard<mutex> guard(ranges[victim]->lock);
+      long remaining = ranges[victim]->end - ranges[victim]->next;
+      if (remaining <= 0) { continue; }
+      end   = ranges[victim]->end;
+      begin = end - (remaining + 1) / 2;
+      ranges[victim]->end = begin;
+    }
+
+    lock_guard<mutex> guard(ranges[worker]->lock);
+    ranges[worker]->next = begin;
+    ranges[worker]->end  = end;
+    return true;
+  }
+}
+
+// Constructor
+orderedOutput::orderedOutput(long numberItems) {
+  results.resize(numberItems);
+  complete.resize(numberItems, false);
+  nextToWrite = 0;
+  aborted     = false;
+}
+
+orderedOutput::~orderedOutput(void) {
+}
+
+// Store the output for an item.
+void orderedOutput::store(long item, const string& output) {
+  lock_guard<mutex> guard(lock);
+  results[item]  = output;
+  complete[item] = true;
+  if (item == nextToWrite) { ready.notify_one(); }
+}
+
+// Take the output for the next item, in order, waiting until it is available. Returns false once
+// the output for every item has been taken, or the output has been aborted.
+bool orderedOutput::next(string& output) {
+  unique_lock<mutex> guard(lock);
+  if (nextToWrite == (long)results.size()) { return false; }
+  ready.wait(guard, [this] { return aborted || complete[nextToWrite]; });
+  if (aborted) { return false; }
+  output.clear();
+  output.swap(results[nextToWrite]);
+  nextToWrite++;
+  return true;
+}
+
+// Write the output for every item, in order, as it becomes available. Output is
+// released from memory once it has been written.
+void orderedOutput::write(outputWriter& out) {
+  string output;
+  while (next(output)) { out << output; }
+}
+
+// Stop releasing output, waking the thread waiting for the next item.
+void orderedOutput::abort(void) {
+  lock_guard<mutex> guard(lock);
+  aborted = true;
+  ready.notify_all();
+}
+
+// Constructor
+workerError::workerError(void) {
+}
+
+workerError::~workerError(void) {
+}
+
+// Record an error, unless one has already been recorded.
+void workerError::record(const string& message) {
+  lock_guard<mutex> guard(lock);
+  if (error.empty()) { error = message; }
+}
+
+bool workerError::failed(void) {
+  lock_guard<mutex> guard(lock);
+  return !error.empty();
+}
+
+string workerError::errorString(void) {
+  lock_guard<mutex> guard(lock);
+  return error;
+}
@@ -0,0 +1,93 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Scheduling of genes across worker threads and ordering of their output
+// ***************************************************************************
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "outputWriter.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Hand out item indexes to a set of workers. Each worker starts with a
+// contiguous range of items, so neighbouring genes are processed by the same
+// reader. A worker that runs out of items steals the back half of the largest
+// remaining range. Once stopped, no more items are handed out.
+class workStealingScheduler {
+
+  public:
+    workStealingScheduler(long, int);
+    ~workStealingScheduler(void);
+
+  // Public methods.
+  public:
+    bool next(int, long&);
+    void stop(void);
+
+  private:
+    bool steal(int);
+
+    // The items still to be processed by each worker are [next, end).
+    struct workRange {
+      mutex lock;
+      long next;
+      long end;
+    };
+    vector<workRange*> ranges;
+};
+
+// Collect the output for each item from the workers and release it in the
+// original item order. If a worker fails, the output is aborted so that the
+// thread releasing it stops waiting for items that will never be stored.
+class orderedOutput {
+
+  public:
+    orderedOutput(long);
+    ~orderedOutput(void);
+
+  // Public methods.
+  public:
+    void store(long, const string&);
+    bool next(string&);
+    void write(outputWriter&);
+    void abort(void);
+
+  private:
+    mutex lock;
+    condition_variable ready;
+    vector<string> results;
+    vector<bool> complete;
+    long nextToWrite;
+    bool aborted;
+};
+
+// Keep the first error reported by any of a set of workers, so that it can be
+// reported once they have all finished.
+class workerError {
+
+  public:
+    workerError(void);
+    ~workerError(void);
+
+  // Public methods.
+  public:
+    void record(const string&);
+    bool failed(void);
+    string errorString(void);
+
+  private:
+    mutex lock;
+    string error;
+};
+
+#endif // PARALLEL_H
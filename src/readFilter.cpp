@@ -0,0 +1,63 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Filter alignments on their flags, mapping quality and base qualities
+// ***************************************************************************
+
+#include "readFilter.h"
+
+using namespace std;
+
+// Constructor
+readFilter::readFilter(void) {
+  minMappingQuality    = 0;
+  requiredFlags        = 0;
+  excludedFlags        = 0;
+  minBaseQuality       = 0;
+  examined             = 0;
+  failedExcludedFlags  = 0;
+  failedRequiredFlags  = 0;
+  failedMappingQuality = 0;
+  maskedBases          = 0;
+}
+
+readFilter::~readFilter(void) {
+}
+
+// Whether any of the filters can reject an alignment or base.
+bool readFilter::active(void) const {
+  return minMappingQuality > 0 || requiredFlags != 0 || excludedFlags != 0 || minBaseQuality > 0 || mates.enabled();
+}
+
+// The blocks of reference positions covered by an alignment that passed the filter, without the
+// bases below the minimum base quality or already counted for the other mate.
+const vector<coveredBlock>& readFilter::coveredBlocks(const BamAlignment& al) {
+  alignmentBlocks(al, minBaseQuality, maskedBases, blocks);
+  if (mates.enabled()) { mates.removeOverlap(al, blocks); }
+  return blocks;
+}
+
+// Add the counters from another filter, e.g. one used by a different thread.
+void readFilter::merge(const readFilter& other) {
+  examined             += other.examined;
+  failedExcludedFlags  += other.failedExcludedFlags;
+  failedRequiredFlags  += other.failedRequiredFlags;
+  failedMappingQuality += other.failedMappingQuality;
+  maskedBases          += other.maskedBases;
+  mates.merge(other.mates);
+}
+
+// Write the number of alignments rejected by each filter. An alignment is only counted against
+// the first filter it fails, in the order listed.
+void readFilter::report(ostream& out) const {
+  out << "alignments examined:\t" << examined << endl;
+  out << "rejected by excluded flags:\t" << failedExcludedFlags << endl;
+  out << "rejected by required flags:\t" << failedRequiredFlags << endl;
+  out << "rejected by mapping quality:\t" << failedMappingQuality << endl;
+  out << "bases below base quality:\t" << maskedBases << endl;
+  if (mates.enabled()) { mates.report(out); }
+}
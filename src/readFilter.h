@@ -0,0 +1,86 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Filter alignments on their flags, mapping quality and base qualities
+// ***************************************************************************
+
+#ifndef READ_FILTER_H
+#define READ_FILTER_H
+
+#include "api/BamAlignment.h"
+#include "depthAccumulator.h"
+#include "mateTracker.h"
+#include <ostream>
+
+using namespace std;
+using namespace BamTools;
+
+// Decide which alignments contribute to the coverage. The flag and mapping
+// quality tests only need the fixed fields of the alignment record, so they
+// are made before the record is fully decoded. Bases below the minimum base
+// quality are removed when the alignment is added to the depth, as are bases
+// already counted for the other mate of the fragment if mates are tracked. Each
+// filter counts the alignments (or bases) it rejected. By default, every
+// alignment passes.
+class readFilter {
+
+  public:
+    readFilter(void);
+    ~readFilter(void);
+
+  // Public methods.
+  public:
+    bool active(void) const;
+    void merge(const readFilter&);
+    void report(ostream&) const;
+
+    // Test the flag and mapping quality of an alignment.
+    bool pass(unsigned int flag, unsigned int mappingQuality) {
+      examined++;
+      if (flag & excludedFlags) {
+        failedExcludedFlags++;
+        return false;
+      }
+      if ((flag & requiredFlags) != requiredFlags) {
+        failedRequiredFlags++;
+        return false;
+      }
+      if ((int)mappingQuality < minMappingQuality) {
+        failedMappingQuality++;
+        return false;
+      }
+      return true;
+    }
+    bool pass(const BamAlignment& al) { return pass(al.AlignmentFlag, al.MapQuality); }
+
+    // Whether the alignment must be added as blocks, rather than straight from the CIGAR, and
+    // whether the read name and qualities must be decoded.
+    bool needsBlocks(void) const { return minBaseQuality > 0 || mates.enabled(); }
+    bool needsCharData(const BamAlignment& al) const { return minBaseQuality > 0 || (mates.enabled() && mates.needsName(al)); }
+    const vector<coveredBlock>& coveredBlocks(const BamAlignment&);
+
+  // Settings.
+  public:
+    int minMappingQuality;
+    unsigned int requiredFlags;
+    unsigned int excludedFlags;
+    int minBaseQuality;
+    mateTracker mates;
+
+  // Counters.
+  public:
+    unsigned long examined;
+    unsigned long failedExcludedFlags;
+    unsigned long failedRequiredFlags;
+    unsigned long failedMappingQuality;
+    unsigned long maskedBases;
+
+  private:
+    vector<coveredBlock> blocks;
+};
+
+#endif // READ_FILTER_H
@@ -0,0 +1,463 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Calculate the coverage of regions from the alignments in BAM files
+// ***************************************************************************
+
+#include "regionCoverage.h"
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+// Get the next alignment that passes the filter. The flags and mapping quality are tested on the
+// core alignment data, and the base qualities are only decoded if they are needed.
+bool nextAlignment(alignmentReader& reader, BamAlignment& al, readFilter& filter) {
+  while ( reader.GetNextAlignmentCore(al) ) {
+    if ( !filter.pass(al) ) { continue; }
+    if (filter.needsCharData(al)) { al.BuildCharData(); }
+    return true;
+  }
+  return false;
+}
+
+// Add an alignment to the depth, leaving out bases with low base quality or covered by the other
+// mate if required.
+static inline void addFiltered(depthAccumulator& accumulator, const BamAlignment& al, readFilter& filter) {
+  if (filter.needsBlocks()) { accumulator.addBlocks(filter.coveredBlocks(al)); }
+  else { accumulator.addAlignment(al); }
+}
+
+// Calculate the coverage of a single region. The start is set to the offset of the region in the
+// coverage, or -1 if there were no alignments. Returns false if the alignments could not be read.
+bool calculateRegionCoverage(alignmentReader& reader, const BamRegion& region, BamAlignment& al, depthAccumulator& accumulator, compactDepth& coverage, readFilter& filter, coverageData& cov, int feature, int& start) {
+
+  // Attempt to set region on reader.
+  if ( !reader.SetRegion(region.LeftRefID, region.LeftPosition, region.RightRefID, region.RightPosition) ) { return false; }
+  filter.mates.clear();
+
+  // Get the first alignment to set the start coordinate of the first base in the first read. Only the
+  // core alignment data (position and CIGAR) is decoded; the read name, bases, qualities and tags are
+  // never needed for coverage. The alignment is reused, so decoding does not allocate once its buffers
+  // have grown to the size of the largest read. If there are no alignments, the feature has no coverage.
+  if ( !nextAlignment(reader, al, filter) ) {
+    start = -1;
+    if (reader.HasFailed()) { return false; }
+    cov.noCoverage(feature);
+    return true;
+  }
+
+  // Initialise variables.
+  int coverageStart;
+  if (al.Position < region.LeftPosition) {coverageStart = al.Position;}
+  else {coverageStart = region.LeftPosition;}
+  accumulator.reset(coverageStart, region.RightPosition - coverageStart);
+
+  // Process the first read.
+  addFiltered(accumulator, al, filter);
+
+  // Loop over the remaining reads spanning the region.
+  while ( nextAlignment(reader, al, filter) ) { addFiltered(accumulator, al, filter); }
+  if (reader.HasFailed()) { return false; }
+
+  // Convert the accumulated events into per-base depth.
+  accumulator.resolve(coverage);
+
+  // Process the coverage data for the feature.
+  start = region.LeftPosition - coverageStart;
+  projectCoverage(coverage, start, cov, feature);
+  return true;
+}
+
+// Calculate the statistics for a feature from the coverage of its span, where start is the offset
+// of the region in the coverage, or -1 if the span has no alignments.
+void projectCoverage(const compactDepth& coverage, int start, coverageData& cov, int feature) {
+  if (start < 0) { cov.noCoverage(feature); }
+
+  // Only process regions with more than a single base.
+  else if (coverage.size() - start > 0) {
+    cov.processFeature(coverage, start, feature);
+  }
+}
+
+// The name of a region, as a region string, for errors.
+static string regionName(const alignmentReader& reader, const BamRegion& region) {
+  RefVector references = reader.GetReferenceData();
+  string left  = (region.LeftRefID >= 0 && region.LeftRefID < (int)references.size()) ? references[region.LeftRefID].RefName : to_string(region.LeftRefID);
+  string right = (region.RightRefID >= 0 && region.RightRefID < (int)references.size()) ? references[region.RightRefID].RefName : to_string(region.RightRefID);
+  if (region.LeftRefID == region.RightRefID) { return left + ":" + to_string(region.LeftPosition) + "-" + to_string(region.RightPosition); }
+  return left + ":" + to_string(region.LeftPosition) + ".." + right + ":" + to_string(region.RightPosition);
+}
+
+// The error for a region whose alignments could not be read: the file that could not be decoded, or
+// otherwise the region, which could not be set on the reader.
+string regionError(const alignmentReader& reader, const string& region) {
+  if (reader.HasFailed()) { return reader.GetErrorString(); }
+  return "could not read the alignments in " + region + ". Check that the region is a valid range and the files are indexed";
+}
+
+// One alignment in every TIMING_SAMPLE_INTERVAL is timed when a region is instrumented.
+#define TIMING_SAMPLE_INTERVAL 64
+
+// Calculate the coverage of a single region, timing each stage. This must give the same result as
+// the uninstrumented version above, and reads the alignments in the same way, decoding each one and
+// adding it before the next is decoded. Reading the clock around every alignment would cost more
+// than adding it, so the decoding and accumulation are timed together and the time is divided
+// between them in the proportion measured on a sample of the alignments.
+bool calculateRegionCoverage(alignmentReader& reader, const BamRegion& region, BamAlignment& al, depthAccumulator& accumulator, compactDepth& coverage, readFilter& filter, coverageData& cov, int feature, int& start, runStatistics& stats) {
+  stats.start();
+  if ( !reader.SetRegion(region.LeftRefID, region.LeftPosition, region.RightRefID, region.RightPosition) ) {
+    stats.stop(STAGE_SEEK);
+    return false;
+  }
+  filter.mates.clear();
+  stats.stop(STAGE_SEEK);
+  stats.addSeek();
+
+  // The first alignment sets the start coordinate of the coverage.
+  stats.start();
+  int coverageStart = region.LeftPosition;
+  unsigned long numberAlignments = 0;
+  double decodeTime = 0, accumulateTime = 0;
+  bool sampled = true;
+  double mark = runStatistics::wallTime();
+  while ( nextAlignment(reader, al, filter) ) {
+    if (sampled) {
+      double decoded = runStatistics::wallTime();
+      decodeTime += decoded - mark;
+      mark = decoded;
+    }
+    if (numberAlignments == 0) {
+      coverageStart = min(al.Position, region.LeftPosition);
+      accumulator.reset(coverageStart, region.RightPosition - coverageStart);
+    }
+    addFiltered(accumulator, al, filter);
+    if (sampled) { accumulateTime += runStatistics::wallTime() - mark; }
+    numberAlignments++;
+    sampled = (numberAlignments % TIMING_SAMPLE_INTERVAL == 0);
+    if (sampled) { mark = runStatistics::wallTime(); }
+  }
+  if (sampled) { decodeTime += runStatistics::wallTime() - mark; }
+  stats.stop(STAGE_DECODE, STAGE_ACCUMULATE, (decodeTime + accumulateTime > 0) ? decodeTime / (decodeTime + accumulateTime) : 1);
+  if (reader.HasFailed()) { return false; }
+  stats.addReads(numberAlignments);
+  stats.addRegion(numberAlignments);
+
+  if (numberAlignments == 0) {
+    stats.start();
+    cov.noCoverage(feature);
+    stats.stop(STAGE_STATISTICS);
+    start = -1;
+    return true;
+  }
+
+  // Convert the accumulated events into per-base depth.
+  stats.start();
+  accumulator.resolve(coverage);
+  unsigned long bases = 0;
+  for (size_t i = 0; i < coverage.size(); ++i) { bases += coverage[i]; }
+  stats.addBases(bases);
+  stats.stop(STAGE_ACCUMULATE);
+
+  stats.start();
+  start = region.LeftPosition - coverageStart;
+  projectCoverage(coverage, start, cov, feature);
+  stats.stop(STAGE_STATISTICS);
+  return true;
+}
+
+// Calculate the depth of the bases [LeftPosition, RightPosition) on a reference. Unlike the coverage
+// of a feature, the depth does not include the base before the region. The spans are found with a
+// +1 at the first base and a -1 after the last base of each alignment, as for the depth. Returns
+// false if the alignments could not be read.
+bool calculateDepth(alignmentReader& reader, const BamRegion& region, BamAlignment& al, depthAccumulator& accumulator, readFilter& filter, vector<int>& depth, vector<int>& spanned) {
+  if ( !reader.SetRegion(region.LeftRefID, region.LeftPosition, region.RightRefID, region.RightPosition) ) { return false; }
+  filter.mates.clear();
+
+  int length = region.RightPosition - region.LeftPosition;
+  accumulator.reset(region.LeftPosition, length);
+  spanned.assign(length + 1, 0);
+  while ( nextAlignment(reader, al, filter) ) {
+    addFiltered(accumulator, al, filter);
+    int first = max(al.Position, region.LeftPosition) - region.LeftPosition;
+    int last  = min(al.GetEndPosition(), region.RightPosition) - region.LeftPosition;
+    if (first < last) {
+      spanned[first]++;
+      spanned[last]--;
+    }
+  }
+  if (reader.HasFailed()) { return false; }
+  accumulator.resolve(depth);
+  spanned.pop_back();
+  for (int i = 1; i < length; ++i) { spanned[i] += spanned[i - 1]; }
+  return true;
+}
+
+// Constructor. If run statistics are given, the sweep counts the seeks, alignments, regions and
+// bases, and times the pass over the references.
+regionSweep::regionSweep(readFilter& readFilter, runStatistics* runStats) : filter(readFilter), stats(runStats) {
+}
+
+regionSweep::~regionSweep(void) {
+  for (size_t i = 0; i < freeAccumulators.size(); ++i) { delete freeAccumulators[i]; }
+}
+
+// Add a region to be processed, along with the feature that will hold the results. Returns the
+// number of the region in the sweep.
+size_t regionSweep::addRegion(const BamRegion& region, coverageData* cov, int feature) {
+  sweepRegion newRegion;
+  newRegion.region        = region;
+  newRegion.cov           = cov;
+  newRegion.feature       = feature;
+  newRegion.coverageStart = 0;
+  newRegion.accumulator   = NULL;
+  newRegion.reads         = 0;
+  newRegion.started       = 0;
+  newRegion.finished      = 0;
+  regions.push_back(newRegion);
+  return regions.size() - 1;
+}
+
+// Add a further feature with the same span as a region in the sweep. The depth of the span is only
+// calculated once, and the statistics for every feature are calculated from it.
+void regionSweep::addCopy(size_t region, coverageData* cov, int feature) {
+  featureSlot copy;
+  copy.cov     = cov;
+  copy.feature = feature;
+  regions[region].copies.push_back(copy);
+}
+
+// Order regions by their start position.
+bool regionSweep::compareStart(const sweepRegion* a, const sweepRegion* b) {
+  return a->region.LeftPosition < b->region.LeftPosition;
+}
+
+// Group the regions by reference sequence. Regions spanning more than one reference are rare and
+// are read individually.
+void regionSweep::groupRegions(map<int, vector<sweepRegion*> >& references, vector<sweepRegion*>& spanning) {
+  vector<sweepRegion>::iterator iter    = regions.begin();
+  vector<sweepRegion>::iterator iterEnd = regions.end();
+  for (; iter != iterEnd; ++iter) {
+    if (iter->region.LeftRefID == iter->region.RightRefID) { references[iter->region.LeftRefID].push_back(&(*iter)); }
+    else { spanning.push_back(&(*iter)); }
+  }
+}
+
+// Process the regions spanning multiple references.
+bool regionSweep::processSpanning(alignmentReader& reader, vector<sweepRegion*>& spanning) {
+  vector<sweepRegion*>::iterator spanIter    = spanning.begin();
+  vector<sweepRegion*>::iterator spanIterEnd = spanning.end();
+  for (; spanIter != spanIterEnd; ++spanIter) {
+    int start;
+    bool read;
+    if (stats == NULL) { read = calculateRegionCoverage(reader, (*spanIter)->region, alignment, accumulator, coverage, filter, *(*spanIter)->cov, (*spanIter)->feature, start); }
+    else {
+      unsigned long reads = stats->reads();
+      (*spanIter)->started = runStatistics::wallTime();
+      read = calculateRegionCoverage(reader, (*spanIter)->region, alignment, accumulator, coverage, filter, *(*spanIter)->cov, (*spanIter)->feature, start, *stats);
+      (*spanIter)->finished = runStatistics::wallTime();
+      (*spanIter)->reads    = stats->reads() - reads;
+    }
+    if (!read) { return fail(regionError(reader, regionName(reader, (*spanIter)->region))); }
+    vector<featureSlot>::iterator copyIter    = (*spanIter)->copies.begin();
+    vector<featureSlot>::iterator copyIterEnd = (*spanIter)->copies.end();
+    for (; copyIter != copyIterEnd; ++copyIter) { projectCoverage(coverage, start, *copyIter->cov, copyIter->feature); }
+  }
+  return true;
+}
+
+// Record an error and stop the sweep.
+bool regionSweep::fail(const string& message) {
+  error = message;
+  return false;
+}
+
+// Process all of the regions, setting the reader to the extent of the regions on each reference
+// in turn. Returns false if the alignments could not be read, with the reason in errorString.
+bool regionSweep::run(alignmentReader& reader) {
+  map<int, vector<sweepRegion*> > references;
+  vector<sweepRegion*> spanning;
+  groupRegions(references, spanning);
+  if (stats != NULL) { stats->start(); }
+
+  // Sweep over each reference in turn.
+  map<int, vector<sweepRegion*> >::iterator refIter    = references.begin();
+  map<int, vector<sweepRegion*> >::iterator refIterEnd = references.end();
+  for (; refIter != refIterEnd; ++refIter) {
+    beginReference(refIter->second);
+    int right = 0;
+    for (size_t i = 0; i < pending.size(); ++i) { right = max(right, pending[i]->region.RightPosition); }
+    BamRegion extent(refIter->first, pending.front()->region.LeftPosition, refIter->first, right);
+    if ( !reader.SetRegion(extent.LeftRefID, extent.LeftPosition, extent.RightRefID, extent.RightPosition) ) { return fail(regionError(reader, regionName(reader, extent))); }
+
+    unsigned long reads = 0;
+    while ( nextAlignment(reader, alignment, filter) ) {
+      addAlignment(alignment);
+      reads++;
+    }
+    if (reader.HasFailed()) { return fail(reader.GetErrorString()); }
+    endReference();
+    if (stats != NULL) {
+      stats->addSeek();
+      stats->addReads(reads);
+    }
+  }
+  if (stats != NULL) { stats->stop(STAGE_SWEEP); }
+
+  return processSpanning(reader, spanning);
+}
+
+// Process all of the regions while streaming every alignment in the files from start to finish.
+// No index is needed, but the files must be sorted by coordinate. The stream applies the filter
+// itself, before decoding each record. The reader is only used for regions spanning more than one
+// reference.
+bool regionSweep::run(bamMultiStream& stream, alignmentReader& reader) {
+  map<int, vector<sweepRegion*> > references;
+  vector<sweepRegion*> spanning;
+  groupRegions(references, spanning);
+
+  // Alignments are sorted by reference, so each reference is started when its first alignment is seen.
+  // Unmapped reads are at the end of the file and are not needed.
+  if (stats != NULL) { stats->start(); }
+  map<int, vector<sweepRegion*> >::iterator current = references.end();
+  int currentRefID = -1;
+  unsigned long reads = 0;
+  while ( stream.GetNextAlignmentCore(alignment) ) {
+    if (alignment.RefID != currentRefID) {
+      if (current != references.end()) {
+        endReference();
+        references.erase(current);
+      }
+      currentRefID = alignment.RefID;
+      if (currentRefID == -1) { break; }
+      current = references.find(currentRefID);
+      if (current != references.end()) { beginReference(current->second); }
+    }
+    if (current != references.end()) { addAlignment(alignment); }
+    reads++;
+  }
+  if (current != references.end()) {
+    endReference();
+    references.erase(current);
+  }
+
+  if (!stream.GetErrorString().empty()) { return fail(stream.GetErrorString()); }
+
+  // Any references that had no alignments.
+  map<int, vector<sweepRegion*> >::iterator refIter    = references.begin();
+  map<int, vector<sweepRegion*> >::iterator refIterEnd = references.end();
+  for (; refIter != refIterEnd; ++refIter) {
+    beginReference(refIter->second);
+    endReference();
+  }
+  if (stats != NULL) {
+    stats->addReads(reads);
+    stats->stop(STAGE_SWEEP);
+  }
+
+  return processSpanning(reader, spanning);
+}
+
+// Start processing the regions on a reference. An alignment is added to a region under the same
+// rule that the reader uses when a region is set: it must start before the end of the region and
+// end at or after the start of the region.
+void regionSweep::beginReference(vector<sweepRegion*>& regions) {
+  pending.swap(regions);
+  stable_sort(pending.begin(), pending.end(), compareStart);
+  active.clear();
+  nextRegion = 0;
+  filter.mates.clear();
+}
+
+// Add an alignment to all the regions that it overlaps.
+void regionSweep::addAlignment(const BamAlignment& al) {
+  int end = al.GetEndPosition();
+
+  // Find the blocks to add once for all regions. Every alignment is passed to the filter, even
+  // if it overlaps no regions, so that mates are tracked.
+  const vector<coveredBlock>* blocks = NULL;
+  if (filter.needsBlocks()) { blocks = &filter.coveredBlocks(al); }
+
+  // Finish any active regions that end before this alignment. As the alignments are sorted,
+  // no later alignment can overlap them.
+  for (size_t i = 0; i < active.size();) {
+    if (active[i]->region.RightPosition <= al.Position) {
+      finishRegion(active[i]);
+      active[i] = active.back();
+      active.pop_back();
+    } else { ++i; }
+  }
+
+  // Activate the regions starting at or before the end of this alignment. Regions that
+  // already end before this alignment have no coverage.
+  for (; nextRegion < pending.size() && pending[nextRegion]->region.LeftPosition <= end; ++nextRegion) {
+    if (stats != NULL) { pending[nextRegion]->started = runStatistics::wallTime(); }
+    if (pending[nextRegion]->region.RightPosition <= al.Position) { finishRegion(pending[nextRegion]); }
+    else { active.push_back(pending[nextRegion]); }
+  }
+
+  // Add the alignment to every active region that it overlaps.
+  vector<sweepRegion*>::iterator iter    = active.begin();
+  vector<sweepRegion*>::iterator iterEnd = active.end();
+  for (; iter != iterEnd; ++iter) {
+    sweepRegion* current = *iter;
+    if (end < current->region.LeftPosition) { continue; }
+
+    // The first alignment in the region sets the start coordinate of the coverage.
+    if (current->accumulator == NULL) {
+      if (freeAccumulators.empty()) { current->accumulator = new depthAccumulator; }
+      else {
+        current->accumulator = freeAccumulators.back();
+        freeAccumulators.pop_back();
+      }
+      current->coverageStart = min(al.Position, current->region.LeftPosition);
+      current->accumulator->reset(current->coverageStart, current->region.RightPosition - current->coverageStart);
+    }
+    if (blocks != NULL) { current->accumulator->addBlocks(*blocks); }
+    else { current->accumulator->addAlignment(al); }
+    current->reads++;
+  }
+}
+
+// Finish all remaining regions on the reference.
+void regionSweep::endReference(void) {
+  for (size_t i = 0; i < active.size(); ++i) { finishRegion(active[i]); }
+  for (; nextRegion < pending.size(); ++nextRegion) { finishRegion(pending[nextRegion]); }
+  active.clear();
+  pending.clear();
+}
+
+// Calculate the statistics for a region that will receive no more alignments.
+void regionSweep::finishRegion(sweepRegion* current) {
+  int start = -1;
+  if (current->accumulator != NULL) {
+    current->accumulator->resolve(coverage);
+    freeAccumulators.push_back(current->accumulator);
+    current->accumulator = NULL;
+    start = current->region.LeftPosition - current->coverageStart;
+  }
+  if (stats != NULL) {
+    unsigned long bases = 0;
+    if (start >= 0) {
+      for (size_t i = 0; i < coverage.size(); ++i) { bases += coverage[i]; }
+    }
+    stats->addRegion(current->reads);
+    stats->addBases(bases);
+  }
+
+  // The features sharing the span get the same statistics.
+  projectCoverage(coverage, start, *current->cov, current->feature);
+  vector<featureSlot>::iterator iter    = current->copies.begin();
+  vector<featureSlot>::iterator iterEnd = current->copies.end();
+  for (; iter != iterEnd; ++iter) { projectCoverage(coverage, start, *iter->cov, iter->feature); }
+
+  // A region never reached by an alignment starts and finishes here.
+  if (stats != NULL) {
+    current->finished = runStatistics::wallTime();
+    if (current->started == 0) { current->started = current->finished; }
+  }
+}
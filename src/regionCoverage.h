@@ -0,0 +1,137 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Calculate the coverage of regions from the alignments in BAM files
+// ***************************************************************************
+
+#ifndef REGION_COVERAGE_H
+#define REGION_COVERAGE_H
+
+#include "alignmentReader.h"
+#include "bamStream.h"
+#include "dataProcessing.h"
+#include "depthAccumulator.h"
+#include "readFilter.h"
+#include "runStatistics.h"
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// Get the next alignment from the reader that passes the filter.
+bool nextAlignment(alignmentReader&, BamAlignment&, readFilter&);
+
+// Calculate the coverage of a single region by setting the region on the reader
+// and reading the alignments that overlap it. The alignment, accumulator and
+// depth are working buffers, reused from region to region. Only alignments
+// passing the filter are counted. The start is set to the offset of the region
+// in the depth, or -1 if there were no alignments, so the depth can be shared
+// with other features with the same span through projectCoverage. Returns false
+// if the region could not be set or the alignments could not be decoded (see
+// regionError).
+bool calculateRegionCoverage(alignmentReader&, const BamRegion&, BamAlignment&, depthAccumulator&, compactDepth&, readFilter&, coverageData&, int, int&);
+
+// Calculate the coverage of a single region in the same way, recording the time
+// spent in each stage. The time spent decoding and adding the alignments is
+// divided between the two stages from a sample of the alignments.
+bool calculateRegionCoverage(alignmentReader&, const BamRegion&, BamAlignment&, depthAccumulator&, compactDepth&, readFilter&, coverageData&, int, int&, runStatistics&);
+
+// The error for a region whose alignments could not be read, given the region
+// string.
+string regionError(const alignmentReader&, const string&);
+
+// Calculate the statistics for a feature from the depth of a region with the
+// same span and the offset returned by calculateRegionCoverage.
+void projectCoverage(const compactDepth&, int, coverageData&, int);
+
+// Calculate the depth of every base in a region on a single reference, from
+// the alignments passing the filter, and the number of those alignments whose
+// span (from the first to the last aligned base) includes each base. Returns
+// false if the alignments could not be read.
+bool calculateDepth(alignmentReader&, const BamRegion&, BamAlignment&, depthAccumulator&, readFilter&, vector<int>&, vector<int>&);
+
+// Calculate the coverage of a set of regions with a single pass over the
+// alignments on each reference sequence. Alignments spanning several regions
+// are read once and added to every region that they overlap. The results are
+// stored in the feature slots of the coverageData objects supplied with each
+// region, so the order in which regions are completed does not matter. run
+// returns false if the alignments could not be read, with the reason in
+// errorString. With run statistics, each region records the alignments added
+// to it and the wall clock time from when the sweep reached it to when it was
+// finished.
+class regionSweep {
+
+  public:
+    regionSweep(readFilter&, runStatistics*);
+    ~regionSweep(void);
+
+  // Public methods.
+  public:
+    size_t addRegion(const BamRegion&, coverageData*, int);
+    void addCopy(size_t, coverageData*, int);
+    bool run(alignmentReader&);
+    bool run(bamMultiStream&, alignmentReader&);
+    const string& errorString(void) const { return error; }
+    unsigned long regionReads(size_t region) const { return regions[region].reads; }
+    double regionStarted(size_t region) const { return regions[region].started; }
+    double regionFinished(size_t region) const { return regions[region].finished; }
+
+  private:
+
+    // A feature receiving the statistics of a region.
+    struct featureSlot {
+      coverageData* cov;
+      int feature;
+    };
+
+    // A region along with the feature it belongs to, any other features with the
+    // same span and, while it is active, the accumulated depth.
+    struct sweepRegion {
+      BamRegion region;
+      coverageData* cov;
+      int feature;
+      vector<featureSlot> copies;
+      int coverageStart;
+      depthAccumulator* accumulator;
+      unsigned long reads;
+      double started;
+      double finished;
+    };
+
+    static bool compareStart(const sweepRegion*, const sweepRegion*);
+    void groupRegions(map<int, vector<sweepRegion*> >&, vector<sweepRegion*>&);
+    bool processSpanning(alignmentReader&, vector<sweepRegion*>&);
+    bool fail(const string&);
+    void beginReference(vector<sweepRegion*>&);
+    void addAlignment(const BamAlignment&);
+    void endReference(void);
+    void finishRegion(sweepRegion*);
+
+    vector<sweepRegion> regions;
+    readFilter& filter;
+    runStatistics* stats;
+    string error;
+
+    // The regions on the current reference, sorted by start position, and those that
+    // alignments are currently being added to. Regions from nextRegion onwards have not
+    // yet been reached.
+    vector<sweepRegion*> pending;
+    vector<sweepRegion*> active;
+    size_t nextRegion;
+
+    // Accumulators that are not in use by an active region.
+    vector<depthAccumulator*> freeAccumulators;
+
+    // The alignment, accumulator and depth are reused for every region.
+    BamAlignment alignment;
+    depthAccumulator accumulator;
+    compactDepth coverage;
+};
+
+#endif // REGION_COVERAGE_H
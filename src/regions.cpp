@@ -0,0 +1,684 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Read, validate and compile the list of genes and regions
+// ***************************************************************************
+
+#include "regions.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+using namespace std;
+
+// Parse a file and add all lines to the list of regions. Returns false, setting the error, if the
+// file is not a list of genes and regions.
+bool getRegions(string file, vector<string>& geneNames, vector< vector <string> >& regionList, string& error) {
+  vector<string> list;
+  string line;
+  int i = -1;
+  ifstream infile(file.c_str());
+
+  // Open the file reading.
+  while (getline(infile, line)) {
+
+    // Check if the line is a gene name or a region. All gene names must
+    // begin with '_'.
+   
+    if (line[0] == '#') {
+      geneNames.push_back(line.substr(1));
+      if (i != -1) {
+        regionList.push_back(list);
+        list.clear();
+      }
+      i++;
+    } else {
+      list.push_back(line);
+    }
+  }
+
+  // Add the final list to regionList.
+  regionList.push_back(list);
+
+  // If the number of gene names is not equal to the number of regions lists, fail.
+  if (regionList.size() != geneNames.size()) {
+    error = "Invalid regions file " + file + ".\n"
+            "Input regions must be a file with the following format:\n"
+            "    #GENE NAME ('#' must prepend gene name)\n"
+            "    chr:start-end (first exon)\n"
+            "    chr:start-end (second exon)\n"
+            "    etc.\n"
+            "\n"
+            "As many genes as desired can be included, but each new set of regions, must\n"
+            "start with the _gene name.";
+    return false;
+  }
+  return true;
+}
+
+// An exon, with 1-based inclusive positions, ordered by reference name and position.
+struct exonInterval {
+  string reference;
+  int start;
+  int end;
+
+  bool operator<(const exonInterval& other) const {
+    if (reference != other.reference) { return reference < other.reference; }
+    if (start != other.start) { return start < other.start; }
+    return end < other.end;
+  }
+};
+
+// The exons of each gene, with the genes in the order that they are first seen. A gene is
+// identified by its key and printed with its name, which need not be unique.
+struct geneExons {
+  map<string, unsigned int> geneIds;
+  vector<string> geneKeys;
+  vector<string> geneNames;
+  vector< set<exonInterval> > exons;
+
+  void add(const string& key, const string& name, const string& reference, int start, int end) {
+    map<string, unsigned int>::iterator found = geneIds.find(key);
+    if (found == geneIds.end()) {
+      found = geneIds.insert(make_pair(key, (unsigned int)geneNames.size())).first;
+      geneKeys.push_back(key);
+      geneNames.push_back(name);
+      exons.push_back(set<exonInterval>());
+    }
+    exonInterval exon;
+    exon.reference = reference;
+    exon.start     = start;
+    exon.end       = end;
+    exons[found->second].insert(exon);
+  }
+};
+
+// Write the union of the exons of each gene as region strings, in position order. Overlapping
+// exons, such as alternative exons with different splice sites, are merged into one region, so no
+// base is counted twice in the gene. Genes sharing a name are told apart as name|key.
+static void listExons(const geneExons& genes, vector<string>& geneNames, vector< vector <string> >& regionList) {
+  map<string, unsigned int> nameCounts;
+  for (size_t gene = 0; gene < genes.geneNames.size(); ++gene) { nameCounts[genes.geneNames[gene]]++; }
+  geneNames = genes.geneNames;
+  for (size_t gene = 0; gene < geneNames.size(); ++gene) {
+    if (nameCounts[geneNames[gene]] > 1 && geneNames[gene] != genes.geneKeys[gene]) { geneNames[gene] += "|" + genes.geneKeys[gene]; }
+  }
+  regionList.resize(genes.exons.size());
+  for (size_t gene = 0; gene < genes.exons.size(); ++gene) {
+    set<exonInterval>::const_iterator iter    = genes.exons[gene].begin();
+    set<exonInterval>::const_iterator iterEnd = genes.exons[gene].end();
+    while (iter != iterEnd) {
+      exonInterval merged = *iter;
+      for (++iter; iter != iterEnd && iter->reference == merged.reference && iter->start <= merged.end; ++iter) {
+        merged.end = max(merged.end, iter->end);
+      }
+      regionList[gene].push_back(merged.reference + ":" + to_string(merged.start) + "-" + to_string(merged.end));
+    }
+  }
+}
+
+// Read the exons from a GTF file. Each gene is identified by its gene_id attribute, or by its
+// gene_name if it has no id, and named by its gene_name, or by its gene_id if it has no name. Distinct genes can share a name, such as the
+// copies of a gene in the pseudoautosomal regions or the members of an RNA family, so these are
+// kept apart and named as gene_name|gene_id. The regions of a gene are the union of the exons of
+// all of its transcripts, so a base in several transcripts is only counted once. Returns false,
+// setting the error, if the file cannot be read.
+bool getGtfRegions(string file, vector<string>& geneNames, vector< vector <string> >& regionList, string& error) {
+  ifstream infile(file.c_str());
+  if (!infile) {
+    error = "Unable to open the regions file: " + file;
+    return false;
+  }
+
+  geneExons genes;
+  string line;
+  vector<string> fields;
+  while (getline(infile, line)) {
+    if (line.empty() || line[0] == '#') { continue; }
+    istringstream columns(line);
+    string column;
+    fields.clear();
+    while (getline(columns, column, '\t')) { fields.push_back(column); }
+    if (fields.size() < 9) {
+      error = "Invalid GTF line in " + file + ": " + line;
+      return false;
+    }
+    if (fields[2] != "exon") { continue; }
+
+    // Find the gene in the attributes, e.g. gene_id "ENSG00000141510"; gene_name "TP53";
+    string geneId;
+    string geneName;
+    istringstream attributes(fields[8]);
+    string attribute;
+    while (getline(attributes, attribute, ';')) {
+      istringstream keyValue(attribute);
+      string key;
+      string value;
+      if ( !(keyValue >> key >> value) ) { continue; }
+      if (value.size() >= 2 && value[0] == '"' && value[value.size() - 1] == '"') { value = value.substr(1, value.size() - 2); }
+      if (key == "gene_id") { geneId = value; }
+      else if (key == "gene_name") { geneName = value; }
+    }
+    if (geneId == "") { geneId = geneName; }
+    if (geneId == "") {
+      error = "GTF exon without a gene_id in " + file + ": " + line;
+      return false;
+    }
+    if (geneName == "") { geneName = geneId; }
+    genes.add(geneId, geneName, fields[0], atoi(fields[3].c_str()), atoi(fields[4].c_str()));
+  }
+  listExons(genes, geneNames, regionList);
+  return true;
+}
+
+// Read the exons from a BED file. In BED12, each line is a transcript whose exons are its blocks;
+// transcripts with the same name are treated as one gene, with the union of the exons of all of
+// them as its regions. Lines with fewer than twelve columns are a single exon. BED positions are 0-based
+// and exclude the end, so are converted to the 1-based positions of a region string. Returns false,
+// setting the error, if the file cannot be read.
+bool getBedRegions(string file, vector<string>& geneNames, vector< vector <string> >& regionList, string& error) {
+  ifstream infile(file.c_str());
+  if (!infile) {
+    error = "Unable to open the regions file: " + file;
+    return false;
+  }
+
+  geneExons genes;
+  string line;
+  vector<string> fields;
+  while (getline(infile, line)) {
+    if (line.empty() || line[0] == '#' || line.compare(0, 5, "track") == 0 || line.compare(0, 7, "browser") == 0) { continue; }
+    istringstream columns(line);
+    string column;
+    fields.clear();
+    while (getline(columns, column, '\t')) { fields.push_back(column); }
+    if (fields.size() < 3) {
+      error = "Invalid BED line in " + file + ": " + line;
+      return false;
+    }
+    int start = atoi(fields[1].c_str());
+    int end   = atoi(fields[2].c_str());
+    string name = (fields.size() > 3) ? fields[3] : fields[0] + ":" + to_string(start + 1) + "-" + to_string(end);
+    if (fields.size() < 12) {
+      genes.add(name, name, fields[0], start + 1, end);
+      continue;
+    }
+
+    int blockCount = atoi(fields[9].c_str());
+    istringstream sizes(fields[10]);
+    istringstream starts(fields[11]);
+    string size;
+    string offset;
+    for (int block = 0; block < blockCount; ++block) {
+      if ( !getline(sizes, size, ',') || !getline(starts, offset, ',') ) {
+        error = "Invalid BED12 blocks in " + file + ": " + line;
+        return false;
+      }
+      int blockStart = start + atoi(offset.c_str());
+      genes.add(name, name, fields[0], blockStart + 1, blockStart + atoi(size.c_str()));
+    }
+  }
+  listExons(genes, geneNames, regionList);
+  return true;
+}
+
+// Whether a file name ends with a suffix.
+static bool hasSuffix(const string& file, const string& suffix) {
+  return file.size() >= suffix.size() && file.compare(file.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// The formats of a regions file, given by its extension.
+enum regionsFormat {
+  REGIONS_LIST = 0,
+  REGIONS_GTF  = 1,
+  REGIONS_BED  = 2
+};
+
+static regionsFormat getRegionsFormat(const string& file) {
+  if (hasSuffix(file, ".gtf")) { return REGIONS_GTF; }
+  else if (hasSuffix(file, ".bed")) { return REGIONS_BED; }
+  return REGIONS_LIST;
+}
+
+// Read the genes and regions from a file in the format given by its extension: GTF (.gtf), BED or
+// BED12 (.bed), or otherwise the list of gene names and region strings read by getRegions.
+bool readRegions(const string& file, vector<string>& geneNames, vector< vector <string> >& regionList, string& error) {
+  switch (getRegionsFormat(file)) {
+    case REGIONS_GTF: return getGtfRegions(file, geneNames, regionList, error);
+    case REGIONS_BED: return getBedRegions(file, geneNames, regionList, error);
+    default: return getRegions(file, geneNames, regionList, error);
+  }
+}
+
+// Check that the region string is valid.
+bool ParseRegionString(const string& regionString, const RefVector& references, const map<string, int>& referenceIds, BamRegion& region) {
+
+  // Check first for empty string.
+  if ( regionString.empty() ) {
+    return false;
+  }
+
+  // Store the name of the gene.
+  string geneName = "";
+  
+  // Look for a colon.
+  size_t foundFirstColon = regionString.find(':');
+  
+  // Store chrom strings, and numeric positions.
+  string startChrom;
+  string stopChrom;
+  int startPos;
+  int stopPos;
+  
+  // If no colon is found, use entire contents of requested chromosome.
+  // Store the entire region string as startChrom name and use BamReader methods
+  // to check if its valid for current BAM file.
+  if ( foundFirstColon == string::npos ) {
+    startChrom = regionString;
+    startPos   = 0;
+    stopChrom  = regionString;
+    stopPos    = -1;
+  }
+  
+  // If a colon is found, we have some sort of startPos requested.
+  else {
+    
+    // Store the start chrom from beginning to first colon.
+    startChrom = regionString.substr(0, foundFirstColon);
+    
+    // Look for ".." or "-"  after the colon.
+    size_t foundRangeDots = regionString.find("..", foundFirstColon + 1);
+    size_t foundDash      = regionString.find("-", foundFirstColon + 1);
+    
+    // If no dots or dash found, we have a startPos but no range. Store the 
+    // contents before colon as startChrom, after as startPos.
+    if ( foundRangeDots == string::npos and foundDash == string::npos ) {
+      startPos   = atoi( regionString.substr(foundFirstColon + 1).c_str() ); 
+      stopChrom  = startChrom;
+      stopPos    = -1;
+    } 
+    
+    // A ".." or "-" is found, so we have some sort of range selected.
+    else {
+      size_t foundSecondColon;
+      size_t foundRange;
+      size_t offset;
+      if ( foundRangeDots == string::npos) {
+        foundRange = foundDash;
+        offset     = 1;
+      }
+      else { 
+        foundRange = foundRangeDots;
+        offset     = 2;
+      }
+
+      // Store the startPos between first colon and range dots ".." or "-" and look for a
+      // second colon.
+      startPos         = atoi( regionString.substr(foundFirstColon + 1, foundRange - foundFirstColon - 1).c_str() );
+      foundSecondColon = regionString.find(':', foundRange + 1);
+      
+      // If no second colon found, so we have a "standard" chrom:start..stop input format (on single chrom).
+      if ( foundSecondColon == string::npos ) {
+        stopChrom  = startChrom;
+        stopPos    = atoi( regionString.substr(foundRange + offset).c_str() );
+      }
+      
+      // If a second colon is found, we have a range requested across 2 chrom's.
+      else {
+        stopChrom  = regionString.substr(foundRange + offset, foundSecondColon - ( foundRange + offset ));
+        stopPos    = atoi( regionString.substr(foundSecondColon + 1).c_str() );
+      }
+    }
+  }
+
+  // Validate reference IDs & genomic positions.
+  map<string, int>::const_iterator found;
+
+  // If startRefID not found, return false.
+  found = referenceIds.find(startChrom);
+  if ( found == referenceIds.end() ) return false;
+  int startRefID = found->second;
+
+  // startPos cannot be greater than or equal to reference length.
+  const RefData& startReference = references.at(startRefID);
+  if ( startPos >= startReference.RefLength ) return false;
+
+  // If stopRefID not found, return false.
+  found = referenceIds.find(stopChrom);
+  if ( found == referenceIds.end() ) return false;
+  int stopRefID = found->second;
+
+  // stopPosition cannot be larger than reference length.
+  const RefData& stopReference = references.at(stopRefID);
+  if ( stopPos > stopReference.RefLength ) return false;
+
+  // If no stopPosition specified, set to reference end.
+  if ( stopPos == -1 ) stopPos = stopReference.RefLength;
+
+  // Set up the Region struct & return.
+  region.LeftRefID     = startRefID;
+  region.LeftPosition  = startPos;
+  region.RightRefID    = stopRefID;;
+  region.RightPosition = stopPos;
+  return true;
+}
+
+// Constructor
+regionTable::regionTable(void) {
+  fingerprint = 0;
+}
+
+regionTable::~regionTable(void) {
+}
+
+// Order regions by reference and position.
+struct compareRegionPosition {
+  const vector<compiledRegion>& regions;
+  compareRegionPosition(const vector<compiledRegion>& r) : regions(r) {}
+  bool operator()(unsigned int a, unsigned int b) const {
+    const compiledRegion& first  = regions[a];
+    const compiledRegion& second = regions[b];
+    if (first.leftRefID != second.leftRefID) { return first.leftRefID < second.leftRefID; }
+    return first.leftPosition < second.leftPosition;
+  }
+};
+
+// Read the regions file and validate every region against the references. Returns false, setting
+// the error, if the file cannot be read or holds an invalid region.
+bool regionTable::compile(const string& regionsFile, const RefVector& references, string& error) {
+  vector< vector <string> > regionLists;
+  if ( !readRegions(regionsFile, geneNames, regionLists, error) ) { return false; }
+
+  // Build a lookup of the reference names.
+  map<string, int> referenceIds;
+  for (size_t i = 0; i < references.size(); ++i) { referenceIds.insert(make_pair(references[i].RefName, int(i))); }
+
+  // Parse all the regions.
+  BamRegion region;
+  geneOffsets.push_back(0);
+  for (unsigned int gene = 0; gene < regionLists.size(); ++gene) {
+    vector<string>::iterator iter    = regionLists[gene].begin();
+    vector<string>::iterator iterEnd = regionLists[gene].end();
+    for (; iter != iterEnd; ++iter) {
+      if ( !ParseRegionString(*iter, references, referenceIds, region) ) {
+        error = "Invalid region string: " + *iter;
+        return false;
+      }
+
+      compiledRegion compiled;
+      compiled.leftRefID     = region.LeftRefID;
+      compiled.leftPosition  = region.LeftPosition;
+      compiled.rightRefID    = region.RightRefID;
+      compiled.rightPosition = region.RightPosition;
+      compiled.gene          = gene;
+      regions.push_back(compiled);
+      regionStrings.push_back(*iter);
+    }
+    geneOffsets.push_back(regions.size());
+  }
+
+  // Sort the regions by position.
+  sortedOrder.resize(regions.size());
+  for (unsigned int i = 0; i < regions.size(); ++i) { sortedOrder[i] = i; }
+  stable_sort(sortedOrder.begin(), sortedOrder.end(), compareRegionPosition(regions));
+  linkSpans();
+  return true;
+}
+
+// Order regions by their span, and by their position in the table if the spans are the same.
+struct compareRegionSpan {
+  const vector<compiledRegion>& regions;
+  compareRegionSpan(const vector<compiledRegion>& r) : regions(r) {}
+  bool operator()(unsigned int a, unsigned int b) const {
+    const compiledRegion& first  = regions[a];
+    const compiledRegion& second = regions[b];
+    if (first.leftRefID != second.leftRefID) { return first.leftRefID < second.leftRefID; }
+    if (first.leftPosition != second.leftPosition) { return first.leftPosition < second.leftPosition; }
+    if (first.rightRefID != second.rightRefID) { return first.rightRefID < second.rightRefID; }
+    if (first.rightPosition != second.rightPosition) { return first.rightPosition < second.rightPosition; }
+    return a < b;
+  }
+};
+
+// Link the regions that have the same span, e.g. an exon listed under several transcripts, so that
+// the depth of the span is only calculated once.
+void regionTable::linkSpans(void) {
+  vector<unsigned int> order(regions.size());
+  for (unsigned int i = 0; i < regions.size(); ++i) { order[i] = i; }
+  sort(order.begin(), order.end(), compareRegionSpan(regions));
+
+  spanSource.assign(regions.size(), NO_REGION);
+  spanNext.assign(regions.size(), NO_REGION);
+  for (size_t i = 0; i < order.size(); ++i) {
+    const compiledRegion& region = regions[order[i]];
+    if (i > 0) {
+      const compiledRegion& previous = regions[order[i - 1]];
+      if (region.leftRefID == previous.leftRefID && region.leftPosition == previous.leftPosition && region.rightRefID == previous.rightRefID && region.rightPosition == previous.rightPosition) {
+        spanSource[order[i]]  = spanSource[order[i - 1]];
+        spanNext[order[i - 1]] = order[i];
+        continue;
+      }
+    }
+    spanSource[order[i]] = order[i];
+  }
+}
+
+// Exchange the contents of two tables.
+void regionTable::swap(regionTable& other) {
+  geneNames.swap(other.geneNames);
+  geneOffsets.swap(other.geneOffsets);
+  regions.swap(other.regions);
+  regionStrings.swap(other.regionStrings);
+  sortedOrder.swap(other.sortedOrder);
+  spanSource.swap(other.spanSource);
+  spanNext.swap(other.spanNext);
+  std::swap(fingerprint, other.fingerprint);
+}
+
+// Build the table for one of a number of shards of the run. The regions in position order are
+// divided into contiguous blocks of equal size, so a shard covers a range of the genome, and a gene
+// may have regions in several shards. The number of each region of the shard table in this table
+// is returned in originalRegions.
+void regionTable::shard(unsigned int shard, unsigned int numberShards, regionTable& part, vector<unsigned int>& originalRegions) const {
+  size_t first = size_t(shard) * regions.size() / numberShards;
+  size_t last  = size_t(shard + 1) * regions.size() / numberShards;
+  vector<bool> selected(regions.size(), false);
+  for (size_t i = first; i < last; ++i) { selected[sortedOrder[i]] = true; }
+  select(selected, part, originalRegions);
+}
+
+// Build a table holding the selected regions. The table holds the genes with selected regions, in
+// their original order, with only those regions. The number of each region in this table is
+// returned in originalRegions.
+void regionTable::select(const vector<bool>& selected, regionTable& part, vector<unsigned int>& originalRegions) const {
+  part = regionTable();
+  part.fingerprint = fingerprint;
+  part.geneOffsets.push_back(0);
+  originalRegions.clear();
+  for (unsigned int gene = 0; gene < numberGenes(); ++gene) {
+    for (unsigned int i = geneOffsets[gene]; i < geneOffsets[gene + 1]; ++i) {
+      if (!selected[i]) { continue; }
+      compiledRegion compiled = regions[i];
+      compiled.gene = part.geneNames.size();
+      part.regions.push_back(compiled);
+      part.regionStrings.push_back(regionStrings[i]);
+      originalRegions.push_back(i);
+    }
+    if (part.regions.size() > part.geneOffsets.back()) {
+      part.geneNames.push_back(geneNames[gene]);
+      part.geneOffsets.push_back(part.regions.size());
+    }
+  }
+
+  part.sortedOrder.resize(part.regions.size());
+  for (unsigned int i = 0; i < part.regions.size(); ++i) { part.sortedOrder[i] = i; }
+  stable_sort(part.sortedOrder.begin(), part.sortedOrder.end(), compareRegionPosition(part.regions));
+  part.linkSpans();
+}
+
+// Return a compiled region as a BamRegion.
+BamRegion regionTable::region(unsigned int index) const {
+  const compiledRegion& compiled = regions[index];
+  return BamRegion(compiled.leftRefID, compiled.leftPosition, compiled.rightRefID, compiled.rightPosition);
+}
+
+// The cache file starts with a magic number and version.
+static const char REGION_CACHE_MAGIC[4] = {'G', 'C', 'R', 'T'};
+static const uint32_t REGION_CACHE_VERSION = 1;
+
+// Helpers for writing and reading the binary cache.
+template <typename T>
+static void writeValues(ofstream& out, const T* values, size_t n) {
+  if (n > 0) { out.write((const char*)values, sizeof(T) * n); }
+}
+
+template <typename T>
+static bool readValues(ifstream& in, T* values, size_t n) {
+  if (n > 0) { in.read((char*)values, sizeof(T) * n); }
+  return in.good();
+}
+
+static void writeStrings(ofstream& out, const vector<string>& strings) {
+  for (size_t i = 0; i < strings.size(); ++i) {
+    uint32_t length = strings[i].size();
+    writeValues(out, &length, 1);
+    out.write(strings[i].data(), length);
+  }
+}
+
+static bool readStrings(ifstream& in, vector<string>& strings, size_t n) {
+  strings.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    uint32_t length;
+    if ( !readValues(in, &length, 1) ) { return false; }
+    strings[i].resize(length);
+    if (length > 0 && !in.read(&strings[i][0], length)) { return false; }
+  }
+  return true;
+}
+
+// Write the compiled table to a cache file.
+bool regionTable::save(const string& cacheFile) const {
+  string temporary = cacheFile + ".tmp";
+  ofstream out(temporary.c_str(), ios::out | ios::binary);
+  if (!out) { return false; }
+
+  uint32_t numberGenes   = geneNames.size();
+  uint32_t numberRegions = regions.size();
+  out.write(REGION_CACHE_MAGIC, 4);
+  writeValues(out, &REGION_CACHE_VERSION, 1);
+  writeValues(out, &fingerprint, 1);
+  writeValues(out, &numberGenes, 1);
+  writeValues(out, &numberRegions, 1);
+  writeValues(out, &geneOffsets[0], geneOffsets.size());
+  for (size_t i = 0; i < regions.size(); ++i) {
+    int32_t values[5] = {regions[i].leftRefID, regions[i].leftPosition, regions[i].rightRefID, regions[i].rightPosition, int32_t(regions[i].gene)};
+    writeValues(out, values, 5);
+  }
+  writeValues(out, sortedOrder.empty() ? NULL : &sortedOrder[0], sortedOrder.size());
+  writeStrings(out, geneNames);
+  writeStrings(out, regionStrings);
+  out.close();
+  if (!out) { return false; }
+
+  // Move the file into place, so a partially written cache is never read.
+  return rename(temporary.c_str(), cacheFile.c_str()) == 0;
+}
+
+// Read the table from a cache file. Returns false if the file does not exist, is not a valid
+// cache or was built from a different regions file or set of references. The offsets and indexes
+// are checked, as the table is used without further checks.
+bool regionTable::load(const string& cacheFile, unsigned long long expectedFingerprint) {
+  ifstream in(cacheFile.c_str(), ios::in | ios::binary);
+  if (!in) { return false; }
+
+  char magic[4];
+  uint32_t version, numberGenes, numberRegions;
+  if ( !readValues(in, magic, 4) || !equal(magic, magic + 4, REGION_CACHE_MAGIC) ) { return false; }
+  if ( !readValues(in, &version, 1) || version != REGION_CACHE_VERSION ) { return false; }
+  if ( !readValues(in, &fingerprint, 1) || fingerprint != expectedFingerprint ) { return false; }
+  if ( !readValues(in, &numberGenes, 1) || !readValues(in, &numberRegions, 1) ) { return false; }
+
+  geneOffsets.resize(numberGenes + 1);
+  regions.resize(numberRegions);
+  sortedOrder.resize(numberRegions);
+  if ( !readValues(in, &geneOffsets[0], geneOffsets.size()) ) { return false; }
+  if (geneOffsets[0] != 0 || geneOffsets[numberGenes] != numberRegions) { return false; }
+  for (size_t i = 0; i < numberGenes; ++i) {
+    if (geneOffsets[i + 1] < geneOffsets[i]) { return false; }
+  }
+  for (size_t i = 0; i < regions.size(); ++i) {
+    int32_t values[5];
+    if ( !readValues(in, values, 5) ) { return false; }
+    regions[i].leftRefID     = values[0];
+    regions[i].leftPosition  = values[1];
+    regions[i].rightRefID    = values[2];
+    regions[i].rightPosition = values[3];
+    regions[i].gene          = values[4];
+    if (regions[i].gene >= numberGenes) { return false; }
+  }
+  if ( numberRegions > 0 && !readValues(in, &sortedOrder[0], sortedOrder.size()) ) { return false; }
+  for (size_t i = 0; i < sortedOrder.size(); ++i) {
+    if (sortedOrder[i] >= numberRegions) { return false; }
+  }
+  if ( !readStrings(in, geneNames, numberGenes) ) { return false; }
+  if ( !readStrings(in, regionStrings, numberRegions) ) { return false; }
+  linkSpans();
+  return true;
+}
+
+// 64 bit FNV-1a hash.
+void hashBytes(unsigned long long& hash, const char* data, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ULL;
+  }
+}
+
+// Calculate the fingerprint of a regions file and set of references. The contents of the regions
+// file are hashed, so the cache remains valid if the file is copied or touched, along with the
+// format it is read as, as the same contents give different regions as a list, GTF or BED file.
+unsigned long long regionFingerprint(const string& regionsFile, const RefVector& references) {
+  unsigned long long hash = FNV_OFFSET_BASIS;
+  uint32_t format = getRegionsFormat(regionsFile);
+  hashBytes(hash, (const char*)&format, sizeof(format));
+
+  ifstream in(regionsFile.c_str(), ios::in | ios::binary);
+  char buffer[65536];
+  while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) { hashBytes(hash, buffer, in.gcount()); }
+
+  RefVector::const_iterator iter    = references.begin();
+  RefVector::const_iterator iterEnd = references.end();
+  for (; iter != iterEnd; ++iter) {
+    hashBytes(hash, iter->RefName.c_str(), iter->RefName.size() + 1);
+    hashBytes(hash, (const char*)&iter->RefLength, sizeof(iter->RefLength));
+  }
+  return hash;
+}
+
+// Build the region table. If a cache file is given and holds a table compiled from the same regions
+// file and references, it is used directly. Otherwise the regions are parsed and, if requested, the
+// cache is written for the next run. Returns false, setting the error, if the regions cannot be
+// compiled.
+bool loadRegions(const string& regionsFile, const string& cacheFile, const RefVector& references, regionTable& table, string& error) {
+  unsigned long long fingerprint = regionFingerprint(regionsFile, references);
+  if (cacheFile != "") {
+    if ( table.load(cacheFile, fingerprint) ) { return true; }
+    table = regionTable();
+  }
+
+  if ( !table.compile(regionsFile, references, error) ) { return false; }
+  table.fingerprint = fingerprint;
+  if (cacheFile != "" && !table.save(cacheFile)) {
+    cerr << "WARNING: Unable to write the region cache: " << cacheFile << endl;
+  }
+  return true;
+}
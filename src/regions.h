@@ -0,0 +1,108 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Read, validate and compile the list of genes and regions
+// ***************************************************************************
+
+#ifndef REGIONS_H
+#define REGIONS_H
+
+#include "api/BamAux.h"
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// Parse a file and add all lines to the list of regions. The readers of regions
+// return false, setting the error, if the file cannot be read.
+bool getRegions(string, vector<string>&, vector< vector <string> >&, string&);
+
+// Read the union of the exons of each gene from a GTF or BED file. Only the
+// union is listed: the output has a row for each region of a gene and one for
+// the gene, and counting a base once per transcript would weight the gene
+// statistics towards exons shared by many transcripts. Transcripts can still
+// be reported by listing each as a gene in a regions list (getRegions), where
+// the exons they share are read once (see regionTable).
+bool getGtfRegions(string, vector<string>&, vector< vector <string> >&, string&);
+bool getBedRegions(string, vector<string>&, vector< vector <string> >&, string&);
+
+// Read the genes and regions from a file, in the format given by its extension.
+bool readRegions(const string&, vector<string>&, vector< vector <string> >&, string&);
+
+// Check that the region string is valid.
+bool ParseRegionString(const string&, const RefVector&, const map<string, int>&, BamRegion&);
+
+// A region that has been parsed and validated against the BAM references.
+struct compiledRegion {
+  int leftRefID;
+  int leftPosition;
+  int rightRefID;
+  int rightPosition;
+  unsigned int gene;
+};
+
+// Marks the absence of a region.
+#define NO_REGION 0xffffffffU
+
+// The full set of genes and regions, parsed once for the run. The regions are
+// held in input order, grouped by gene, and the regions of gene g are
+// [geneOffsets[g], geneOffsets[g + 1]). sortedOrder lists the regions ordered by
+// reference and position. Regions with the same span, such as an exon listed
+// under several transcripts or genes in a regions list, share their depth:
+// spanSource is the first region in the table with the same span as each
+// region, and spanNext the next region with it, or NO_REGION. In a table read
+// from a GTF or BED file, spans are only shared between genes with an
+// identical merged exon.
+class regionTable {
+
+  public:
+    regionTable(void);
+    ~regionTable(void);
+
+  // Public methods.
+  public:
+    bool compile(const string&, const RefVector&, string&);
+    bool load(const string&, unsigned long long);
+    bool save(const string&) const;
+    BamRegion region(unsigned int) const;
+    void swap(regionTable&);
+    void shard(unsigned int, unsigned int, regionTable&, vector<unsigned int>&) const;
+    void select(const vector<bool>&, regionTable&, vector<unsigned int>&) const;
+    unsigned int numberGenes() const { return geneNames.size(); }
+    unsigned int numberRegions(unsigned int gene) const { return geneOffsets[gene + 1] - geneOffsets[gene]; }
+    bool sharesSpan(unsigned int index) const { return spanSource[index] != index || spanNext[index] != NO_REGION; }
+
+  public:
+    vector<string> geneNames;
+    vector<unsigned int> geneOffsets;
+    vector<compiledRegion> regions;
+    vector<string> regionStrings;
+    vector<unsigned int> sortedOrder;
+    vector<unsigned int> spanSource;
+    vector<unsigned int> spanNext;
+
+    // Identifies the regions file and BAM references that the table was compiled from.
+    unsigned long long fingerprint;
+
+  private:
+    void linkSpans(void);
+};
+
+// Add bytes to a 64 bit FNV-1a hash, which starts at FNV_OFFSET_BASIS.
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+void hashBytes(unsigned long long&, const char*, size_t);
+
+// Calculate the fingerprint of a regions file and set of references.
+unsigned long long regionFingerprint(const string&, const RefVector&);
+
+// Build the region table, using a cached copy if one is available and up to
+// date. Returns false, setting the error, if the regions cannot be compiled.
+bool loadRegions(const string&, const string&, const RefVector&, regionTable&, string&);
+
+#endif // REGIONS_H
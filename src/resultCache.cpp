@@ -0,0 +1,250 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// A directory of gene results kept between runs
+// ***************************************************************************
+
+#include "resultCache.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// An entry starts with a magic number.
+static const char RESULT_CACHE_MAGIC[4] = {'G', 'C', 'R', 'C'};
+
+template <typename T>
+static void hashValue(unsigned long long& hash, T value) {
+  hashBytes(hash, (const char*)&value, sizeof(T));
+}
+
+static void hashString(unsigned long long& hash, const string& text) {
+  hashBytes(hash, text.c_str(), text.size() + 1);
+}
+
+// Add the contents of a file to a hash. Returns false if the file cannot be read.
+static bool hashFile(unsigned long long& hash, const string& filename) {
+  ifstream in(filename.c_str(), ios::in | ios::binary);
+  if (!in) { return false; }
+  char buffer[65536];
+  while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) { hashBytes(hash, buffer, in.gcount()); }
+  return true;
+}
+
+// Calculate the fingerprint of the alignments in a set of BAM files: the merged header and
+// references, and the size of each file and the contents of its index. The header alone is not
+// enough, as files from the same pipeline can have the same header, and hashing the index rather
+// than the file keeps the fingerprint cheap; the index changes with any change to the alignments.
+// A file without an index is fingerprinted by its modification time instead.
+unsigned long long alignmentFingerprint(const vector<string>& inputFiles, const string& headerText, const RefVector& references) {
+  unsigned long long hash = FNV_OFFSET_BASIS;
+  hashString(hash, headerText);
+  RefVector::const_iterator refIter    = references.begin();
+  RefVector::const_iterator refIterEnd = references.end();
+  for (; refIter != refIterEnd; ++refIter) {
+    hashString(hash, refIter->RefName);
+    hashValue<int32_t>(hash, refIter->RefLength);
+  }
+
+  vector<string>::const_iterator iter    = inputFiles.begin();
+  vector<string>::const_iterator iterEnd = inputFiles.end();
+  for (; iter != iterEnd; ++iter) {
+    struct stat status;
+    bool found = (stat(iter->c_str(), &status) == 0);
+    hashValue<int64_t>(hash, found ? int64_t(status.st_size) : -1);
+
+    // The index is next to the file, either with the extension added or in place of ".bam".
+    vector<string> indexes;
+    indexes.push_back(*iter + ".bai");
+    indexes.push_back(*iter + ".csi");
+    indexes.push_back(*iter + ".crai");
+    if (iter->size() > 4 && iter->compare(iter->size() - 4, 4, ".bam") == 0) { indexes.push_back(iter->substr(0, iter->size() - 4) + ".bai"); }
+    bool indexed = false;
+    for (size_t i = 0; i < indexes.size() && !indexed; ++i) { indexed = hashFile(hash, indexes[i]); }
+    if (!indexed) { hashValue<int64_t>(hash, found ? int64_t(status.st_mtime) : -1); }
+  }
+  return hash;
+}
+
+// Constructor
+resultCache::resultCache(void) {
+  runKey      = 0;
+  entryMode   = 0644;
+  storeFailed = false;
+}
+
+resultCache::~resultCache(void) {
+}
+
+// Use a cache directory, creating it if it does not exist.
+bool resultCache::open(const string& cacheDirectory) {
+  if (mkdir(cacheDirectory.c_str(), 0777) != 0 && errno != EEXIST) {
+    error = "could not create the result cache " + cacheDirectory;
+    return false;
+  }
+  struct stat status;
+  if (stat(cacheDirectory.c_str(), &status) != 0 || !S_ISDIR(status.st_mode) || access(cacheDirectory.c_str(), R_OK | W_OK | X_OK) != 0) {
+    error = "the result cache " + cacheDirectory + " is not a writable directory";
+    return false;
+  }
+  directory = cacheDirectory;
+
+  // mkstemp creates the temporary files readable only by the owner, so each entry is given the
+  // permissions of a file created under the umask before it is renamed into place. The umask is
+  // read here, before any thread stores an entry.
+  mode_t mask = umask(0);
+  umask(mask);
+  entryMode = 0666 & ~mask;
+  return true;
+}
+
+// Set the run that the genes are calculated for: the fingerprint of the alignments and the options
+// that change the results.
+void resultCache::setRun(unsigned long long alignments, const statisticsOptions& statistics, const readFilter& filter) {
+  runKey = FNV_OFFSET_BASIS;
+  hashValue<uint32_t>(runKey, RESULT_CACHE_VERSION);
+  hashValue<uint64_t>(runKey, alignments);
+  hashValue<uint32_t>(runKey, statistics.lowCoverage);
+  hashValue<uint32_t>(runKey, statistics.thresholds.size());
+  for (size_t i = 0; i < statistics.thresholds.size(); ++i) { hashValue<int32_t>(runKey, statistics.thresholds[i]); }
+  hashValue<int32_t>(runKey, filter.minMappingQuality);
+  hashValue<uint32_t>(runKey, filter.requiredFlags);
+  hashValue<uint32_t>(runKey, filter.excludedFlags);
+  hashValue<int32_t>(runKey, filter.minBaseQuality);
+  hashValue<uint64_t>(runKey, filter.mates.window());
+}
+
+// The key of a gene in this run, from its name and its regions. The region strings are part of the
+// output, so are included along with the compiled regions.
+unsigned long long resultCache::geneKey(const regionTable& table, unsigned int gene) const {
+  unsigned long long hash = runKey;
+  hashString(hash, table.geneNames[gene]);
+  for (unsigned int i = table.geneOffsets[gene]; i < table.geneOffsets[gene + 1]; ++i) {
+    const compiledRegion& region = table.regions[i];
+    hashString(hash, table.regionStrings[i]);
+    hashValue<int32_t>(hash, region.leftRefID);
+    hashValue<int32_t>(hash, region.leftPosition);
+    hashValue<int32_t>(hash, region.rightRefID);
+    hashValue<int32_t>(hash, region.rightPosition);
+  }
+  return hash;
+}
+
+// The path of the entry for a key, with the given extension. The subdirectory is created if needed.
+string resultCache::entryPath(unsigned long long key, const string& extension) const {
+  char name[20];
+  snprintf(name, sizeof(name), "%016llx", key);
+  string subdirectory = directory + "/" + string(name, 2);
+  mkdir(subdirectory.c_str(), 0777);
+  return subdirectory + "/" + name + extension;
+}
+
+// Read the entry for a key. Returns false if there is no entry, or it is not a complete entry for
+// the key.
+bool resultCache::find(unsigned long long key, string& output, string& lowCoverage) const {
+  ifstream in(entryPath(key, ".gcrc").c_str(), ios::in | ios::binary);
+  if (!in) { return false; }
+
+  char magic[4];
+  uint32_t version;
+  uint64_t entryKey, outputLength, lowCoverageLength, checksum;
+  in.read(magic, 4);
+  in.read((char*)&version, sizeof(version));
+  in.read((char*)&entryKey, sizeof(entryKey));
+  in.read((char*)&outputLength, sizeof(outputLength));
+  in.read((char*)&lowCoverageLength, sizeof(lowCoverageLength));
+  if ( !in || !equal(magic, magic + 4, RESULT_CACHE_MAGIC) || version != RESULT_CACHE_VERSION || entryKey != key ) { return false; }
+
+  // The lengths are checked against the size of the file before the strings are allocated.
+  streampos dataStart = in.tellg();
+  in.seekg(0, ios::end);
+  if (uint64_t(in.tellg() - dataStart) != outputLength + lowCoverageLength + sizeof(checksum)) { return false; }
+  in.seekg(dataStart);
+
+  output.resize(outputLength);
+  lowCoverage.resize(lowCoverageLength);
+  if (outputLength > 0) { in.read(&output[0], outputLength); }
+  if (lowCoverageLength > 0) { in.read(&lowCoverage[0], lowCoverageLength); }
+  in.read((char*)&checksum, sizeof(checksum));
+  if (!in) { return false; }
+
+  unsigned long long hash = FNV_OFFSET_BASIS;
+  hashBytes(hash, output.data(), output.size());
+  hashBytes(hash, lowCoverage.data(), lowCoverage.size());
+  return checksum == hash;
+}
+
+// Write the entry for a key. The entry is written to a temporary file that is renamed into place,
+// so the entry is either complete or absent, whatever happens to the process. A failure is
+// reported once and the run continues without the entry.
+bool resultCache::store(unsigned long long key, const string& output, const string& lowCoverage) {
+  string path = entryPath(key, ".gcrc");
+  string temporary = path + ".XXXXXX";
+  int fd = mkstemp(&temporary[0]);
+  bool written = false;
+  if (fd >= 0) {
+    uint32_t version = RESULT_CACHE_VERSION;
+    uint64_t entryKey = key, outputLength = output.size(), lowCoverageLength = lowCoverage.size();
+    unsigned long long checksum = FNV_OFFSET_BASIS;
+    hashBytes(checksum, output.data(), output.size());
+    hashBytes(checksum, lowCoverage.data(), lowCoverage.size());
+
+    string entry(RESULT_CACHE_MAGIC, 4);
+    entry.append((const char*)&version, sizeof(version));
+    entry.append((const char*)&entryKey, sizeof(entryKey));
+    entry.append((const char*)&outputLength, sizeof(outputLength));
+    entry.append((const char*)&lowCoverageLength, sizeof(lowCoverageLength));
+    entry += output;
+    entry += lowCoverage;
+    entry.append((const char*)&checksum, sizeof(checksum));
+
+    size_t done = 0;
+    while (done < entry.size()) {
+      ssize_t n = write(fd, entry.data() + done, entry.size() - done);
+      if (n < 0 && errno == EINTR) { continue; }
+      if (n <= 0) { break; }
+      done += n;
+    }
+    bool permitted = (fchmod(fd, entryMode) == 0);
+    written = (close(fd) == 0 && permitted && done == entry.size() && rename(temporary.c_str(), path.c_str()) == 0);
+    if (!written) { unlink(temporary.c_str()); }
+  }
+  if (!written && !storeFailed.exchange(true)) {
+    cerr << "WARNING: Unable to write to the result cache " << directory << ". The genes are still calculated, but are not kept." << endl;
+  }
+  return written;
+}
+
+// Lock the entry for a key, waiting for any other process or thread holding it. Returns the
+// descriptor of the lock file, or -1 if it could not be locked, in which case the caller carries on
+// without the lock. The lock files are left in place: removing one could let two processes hold
+// locks on different files for the same key.
+int resultCache::lock(unsigned long long key) const {
+  int fd = ::open(entryPath(key, ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (fd < 0) { return -1; }
+  while (flock(fd, LOCK_EX) != 0) {
+    if (errno != EINTR) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+void resultCache::unlock(int fd) const {
+  if (fd < 0) { return; }
+  flock(fd, LOCK_UN);
+  close(fd);
+}
@@ -0,0 +1,82 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// A directory of gene results kept between runs
+// ***************************************************************************
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "dataProcessing.h"
+#include "readFilter.h"
+#include "regions.h"
+#include "api/BamAux.h"
+#include <atomic>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// The output for each gene is kept in a cache directory, under a key made from
+// the alignments (the BAM header and references, and the size of each BAM file
+// and the contents of its index, or its modification time if it has no index),
+// the statistics and read filter options and the name and regions of the gene.
+// A run that is restarted, or a later run with some of the same genes, takes
+// those genes from the cache rather than reading the alignments again. Each
+// entry is a file:
+//   header      magic, version, key, and the lengths of the output and the low
+//               coverage intervals
+//   data        the output lines and the low coverage intervals of the gene
+//   trailer     a checksum of the data
+// Entries are written to a temporary file and renamed into place, so a reader
+// never sees a partial entry, with the permissions of a file created under the
+// umask, and are spread over 256 subdirectories. Any
+// number of processes and threads can share the directory. A gene being
+// calculated is locked (flock on a lock file beside the entry), so a process
+// needing the same gene waits for it rather than calculating it again.
+#define RESULT_CACHE_VERSION 1
+
+// Calculate the fingerprint of the alignments in a set of BAM files.
+unsigned long long alignmentFingerprint(const vector<string>&, const string&, const RefVector&);
+
+class resultCache {
+
+  public:
+    resultCache(void);
+    ~resultCache(void);
+
+  // Public methods.
+  public:
+    bool open(const string&);
+    bool isOpen(void) const { return directory != ""; }
+    void setRun(unsigned long long, const statisticsOptions&, const readFilter&);
+    unsigned long long geneKey(const regionTable&, unsigned int) const;
+    bool find(unsigned long long, string&, string&) const;
+    bool store(unsigned long long, const string&, const string&);
+    int lock(unsigned long long) const;
+    void unlock(int) const;
+    const string& errorString(void) const { return error; }
+
+  private:
+    string entryPath(unsigned long long, const string&) const;
+
+    string directory;
+    string error;
+
+    // The permissions of an entry, from the umask.
+    mode_t entryMode;
+
+    // The key of the run, which every gene key includes.
+    unsigned long long runKey;
+
+    // A failure to write an entry is only reported once.
+    atomic<bool> storeFailed;
+};
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,187 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Timings and counters describing where the time in a run is spent
+// ***************************************************************************
+
+#include "runStatistics.h"
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+
+// The names of the stages in the output.
+static const char* STAGE_NAMES[NUMBER_RUN_STAGES] = {"parse_regions", "seek", "decode", "accumulate", "sweep", "statistics", "output"};
+
+static double clockSeconds(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Constructor
+runStatistics::runStatistics(void) {
+  startWall        = 0;
+  startCpu         = 0;
+  seeks            = 0;
+  regions          = 0;
+  regionReads      = 0;
+  readsDecoded     = 0;
+  minReads         = 0;
+  maxReads         = 0;
+  basesAccumulated = 0;
+  cachedGenes      = 0;
+  for (int i = 0; i < NUMBER_RUN_STAGES; ++i) {
+    wall[i] = 0;
+    cpu[i]  = 0;
+  }
+  created = wallTime();
+}
+
+runStatistics::~runStatistics(void) {
+}
+
+double runStatistics::wallTime(void) {
+  return clockSeconds(CLOCK_MONOTONIC);
+}
+
+// Start timing a stage.
+void runStatistics::start(void) {
+  startWall = clockSeconds(CLOCK_MONOTONIC);
+  startCpu  = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+// Add the time since start to a stage.
+void runStatistics::stop(runStage stage) {
+  wall[stage] += clockSeconds(CLOCK_MONOTONIC) - startWall;
+  cpu[stage]  += clockSeconds(CLOCK_THREAD_CPUTIME_ID) - startCpu;
+}
+
+// Add the time since start to two stages that were interleaved, the first taking the given
+// fraction of it.
+void runStatistics::stop(runStage first, runStage second, double fraction) {
+  double wallTaken = clockSeconds(CLOCK_MONOTONIC) - startWall;
+  double cpuTaken  = clockSeconds(CLOCK_THREAD_CPUTIME_ID) - startCpu;
+  wall[first]  += wallTaken * fraction;
+  cpu[first]   += cpuTaken * fraction;
+  wall[second] += wallTaken * (1 - fraction);
+  cpu[second]  += cpuTaken * (1 - fraction);
+}
+
+// Count a region and the alignments added to it. The alignments decoded are counted separately
+// (addReads), as a sweep adds an alignment to every region that it overlaps.
+void runStatistics::addRegion(unsigned long reads) {
+  if (regions == 0 || reads < minReads) { minReads = reads; }
+  if (reads > maxReads) { maxReads = reads; }
+  regions++;
+  regionReads += reads;
+}
+
+bool runStatistics::compareTiming(const geneTiming& a, const geneTiming& b) {
+  return a.seconds > b.seconds;
+}
+
+// Record the time taken by a gene, keeping only the slowest.
+void runStatistics::addGene(const string& name, double seconds, unsigned int geneRegions, unsigned long reads) {
+  if (slowest.size() == SLOWEST_GENES && seconds <= slowest.back().seconds) { return; }
+  geneTiming timing;
+  timing.name    = name;
+  timing.seconds = seconds;
+  timing.regions = geneRegions;
+  timing.reads   = reads;
+  slowest.insert(upper_bound(slowest.begin(), slowest.end(), timing, compareTiming), timing);
+  if (slowest.size() > SLOWEST_GENES) { slowest.pop_back(); }
+}
+
+// Add the statistics from another thread.
+void runStatistics::merge(const runStatistics& other) {
+  for (int i = 0; i < NUMBER_RUN_STAGES; ++i) {
+    wall[i] += other.wall[i];
+    cpu[i]  += other.cpu[i];
+  }
+  if (other.regions > 0) {
+    if (regions == 0 || other.minReads < minReads) { minReads = other.minReads; }
+    if (other.maxReads > maxReads) { maxReads = other.maxReads; }
+  }
+  seeks            += other.seeks;
+  regions          += other.regions;
+  regionReads      += other.regionReads;
+  readsDecoded     += other.readsDecoded;
+  basesAccumulated += other.basesAccumulated;
+  cachedGenes      += other.cachedGenes;
+  for (size_t i = 0; i < other.slowest.size(); ++i) {
+    addGene(other.slowest[i].name, other.slowest[i].seconds, other.slowest[i].regions, other.slowest[i].reads);
+  }
+}
+
+// The number of bytes the process has read, from /proc/self/io. Returns false if this is not
+// available.
+static bool bytesRead(unsigned long& bytes) {
+  ifstream io("/proc/self/io");
+  string key;
+  while (io >> key >> bytes) {
+    if (key == "rchar:") { return true; }
+  }
+  return false;
+}
+
+// Write a string as a JSON string.
+static void writeJsonString(ofstream& out, const string& text) {
+  out << '"';
+  for (size_t i = 0; i < text.size(); ++i) {
+    unsigned char c = text[i];
+    if (c == '"' || c == '\\') { out << '\\' << c; }
+    else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out << escaped;
+    }
+    else { out << c; }
+  }
+  out << '"';
+}
+
+// Write the statistics as JSON. The wall and CPU times of the stages are summed over the threads,
+// so with several threads they can add up to more than the length of the run. The number of
+// alignments examined by the read filter is passed in, as the filter counts the alignments it
+// rejects.
+bool runStatistics::write(const string& filename, unsigned long examined) const {
+  ofstream out(filename.c_str());
+  if (!out) { return false; }
+
+  out << "{\n";
+  out << "  \"wall_seconds\": " << wallTime() - created << ",\n";
+  out << "  \"cpu_seconds\": " << clockSeconds(CLOCK_PROCESS_CPUTIME_ID) << ",\n";
+  out << "  \"stages\": {\n";
+  for (int i = 0; i < NUMBER_RUN_STAGES; ++i) {
+    out << "    \"" << STAGE_NAMES[i] << "\": {\"wall_seconds\": " << wall[i] << ", \"cpu_seconds\": " << cpu[i] << "}";
+    out << ((i + 1 < NUMBER_RUN_STAGES) ? ",\n" : "\n");
+  }
+  out << "  },\n";
+  out << "  \"counters\": {\n";
+  out << "    \"seeks\": " << seeks << ",\n";
+  out << "    \"regions\": " << regions << ",\n";
+  out << "    \"reads_examined\": " << examined << ",\n";
+  out << "    \"reads_decoded\": " << readsDecoded << ",\n";
+  out << "    \"reads_per_region\": {\"min\": " << minReads << ", \"mean\": " << (regions > 0 ? double(regionReads) / regions : 0) << ", \"max\": " << maxReads << "},\n";
+  out << "    \"bases_accumulated\": " << basesAccumulated << ",\n";
+  out << "    \"cached_genes\": " << cachedGenes;
+  unsigned long bytes;
+  if (bytesRead(bytes)) { out << ",\n    \"bytes_read\": " << bytes; }
+  out << "\n  },\n";
+  out << "  \"slowest_genes\": [";
+  for (size_t i = 0; i < slowest.size(); ++i) {
+    out << (i > 0 ? ",\n" : "\n") << "    {\"gene\": ";
+    writeJsonString(out, slowest[i].name);
+    out << ", \"wall_seconds\": " << slowest[i].seconds << ", \"regions\": " << slowest[i].regions << ", \"reads\": " << slowest[i].reads << "}";
+  }
+  out << (slowest.empty() ? "]\n" : "\n  ]\n");
+  out << "}\n";
+  out.close();
+  return !out.fail();
+}
@@ -0,0 +1,101 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Timings and counters describing where the time in a run is spent
+// ***************************************************************************
+
+#ifndef RUN_STATISTICS_H
+#define RUN_STATISTICS_H
+
+#include <time.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The stages of a run that are timed. The sweep reads and accumulates the
+// alignments for many regions at once, so its decoding and accumulation are
+// timed together.
+enum runStage {
+  STAGE_PARSE_REGIONS,
+  STAGE_SEEK,
+  STAGE_DECODE,
+  STAGE_ACCUMULATE,
+  STAGE_SWEEP,
+  STAGE_STATISTICS,
+  STAGE_OUTPUT,
+  NUMBER_RUN_STAGES
+};
+
+// The number of slowest genes reported.
+#define SLOWEST_GENES 10
+
+// Collect the wall and CPU time spent in each stage, along with counters of the
+// work done. The CPU time is that of the calling thread, so each thread keeps
+// its own statistics and they are merged at the end of the run. Statistics are
+// only collected if requested; the code being measured holds a pointer that is
+// NULL otherwise, and checks it once per region rather than once per alignment.
+class runStatistics {
+
+  public:
+    runStatistics(void);
+    ~runStatistics(void);
+
+  // Public methods.
+  public:
+    void start(void);
+    void stop(runStage);
+    void stop(runStage, runStage, double);
+    void addSeek(void) { seeks++; }
+    void addRegion(unsigned long);
+    void addReads(unsigned long reads) { readsDecoded += reads; }
+    void addBases(unsigned long bases) { basesAccumulated += bases; }
+    void addCachedGene(void) { cachedGenes++; }
+    void addGene(const string&, double, unsigned int, unsigned long);
+    void merge(const runStatistics&);
+    bool write(const string&, unsigned long) const;
+
+    // The wall clock time, for timing a gene.
+    static double wallTime(void);
+    unsigned long reads(void) const { return readsDecoded; }
+
+  private:
+
+    // A gene and the time it took.
+    struct geneTiming {
+      string name;
+      double seconds;
+      unsigned int regions;
+      unsigned long reads;
+    };
+    static bool compareTiming(const geneTiming&, const geneTiming&);
+
+    // The start of the stage being timed.
+    double startWall;
+    double startCpu;
+
+    // The time spent in each stage.
+    double wall[NUMBER_RUN_STAGES];
+    double cpu[NUMBER_RUN_STAGES];
+
+    unsigned long seeks;
+    unsigned long regions;
+    unsigned long regionReads;
+    unsigned long readsDecoded;
+    unsigned long minReads;
+    unsigned long maxReads;
+    unsigned long basesAccumulated;
+    unsigned long cachedGenes;
+
+    // The slowest genes, slowest first.
+    vector<geneTiming> slowest;
+
+    // The time the statistics were created, for the length of the run.
+    double created;
+};
+
+#endif // RUN_STATISTICS_H
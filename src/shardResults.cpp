@@ -0,0 +1,267 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Write and read the partial results of a shard of a run
+// ***************************************************************************
+
+#include "shardResults.h"
+#include <algorithm>
+
+using namespace std;
+
+// The shard file starts and ends with a magic number.
+static const char SHARD_MAGIC[4]   = {'G', 'C', 'S', 'H'};
+static const char SHARD_TRAILER[4] = {'G', 'C', 'S', 'E'};
+
+template <typename T>
+static void writeValue(outputWriter& out, T value) {
+  out.write((const char*)&value, sizeof(T));
+}
+
+// Write the header of a shard file, describing the run that the shard is part of.
+void writeShardHeader(outputWriter& out, const shardMapping& mapping, const regionTable& part, const statisticsOptions& statistics, const readFilter& filter, const RefVector& references) {
+  out.write(SHARD_MAGIC, 4);
+  writeValue<uint32_t>(out, SHARD_VERSION);
+  writeValue<uint32_t>(out, mapping.shard);
+  writeValue<uint32_t>(out, mapping.numberShards);
+  writeValue<uint64_t>(out, mapping.table.fingerprint);
+  writeValue<uint64_t>(out, mapping.alignments);
+  writeValue<int32_t>(out, filter.minMappingQuality);
+  writeValue<int32_t>(out, filter.minBaseQuality);
+  writeValue<uint32_t>(out, filter.requiredFlags);
+  writeValue<uint32_t>(out, filter.excludedFlags);
+  writeValue<uint64_t>(out, filter.mates.window());
+  writeValue<uint32_t>(out, statistics.lowCoverage);
+  writeValue<uint32_t>(out, statistics.thresholds.size());
+  for (size_t i = 0; i < statistics.thresholds.size(); ++i) { writeValue<int32_t>(out, statistics.thresholds[i]); }
+  writeValue<uint32_t>(out, references.size());
+  for (size_t i = 0; i < references.size(); ++i) {
+    writeValue<uint32_t>(out, references[i].RefName.size());
+    out << references[i].RefName;
+    writeValue<int32_t>(out, references[i].RefLength);
+  }
+  writeValue<uint32_t>(out, part.numberGenes());
+}
+
+void writeShardTrailer(outputWriter& out) {
+  out.write(SHARD_TRAILER, 4);
+}
+
+// Constructor
+shardWriter::shardWriter(outputWriter& outFile, const shardMapping& shardMap, const regionTable& shardTable) : out(outFile), mapping(shardMap), part(shardTable) {
+}
+
+shardWriter::~shardWriter(void) {
+}
+
+// Write the record for a gene of the shard.
+void shardWriter::gene(unsigned int gene, const coverageData& cov) {
+  unsigned int firstRegion = mapping.originalRegions[part.geneOffsets[gene]];
+  unsigned int fullGene    = mapping.table.regions[firstRegion].gene;
+  unsigned int fullOffset  = mapping.table.geneOffsets[fullGene];
+  writeValue<uint32_t>(fullGene);
+
+  // The gene level totals.
+  const vector<unsigned long>& basesAbove = cov.geneCountsAbove();
+  for (size_t i = 0; i < basesAbove.size(); ++i) { writeValue<uint64_t>(basesAbove[i]); }
+  cov.geneDepths().counts(depths);
+  writeValue<uint32_t>(depths.size());
+  vector< pair<int, unsigned long> >::const_iterator depthIter    = depths.begin();
+  vector< pair<int, unsigned long> >::const_iterator depthIterEnd = depths.end();
+  for (; depthIter != depthIterEnd; ++depthIter) {
+    writeValue<int32_t>(depthIter->first);
+    writeValue<uint64_t>(depthIter->second);
+  }
+
+  // The low coverage intervals.
+  writeValue<uint32_t>(cov.lowCoverage.size());
+  vector<lowCoverageInterval>::const_iterator lowIter    = cov.lowCoverage.begin();
+  vector<lowCoverageInterval>::const_iterator lowIterEnd = cov.lowCoverage.end();
+  for (; lowIter != lowIterEnd; ++lowIter) {
+    writeValue<uint32_t>(mapping.originalRegions[part.geneOffsets[gene] + lowIter->feature] - fullOffset);
+    writeValue<int32_t>(lowIter->start);
+    writeValue<int32_t>(lowIter->end);
+  }
+
+  // The statistics for each feature.
+  size_t numberThresholds = cov.numberThresholds();
+  writeValue<uint32_t>(cov.size());
+  for (size_t feature = 0; feature < cov.size(); ++feature) {
+    writeValue<uint32_t>(mapping.originalRegions[part.geneOffsets[gene] + feature] - fullOffset);
+    writeValue<int32_t>(cov.featureMin[feature]);
+    writeValue<int32_t>(cov.featureMax[feature]);
+    writeValue<double>(cov.featureQ1[feature]);
+    writeValue<double>(cov.featureMedian[feature]);
+    writeValue<double>(cov.featureQ3[feature]);
+    writeValue<double>(cov.featureMean[feature]);
+    writeValue<double>(cov.featureSd[feature]);
+    for (size_t i = 0; i < numberThresholds; ++i) { writeValue<double>(cov.featureAbove[feature * numberThresholds + i]); }
+  }
+}
+
+// Constructor
+shardReader::shardReader(void) {
+  file         = NULL;
+  shard        = 0;
+  numberShards = 0;
+  fingerprint       = 0;
+  alignments        = 0;
+  minMappingQuality = 0;
+  minBaseQuality    = 0;
+  requiredFlags     = 0;
+  excludedFlags     = 0;
+  mateWindow        = 0;
+  lowCoverage       = false;
+  numberGenes  = 0;
+  genesRead    = 0;
+  currentGene  = NO_REGION;
+}
+
+shardReader::~shardReader(void) {
+  close();
+}
+
+void shardReader::close(void) {
+  if (file != NULL) { gzclose(file); }
+  file = NULL;
+}
+
+bool shardReader::readBytes(void* data, size_t length) {
+  return gzread(file, data, length) == (int)length;
+}
+
+// Record an error and stop reading.
+bool shardReader::fail(const string& message) {
+  error = filename + ": " + message;
+  currentGene = NO_REGION;
+  return false;
+}
+
+// Open a shard file and read the header and the first gene record, if there is one.
+bool shardReader::open(const string& shardFile) {
+  close();
+  filename = shardFile;
+  error.clear();
+  file = gzopen(shardFile.c_str(), "rb");
+  if (file == NULL) { return fail("could not open the shard file"); }
+  gzbuffer(file, 1048576);
+
+  char magic[4];
+  uint32_t version, required, excluded, lowCoverageFlag, numberThresholds, numberReferences, genes;
+  int32_t mappingQuality, baseQuality;
+  uint64_t runFingerprint, alignmentFingerprint, window;
+  if ( !readBytes(magic, 4) || !equal(magic, magic + 4, SHARD_MAGIC) ) { return fail("not a shard file"); }
+  if ( !readValue(version) || version != SHARD_VERSION ) { return fail("unsupported shard file version"); }
+  if ( !readValue(shard) || !readValue(numberShards) || !readValue(runFingerprint) || !readValue(alignmentFingerprint) ) { return fail("truncated header"); }
+  if ( !readValue(mappingQuality) || !readValue(baseQuality) || !readValue(required) || !readValue(excluded) || !readValue(window) ) { return fail("truncated header"); }
+  if ( !readValue(lowCoverageFlag) || !readValue(numberThresholds) ) { return fail("truncated header"); }
+  if (shard >= numberShards) { return fail("invalid shard number"); }
+  fingerprint       = runFingerprint;
+  alignments        = alignmentFingerprint;
+  minMappingQuality = mappingQuality;
+  minBaseQuality    = baseQuality;
+  requiredFlags     = required;
+  excludedFlags     = excluded;
+  mateWindow        = window;
+  lowCoverage       = (lowCoverageFlag != 0);
+
+  thresholds.resize(numberThresholds);
+  for (size_t i = 0; i < thresholds.size(); ++i) {
+    int32_t threshold;
+    if ( !readValue(threshold) ) { return fail("truncated header"); }
+    thresholds[i] = threshold;
+  }
+  if ( !readValue(numberReferences) ) { return fail("truncated header"); }
+  references.clear();
+  for (uint32_t i = 0; i < numberReferences; ++i) {
+    uint32_t length;
+    int32_t referenceLength;
+    if ( !readValue(length) ) { return fail("truncated header"); }
+    string name(length, '\0');
+    if ( (length > 0 && !readBytes(&name[0], length)) || !readValue(referenceLength) ) { return fail("truncated header"); }
+    references.push_back(RefData(name, referenceLength));
+  }
+  if ( !readValue(genes) ) { return fail("truncated header"); }
+  numberGenes = genes;
+  genesRead   = 0;
+  next();
+  return error.empty();
+}
+
+// Read the next gene record. Returns false once all the genes have been read, or on an error, in
+// which case errorString is set.
+bool shardReader::next(void) {
+  currentGene = NO_REGION;
+  if (genesRead == numberGenes) {
+    char trailer[4];
+    if ( !readBytes(trailer, 4) || !equal(trailer, trailer + 4, SHARD_TRAILER) ) { return fail("truncated file"); }
+    return false;
+  }
+
+  uint32_t gene, numberDepths, numberIntervals, numberFeatures;
+  if ( !readValue(gene) ) { return fail("truncated file"); }
+
+  basesAbove.resize(thresholds.size());
+  for (size_t i = 0; i < basesAbove.size(); ++i) {
+    uint64_t bases;
+    if ( !readValue(bases) ) { return fail("truncated file"); }
+    basesAbove[i] = bases;
+  }
+  depths.clear();
+  if ( !readValue(numberDepths) ) { return fail("truncated file"); }
+  for (uint32_t i = 0; i < numberDepths; ++i) {
+    int32_t depth;
+    uint64_t count;
+    if ( !readValue(depth) || !readValue(count) ) { return fail("truncated file"); }
+    depths.add(depth, count);
+  }
+
+  if ( !readValue(numberIntervals) ) { return fail("truncated file"); }
+  lowCoverageIntervals.resize(numberIntervals);
+  for (uint32_t i = 0; i < numberIntervals; ++i) {
+    uint32_t feature;
+    int32_t start, end;
+    if ( !readValue(feature) || !readValue(start) || !readValue(end) ) { return fail("truncated file"); }
+    lowCoverageIntervals[i].feature = feature;
+    lowCoverageIntervals[i].start   = start;
+    lowCoverageIntervals[i].end     = end;
+  }
+
+  if ( !readValue(numberFeatures) ) { return fail("truncated file"); }
+  features.resize(numberFeatures);
+  featureAbove.resize(size_t(numberFeatures) * thresholds.size());
+  for (uint32_t i = 0; i < numberFeatures; ++i) {
+    shardFeature& feature = features[i];
+    if ( !readValue(feature.feature) || !readValue(feature.min) || !readValue(feature.max) || !readValue(feature.q1) || !readValue(feature.median) ||
+         !readValue(feature.q3) || !readValue(feature.mean) || !readValue(feature.sd) ) { return fail("truncated file"); }
+    if ( !thresholds.empty() && !readBytes(&featureAbove[i * thresholds.size()], sizeof(double) * thresholds.size()) ) { return fail("truncated file"); }
+  }
+
+  genesRead++;
+  currentGene = gene;
+  return true;
+}
+
+// Add the current gene record to the results for the gene. The features must already have been
+// added to the coverageData.
+void shardReader::addTo(coverageData& cov) const {
+  size_t numberThresholds = thresholds.size();
+  for (size_t i = 0; i < features.size(); ++i) {
+    const shardFeature& feature = features[i];
+    unsigned int f = feature.feature;
+    cov.featureMin[f]    = feature.min;
+    cov.featureMax[f]    = feature.max;
+    cov.featureQ1[f]     = feature.q1;
+    cov.featureMedian[f] = feature.median;
+    cov.featureQ3[f]     = feature.q3;
+    cov.featureMean[f]   = feature.mean;
+    cov.featureSd[f]     = feature.sd;
+    for (size_t j = 0; j < numberThresholds; ++j) { cov.featureAbove[f * numberThresholds + j] = featureAbove[i * numberThresholds + j]; }
+  }
+  cov.lowCoverage.insert(cov.lowCoverage.end(), lowCoverageIntervals.begin(), lowCoverageIntervals.end());
+  cov.addGeneTotals(depths, basesAbove);
+}
@@ -0,0 +1,144 @@
+// ***************************************************************************
+// Alistair Ward
+// Marth Lab, USTAR Center for Genetic Discovery
+// University of Utah School of Medicine
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Write and read the partial results of a shard of a run
+// ***************************************************************************
+
+#ifndef SHARD_RESULTS_H
+#define SHARD_RESULTS_H
+
+#include "coverageEngine.h"
+#include "dataProcessing.h"
+#include "depthHistogram.h"
+#include "outputWriter.h"
+#include "readFilter.h"
+#include "regions.h"
+#include <stdint.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// A shard file holds the results for the genes with regions in one shard of a
+// run, enough to give exactly the output of a single run once the shards are
+// merged. All values are in native byte order. The file is laid out as:
+//   header      magic, version, shard, number of shards, region fingerprint,
+//               alignment fingerprint, the read filter settings (minimum
+//               mapping and base quality, required and excluded flags and the
+//               mate window, zero if mates are not tracked), whether low
+//               coverage intervals are held, the depth thresholds, the
+//               reference sequences and the number of genes
+//   genes       a record for each gene, in gene order
+//   trailer     magic, so that a truncated file is detected
+// Each gene record holds the number of the gene in the full region table, the
+// gene level totals (the bases at or above each threshold and the histogram of
+// depths), the low coverage intervals and the statistics for each feature in
+// the shard, with the features numbered within the full gene.
+#define SHARD_VERSION 2
+
+// The full region table and the part of it calculated by a shard, with the
+// number of each region of the part in the full table, and the fingerprint of
+// the alignments the shard is calculated from.
+struct shardMapping {
+  regionTable table;
+  vector<unsigned int> originalRegions;
+  unsigned int shard;
+  unsigned int numberShards;
+  unsigned long long alignments;
+};
+
+// Write the header and trailer of a shard file.
+void writeShardHeader(outputWriter&, const shardMapping&, const regionTable&, const statisticsOptions&, const readFilter&, const RefVector&);
+void writeShardTrailer(outputWriter&);
+
+// A consumer writing the record for each gene of a shard, with the genes and
+// features numbered as in the full region table.
+class shardWriter : public coverageConsumer {
+
+  public:
+    shardWriter(outputWriter&, const shardMapping&, const regionTable&);
+    ~shardWriter(void);
+
+  // Public methods.
+  public:
+    void gene(unsigned int, const coverageData&);
+
+  private:
+    template <typename T> void writeValue(T value) { out.write((const char*)&value, sizeof(T)); }
+
+    outputWriter& out;
+    const shardMapping& mapping;
+    const regionTable& part;
+    vector< pair<int, unsigned long> > depths;
+};
+
+// Read the gene records from a shard file, which may be compressed.
+class shardReader {
+
+  public:
+    shardReader(void);
+    ~shardReader(void);
+
+  // Public methods.
+  public:
+    bool open(const string&);
+    void close(void);
+    bool next(void);
+    void addTo(coverageData&) const;
+    unsigned int gene(void) const { return currentGene; }
+    const string& errorString(void) const { return error; }
+
+  // The header.
+  public:
+    unsigned int shard;
+    unsigned int numberShards;
+    unsigned long long fingerprint;
+    unsigned long long alignments;
+    int minMappingQuality;
+    int minBaseQuality;
+    unsigned int requiredFlags;
+    unsigned int excludedFlags;
+    unsigned long long mateWindow;
+    bool lowCoverage;
+    vector<int> thresholds;
+    RefVector references;
+    unsigned int numberGenes;
+
+  private:
+    template <typename T> bool readValue(T& value) { return readBytes(&value, sizeof(T)); }
+    bool readBytes(void*, size_t);
+    bool fail(const string&);
+
+    // The results for a feature.
+    struct shardFeature {
+      uint32_t feature;
+      int32_t min;
+      int32_t max;
+      double q1;
+      double median;
+      double q3;
+      double mean;
+      double sd;
+    };
+
+    gzFile file;
+    string filename;
+    string error;
+    unsigned int genesRead;
+
+    // The current gene record, or NO_REGION once all have been read.
+    unsigned int currentGene;
+    vector<unsigned long> basesAbove;
+    depthHistogram depths;
+    vector<lowCoverageInterval> lowCoverageIntervals;
+    vector<shardFeature> features;
+    vector<double> featureAbove;
+};
+
+#endif // SHARD_RESULTS_H